@@ -51,6 +51,7 @@ int dbg;
 int print_delays;
 int print_io_accounting;
 int print_task_context_switch_counts;
+int print_fairamp;
 __u64 stime, utime;
 
 #define PRINTF(fmt, arg...) {			\
@@ -74,9 +75,10 @@ char cpumask[100+6*MAX_CPUS];
 
 static void usage(void)
 {
-	fprintf(stderr, "getdelays [-dilv] [-w logfile] [-r bufsize] "
+	fprintf(stderr, "getdelays [-dilva] [-w logfile] [-r bufsize] "
 			"[-m cpumask] [-t tgid] [-p pid]\n");
 	fprintf(stderr, "  -d: print delayacct stats\n");
+	fprintf(stderr, "  -a: print FAIRAMP fast/slow core stats\n");
 	fprintf(stderr, "  -i: print IO accounting (works only with -p)\n");
 	fprintf(stderr, "  -l: listen forever\n");
 	fprintf(stderr, "  -v: debug on\n");
@@ -233,6 +235,21 @@ static void task_context_switch_counts(struct taskstats *t)
 	       (unsigned long long)t->nvcsw, (unsigned long long)t->nivcsw);
 }
 
+static void print_fairampacct(struct taskstats *t)
+{
+	printf("\n\nFAIRAMP%15s%15s%15s%15s%11s%11s%8s\n"
+	       "       %15llu%15llu%15llu%15llu%11llu%11llu%8lld\n",
+	       "fast_exec(ns)", "slow_exec(ns)", "insts_fast", "insts_slow",
+	       "fast_round", "slow_round", "lagged",
+	       (unsigned long long)t->fairamp_fast_exec_runtime,
+	       (unsigned long long)t->fairamp_slow_exec_runtime,
+	       (unsigned long long)t->fairamp_insts_fast,
+	       (unsigned long long)t->fairamp_insts_slow,
+	       (unsigned long long)t->fairamp_fast_round,
+	       (unsigned long long)t->fairamp_slow_round,
+	       (long long)t->fairamp_lagged);
+}
+
 static void print_cgroupstats(struct cgroupstats *c)
 {
 	printf("sleeping %llu, blocked %llu, running %llu, stopped %llu, "
@@ -281,7 +298,7 @@ int main(int argc, char *argv[])
 	struct msgtemplate msg;
 
 	while (!forking) {
-		c = getopt(argc, argv, "qdiw:r:m:t:p:vlC:c:");
+		c = getopt(argc, argv, "qdiaw:r:m:t:p:vlC:c:");
 		if (c < 0)
 			break;
 
@@ -294,6 +311,10 @@ int main(int argc, char *argv[])
 			printf("printing IO accounting\n");
 			print_io_accounting = 1;
 			break;
+		case 'a':
+			printf("printing FAIRAMP fast/slow core stats\n");
+			print_fairamp = 1;
+			break;
 		case 'q':
 			printf("printing task/process context switch rates\n");
 			print_task_context_switch_counts = 1;
@@ -496,6 +517,8 @@ int main(int argc, char *argv[])
 							print_ioacct((struct taskstats *) NLA_DATA(na));
 						if (print_task_context_switch_counts)
 							task_context_switch_counts((struct taskstats *) NLA_DATA(na));
+						if (print_fairamp)
+							print_fairampacct((struct taskstats *) NLA_DATA(na));
 						if (fd) {
 							if (write(fd, NLA_DATA(na), na->nla_len) < 0) {
 								err(1,"write error\n");
@@ -902,6 +902,11 @@ void update_cpu_IPS_type(void *__not_in_cs) {
 	insts += M_INST_THRESHOLD * ovf; /* overflowed values */
 
 	atomic64_add(insts, is_fast ? &p->insts_fast : &p->insts_slow);
+#ifdef CONFIG_FAIRAMP_NUMA
+	/* the IPS away from the home node shows the remote access penalty */
+	if (fairamp_home_node(p) >= 0 && fairamp_home_node(p) != cpu_to_node(cpu))
+		atomic64_add(insts, &p->insts_remote);
+#endif
 
 	if (not_in_cs) { /* if not called by context_switch() */
 		update_cpu_time_type(NULL); /* in context_switch(), time information is already updated */
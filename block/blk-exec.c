@@ -5,6 +5,7 @@
 #include <linux/module.h>
 #include <linux/bio.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 
 #include "blk.h"
 
@@ -23,7 +24,9 @@ static void blk_end_sync_rq(struct request *rq, int error)
 	struct completion *waiting = rq->end_io_data;
 
 	rq->end_io_data = NULL;
-	__blk_put_request(rq->q, rq);
+	/* blk-mq requests are not refcounted, blk_put_request() frees them */
+	if (!rq->q->mq_ops)
+		__blk_put_request(rq->q, rq);
 
 	/*
 	 * complete last, if this is a stack request the process (and thus
@@ -64,6 +67,17 @@ void blk_execute_rq_nowait(struct request_queue *q, struct gendisk *bd_disk,
 	 */
 	is_pm_resume = rq->cmd_type == REQ_TYPE_PM_RESUME;
 
+	if (q->mq_ops) {
+		if (unlikely(blk_queue_dead(q))) {
+			rq->errors = -ENXIO;
+			if (rq->end_io)
+				rq->end_io(rq, rq->errors);
+			return;
+		}
+		blk_mq_insert_request(q, rq, true);
+		return;
+	}
+
 	spin_lock_irq(q->queue_lock);
 
 	if (unlikely(blk_queue_dead(q))) {
@@ -0,0 +1,161 @@
+/*
+ * Tag allocation for the multiqueue block layer
+ *
+ * Tags live in one bitmap per hardware queue.  Every cpu starts its search
+ * where its last allocation left off, and the cpus start out spread over
+ * the map, so cpus submitting at the same time mostly touch different
+ * words of the bitmap.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+
+#include <linux/blk-mq.h>
+#include "blk-mq-tag.h"
+
+static unsigned int __blk_mq_get_tag(struct blk_mq_tags *tags)
+{
+	unsigned int *hint, start, tag;
+
+	hint = get_cpu_ptr(tags->hint);
+	start = *hint;
+	if (start >= tags->nr_tags)
+		start = 0;
+
+	tag = start;
+	do {
+		tag = find_next_zero_bit(tags->map, tags->nr_tags, tag);
+		if (tag >= tags->nr_tags) {
+			if (!start)
+				break;
+			/* wrap around once, up to where we started */
+			tag = find_next_zero_bit(tags->map, start, 0);
+			if (tag >= start)
+				break;
+			start = 0;
+		}
+		if (!test_and_set_bit(tag, tags->map)) {
+			*hint = tag + 1;
+			put_cpu_ptr(tags->hint);
+			return tag;
+		}
+	} while (1);
+
+	put_cpu_ptr(tags->hint);
+	return BLK_MQ_TAG_FAIL;
+}
+
+/**
+ * blk_mq_get_tag - allocate a tag
+ * @tags:	tag map to allocate from
+ * @gfp:	with __GFP_WAIT, sleep until a tag is freed
+ *
+ * Returns a tag, or %BLK_MQ_TAG_FAIL if none is free and @gfp does not
+ * allow sleeping.
+ */
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp)
+{
+	unsigned int tag;
+	DEFINE_WAIT(wait);
+
+	tag = __blk_mq_get_tag(tags);
+	if (tag != BLK_MQ_TAG_FAIL || !(gfp & __GFP_WAIT))
+		return tag;
+
+	do {
+		prepare_to_wait_exclusive(&tags->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		tag = __blk_mq_get_tag(tags);
+		if (tag != BLK_MQ_TAG_FAIL)
+			break;
+		io_schedule();
+	} while (1);
+
+	finish_wait(&tags->wait, &wait);
+	return tag;
+}
+
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	BUG_ON(tag >= tags->nr_tags);
+
+	clear_bit(tag, tags->map);
+	/* pairs with the set_current_state() in prepare_to_wait */
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&tags->wait))
+		wake_up(&tags->wait);
+}
+
+bool blk_mq_has_free_tags(struct blk_mq_tags *tags)
+{
+	return find_first_zero_bit(tags->map, tags->nr_tags) < tags->nr_tags;
+}
+
+bool blk_mq_tags_idle(struct blk_mq_tags *tags)
+{
+	return bitmap_empty(tags->map, tags->nr_tags);
+}
+
+/*
+ * Call @fn for every tag in use.  Tags may be freed and allocated again
+ * behind our back, so @fn has to cope with requests that are not in flight.
+ */
+void blk_mq_tag_busy_iter(struct blk_mq_tags *tags,
+			  void (*fn)(void *data, unsigned int tag),
+			  void *data)
+{
+	unsigned int tag;
+
+	for_each_set_bit(tag, tags->map, tags->nr_tags)
+		fn(data, tag);
+}
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node)
+{
+	struct blk_mq_tags *tags;
+	int cpu, i = 0;
+
+	if (!nr_tags || nr_tags > BLK_MQ_MAX_DEPTH) {
+		pr_err("blk-mq: tag depth %u is out of range\n", nr_tags);
+		return NULL;
+	}
+
+	tags = kzalloc_node(sizeof(*tags), GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->nr_tags = nr_tags;
+	init_waitqueue_head(&tags->wait);
+
+	tags->map = kzalloc_node(BITS_TO_LONGS(nr_tags) * sizeof(long),
+				 GFP_KERNEL, node);
+	if (!tags->map)
+		goto err_map;
+
+	tags->hint = alloc_percpu(unsigned int);
+	if (!tags->hint)
+		goto err_hint;
+
+	/* spread the cpus over the map */
+	for_each_possible_cpu(cpu)
+		*per_cpu_ptr(tags->hint, cpu) =
+			(i++ * nr_tags) / num_possible_cpus();
+
+	return tags;
+
+err_hint:
+	kfree(tags->map);
+err_map:
+	kfree(tags);
+	return NULL;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	free_percpu(tags->hint);
+	kfree(tags->map);
+	kfree(tags);
+}
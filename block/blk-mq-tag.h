@@ -0,0 +1,27 @@
+#ifndef INT_BLK_MQ_TAG_H
+#define INT_BLK_MQ_TAG_H
+
+/*
+ * Tag address space map.
+ */
+struct blk_mq_tags {
+	unsigned int nr_tags;
+	unsigned long *map;		/* set bits are tags in use */
+	unsigned int __percpu *hint;	/* where a cpu looks first */
+	wait_queue_head_t wait;
+};
+
+#define BLK_MQ_TAG_FAIL		-1U
+
+extern struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node);
+extern void blk_mq_free_tags(struct blk_mq_tags *tags);
+
+extern unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp);
+extern void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag);
+extern bool blk_mq_has_free_tags(struct blk_mq_tags *tags);
+extern bool blk_mq_tags_idle(struct blk_mq_tags *tags);
+extern void blk_mq_tag_busy_iter(struct blk_mq_tags *tags,
+				 void (*fn)(void *data, unsigned int tag),
+				 void *data);
+
+#endif
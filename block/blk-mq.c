@@ -0,0 +1,899 @@
+/*
+ * Block multiqueue core code
+ *
+ * Requests are staged on per-cpu software queues and dispatched to the
+ * driver through one or more hardware queues.  Every cpu maps to exactly
+ * one hardware queue.  A submitter only takes the lock of its own software
+ * queue, and requests come from a preallocated pool indexed by a per
+ * hardware queue tag map, so nothing on the submission or completion path
+ * is shared by all the cpus.  Completions are sent back to the submitting
+ * cpu if the queue asks for that.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/backing-dev.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/mm.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/smp.h>
+#include <linux/cache.h>
+#include <linux/sched.h>
+#include <linux/delay.h>
+#include <linux/writeback.h>
+#include <linux/cpu.h>
+
+#include <trace/events/block.h>
+
+#include <linux/blk-mq.h>
+#include "blk.h"
+#include "blk-mq.h"
+#include "blk-mq-tag.h"
+
+/*
+ * Check if any of the ctx's have pending work in this hardware queue
+ */
+static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	return !list_empty_careful(&hctx->dispatch) ||
+		find_first_bit(hctx->ctx_map, hctx->nr_ctx) < hctx->nr_ctx;
+}
+
+/*
+ * Mark this ctx as having pending work in this hardware queue
+ */
+static void blk_mq_hctx_mark_pending(struct blk_mq_hw_ctx *hctx,
+				     struct blk_mq_ctx *ctx)
+{
+	if (!test_bit(ctx->index_hw, hctx->ctx_map))
+		set_bit(ctx->index_hw, hctx->ctx_map);
+}
+
+static struct request *__blk_mq_alloc_request(struct blk_mq_hw_ctx *hctx,
+					      gfp_t gfp)
+{
+	struct request *rq;
+	unsigned int tag;
+
+	tag = blk_mq_get_tag(hctx->tags, gfp);
+	if (tag == BLK_MQ_TAG_FAIL)
+		return NULL;
+
+	rq = hctx->rqs[tag];
+	rq->tag = tag;
+	return rq;
+}
+
+static void blk_mq_rq_ctx_init(struct request_queue *q, struct blk_mq_ctx *ctx,
+			       struct request *rq, unsigned int rw_flags)
+{
+	int tag = rq->tag;
+
+	if (blk_queue_io_stat(q))
+		rw_flags |= REQ_IO_STAT;
+
+	blk_rq_init(q, rq);
+	rq->tag = tag;
+	rq->mq_ctx = ctx;
+	rq->cmd_flags = rw_flags;
+	ctx->rq_dispatched[rw_is_sync(rw_flags)]++;
+}
+
+/*
+ * Get a request from the hardware queue of the current cpu.  If all of its
+ * tags are in flight and @gfp allows it, push out what is queued and wait
+ * for a tag to come back.
+ */
+static struct request *blk_mq_get_request(struct request_queue *q, int rw,
+					  gfp_t gfp)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	rq = __blk_mq_alloc_request(hctx, gfp & ~__GFP_WAIT);
+	blk_mq_put_ctx(ctx);
+
+	if (unlikely(!rq)) {
+		if (!(gfp & __GFP_WAIT))
+			return NULL;
+		blk_mq_run_hw_queue(hctx, false);
+		rq = __blk_mq_alloc_request(hctx, gfp);
+	}
+
+	blk_mq_rq_ctx_init(q, ctx, rq, rw);
+	return rq;
+}
+
+struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
+				     gfp_t gfp)
+{
+	if (blk_queue_dead(q))
+		return NULL;
+
+	return blk_mq_get_request(q, rw, gfp);
+}
+EXPORT_SYMBOL(blk_mq_alloc_request);
+
+void blk_mq_free_request(struct request *rq)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	ctx->rq_completed[rq_is_sync(rq)]++;
+
+	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+	blk_mq_put_tag(hctx->tags, rq->tag);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+/**
+ * blk_mq_end_io - end all of a request
+ * @rq:		the request being processed
+ * @error:	%0 for success, < %0 for error
+ *
+ * Description:
+ *     Ends the I/O on all of @rq and frees it, or hands it to its end_io
+ *     callback.  May be called from any context.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	if (unlikely(laptop_mode) && rq->cmd_type == REQ_TYPE_FS)
+		laptop_io_completion(&rq->q->backing_dev_info);
+
+	blk_account_io_done(rq);
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void blk_mq_end_io_default(struct request *rq)
+{
+	blk_mq_end_io(rq, rq->errors);
+}
+
+#if defined(CONFIG_SMP) && defined(CONFIG_USE_GENERIC_SMP_HELPERS)
+static void __blk_mq_complete_request_remote(void *data)
+{
+	struct request *rq = data;
+
+	rq->q->softirq_done_fn(rq);
+}
+
+static void __blk_mq_complete_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	int cpu, submit_cpu = rq->mq_ctx->cpu;
+	bool local;
+
+	if (!test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags)) {
+		q->softirq_done_fn(rq);
+		return;
+	}
+
+	cpu = get_cpu();
+	if (test_bit(QUEUE_FLAG_SAME_FORCE, &q->queue_flags))
+		local = cpu == submit_cpu;
+	else
+		local = cpus_share_cache(cpu, submit_cpu);
+
+	if (!local && cpu_online(submit_cpu)) {
+		rq->csd.func = __blk_mq_complete_request_remote;
+		rq->csd.info = rq;
+		rq->csd.flags = 0;
+		__smp_call_function_single(submit_cpu, &rq->csd, 0);
+	} else
+		q->softirq_done_fn(rq);
+	put_cpu();
+}
+#else
+static void __blk_mq_complete_request(struct request *rq)
+{
+	rq->q->softirq_done_fn(rq);
+}
+#endif
+
+/**
+ * blk_mq_complete_request - end I/O on a request
+ * @rq:		the request being processed
+ *
+ * Description:
+ *     Ends the I/O on @rq through the queue's completion handler, on the
+ *     cpu that submitted it if the queue has QUEUE_FLAG_SAME_COMP set.
+ *     A request that already timed out is left alone.
+ **/
+void blk_mq_complete_request(struct request *rq)
+{
+	if (unlikely(blk_should_fake_timeout(rq->q)))
+		return;
+	if (!blk_mark_rq_complete(rq))
+		__blk_mq_complete_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_complete_request);
+
+static void blk_mq_start_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	trace_block_rq_issue(q, rq);
+
+	rq->resid_len = blk_rq_bytes(rq);
+	rq->deadline = jiffies + q->rq_timeout;
+
+	/* the timeout scan must see the deadline once it sees STARTED */
+	smp_wmb();
+	set_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+
+	if (!timer_pending(&q->timeout))
+		mod_timer(&q->timeout, round_jiffies_up(rq->deadline));
+}
+
+static void blk_mq_requeue_request(struct request *rq)
+{
+	trace_block_rq_requeue(rq->q, rq);
+	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+}
+
+struct blk_mq_timeout_data {
+	struct blk_mq_hw_ctx *hctx;
+	unsigned long next;
+	bool next_set;
+};
+
+static void blk_mq_rq_timed_out(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	enum blk_eh_timer_return ret = BLK_EH_RESET_TIMER;
+
+	if (q->mq_ops->timeout)
+		ret = q->mq_ops->timeout(rq);
+
+	switch (ret) {
+	case BLK_EH_HANDLED:
+		__blk_mq_complete_request(rq);
+		break;
+	case BLK_EH_RESET_TIMER:
+		rq->deadline = jiffies + q->rq_timeout;
+		blk_clear_rq_complete(rq);
+		if (!timer_pending(&q->timeout))
+			mod_timer(&q->timeout, round_jiffies_up(rq->deadline));
+		break;
+	case BLK_EH_NOT_HANDLED:
+		/* the driver owns the request now */
+		break;
+	default:
+		printk(KERN_ERR "block: bad eh return: %d\n", ret);
+		break;
+	}
+}
+
+static void blk_mq_check_expired(void *__data, unsigned int tag)
+{
+	struct blk_mq_timeout_data *data = __data;
+	struct request *rq = data->hctx->rqs[tag];
+
+	if (!test_bit(REQ_ATOM_STARTED, &rq->atomic_flags))
+		return;
+	smp_rmb();
+
+	if (time_after_eq(jiffies, rq->deadline)) {
+		if (!blk_mark_rq_complete(rq))
+			blk_mq_rq_timed_out(rq);
+	} else if (!data->next_set || time_after(data->next, rq->deadline)) {
+		data->next = rq->deadline;
+		data->next_set = true;
+	}
+}
+
+static void blk_mq_rq_timer(unsigned long data)
+{
+	struct request_queue *q = (struct request_queue *) data;
+	struct blk_mq_timeout_data tdata = { .next_set = false };
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		tdata.hctx = hctx;
+		blk_mq_tag_busy_iter(hctx->tags, blk_mq_check_expired, &tdata);
+	}
+
+	if (tdata.next_set)
+		mod_timer(&q->timeout, round_jiffies_up(tdata.next));
+}
+
+/*
+ * Move the requests of all the software queues with pending work onto
+ * @list.  A software queue marked after we looked at it gets picked up by
+ * the run its submitter kicks off.
+ */
+static void flush_busy_ctxs(struct blk_mq_hw_ctx *hctx, struct list_head *list)
+{
+	struct blk_mq_ctx *ctx;
+	int i;
+
+	for_each_set_bit(i, hctx->ctx_map, hctx->nr_ctx) {
+		ctx = hctx->ctxs[i];
+		clear_bit(i, hctx->ctx_map);
+
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, list);
+		spin_unlock(&ctx->lock);
+	}
+}
+
+/*
+ * Run this hardware queue, pulling any software queues mapped to it in.
+ * Note that this function currently has various problems around ordering
+ * of IO. In particular, we'd like FIFO behaviour on handling existing
+ * items on the hctx->dispatch list. Ignore that for now.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	int ret;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	hctx->run++;
+
+	/*
+	 * Touch any software queue that has pending entries.
+	 */
+	flush_busy_ctxs(hctx, &rq_list);
+
+	/*
+	 * If we have previous entries on our dispatch list, grab them
+	 * and dispatch them first.
+	 */
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	/*
+	 * Now process all the entries, sending them to the driver.
+	 */
+	while (!list_empty(&rq_list)) {
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		blk_mq_start_request(rq);
+
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		switch (ret) {
+		case BLK_MQ_RQ_QUEUE_OK:
+			continue;
+		case BLK_MQ_RQ_QUEUE_BUSY:
+			/*
+			 * The driver stopped the queue with
+			 * blk_mq_stop_hw_queue() before saying busy, so the
+			 * request waits on hctx->dispatch until it restarts it.
+			 */
+			list_add(&rq->queuelist, &rq_list);
+			blk_mq_requeue_request(rq);
+			break;
+		default:
+			pr_err("blk-mq: bad return on queue: %d\n", ret);
+			/* fall through */
+		case BLK_MQ_RQ_QUEUE_ERROR:
+			rq->errors = -EIO;
+			blk_mq_end_io(rq, rq->errors);
+			continue;
+		}
+		break;
+	}
+
+	/*
+	 * Any items that need requeuing? Stuff them into hctx->dispatch,
+	 * that is where we will continue on next queue run.
+	 */
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+	}
+}
+
+/**
+ * blk_mq_run_hw_queue - send the queued requests of a hardware queue
+ * @hctx:	hardware queue to run
+ * @async:	leave the work to kblockd
+ *
+ * Description:
+ *     The queue is run right away if the caller is on one of the cpus of
+ *     @hctx and does not ask for @async, else from kblockd.  Nothing is
+ *     done while the queue is stopped.
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (!async && !in_interrupt() &&
+	    cpumask_test_cpu(raw_smp_processor_id(), hctx->cpumask))
+		__blk_mq_run_hw_queue(hctx);
+	else
+		kblockd_schedule_delayed_work(hctx->queue, &hctx->run_work, 0);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!blk_mq_hctx_has_pending(hctx))
+			continue;
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+/**
+ * blk_mq_stop_hw_queue - stop dispatching to a hardware queue
+ * @hctx:	hardware queue to stop
+ *
+ * Description:
+ *     A driver that returns %BLK_MQ_RQ_QUEUE_BUSY from ->queue_rq stops the
+ *     queue first, and restarts it with blk_mq_start_stopped_hw_queues()
+ *     once it can take requests again.  Requests keep queueing meanwhile.
+ */
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	cancel_delayed_work(&hctx->run_work);
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+void blk_mq_start_stopped_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+		blk_mq_run_hw_queue(hctx, true);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static void blk_mq_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, run_work.work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
+				    struct blk_mq_ctx *ctx, struct request *rq)
+{
+	trace_block_rq_insert(hctx->queue, rq);
+
+	list_add_tail(&rq->queuelist, &ctx->rq_list);
+	blk_mq_hctx_mark_pending(hctx, ctx);
+	hctx->queued++;
+}
+
+void blk_mq_insert_request(struct request_queue *q, struct request *rq,
+			   bool run_queue)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	spin_lock(&ctx->lock);
+	__blk_mq_insert_request(hctx, ctx, rq);
+	spin_unlock(&ctx->lock);
+
+	if (run_queue)
+		blk_mq_run_hw_queue(hctx, false);
+}
+EXPORT_SYMBOL(blk_mq_insert_request);
+
+static void blk_mq_unplug(struct blk_plug_cb *cb, bool from_schedule)
+{
+	struct blk_mq_hw_ctx *hctx = cb->data;
+
+	kfree(cb);
+	blk_mq_run_hw_queue(hctx, from_schedule);
+}
+
+static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	const int is_sync = rw_is_sync(bio->bi_rw);
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	int rw_flags;
+
+	if (unlikely(blk_queue_dead(q))) {
+		bio_endio(bio, -ENODEV);
+		return;
+	}
+
+	/*
+	 * low level driver can indicate that it wants pages above a
+	 * certain limit bounced to low memory (ie for highmem, or even
+	 * ISA dma in theory)
+	 */
+	blk_queue_bounce(q, &bio);
+
+	rw_flags = bio_data_dir(bio);
+	if (is_sync)
+		rw_flags |= REQ_SYNC;
+
+	trace_block_getrq(q, bio, rw_flags);
+	rq = blk_mq_get_request(q, rw_flags, GFP_NOIO);
+
+	/* we may have slept for the tag while @q was being torn down */
+	if (unlikely(blk_queue_dead(q))) {
+		blk_mq_free_request(rq);
+		bio_endio(bio, -ENODEV);
+		return;
+	}
+
+	init_request_from_bio(rq, bio);
+	drive_stat_acct(rq, 1);
+
+	ctx = rq->mq_ctx;
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	spin_lock(&ctx->lock);
+	__blk_mq_insert_request(hctx, ctx, rq);
+	spin_unlock(&ctx->lock);
+
+	/*
+	 * Under a plug, leave the request in the software queue and run
+	 * the hardware queue once at unplug time, so that the requests go
+	 * out to the driver as a batch.
+	 */
+	if (blk_check_plugged(blk_mq_unplug, hctx, sizeof(struct blk_plug_cb)))
+		return;
+
+	blk_mq_run_hw_queue(hctx, !is_sync);
+}
+
+/*
+ * Default mapping to a software queue, since we use one per CPU.
+ */
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+static void blk_mq_free_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	if (hctx->rqs) {
+		for (i = 0; i < hctx->queue_depth; i++)
+			kfree(hctx->rqs[i]);
+		kfree(hctx->rqs);
+	}
+	if (hctx->tags)
+		blk_mq_free_tags(hctx->tags);
+	kfree(hctx->ctx_map);
+	kfree(hctx->ctxs);
+	free_cpumask_var(hctx->cpumask);
+	kfree(hctx);
+}
+
+/*
+ * Preallocate the requests of a hardware queue, each followed by
+ * @cmd_size bytes for the driver.
+ */
+static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
+			      unsigned int cmd_size, int node)
+{
+	size_t rq_size;
+	unsigned int i;
+
+	rq_size = round_up(sizeof(struct request) + cmd_size,
+			   cache_line_size());
+
+	hctx->rqs = kzalloc_node(hctx->queue_depth * sizeof(struct request *),
+				 GFP_KERNEL, node);
+	if (!hctx->rqs)
+		return -ENOMEM;
+
+	for (i = 0; i < hctx->queue_depth; i++) {
+		hctx->rqs[i] = kzalloc_node(rq_size, GFP_KERNEL, node);
+		if (!hctx->rqs[i])
+			return -ENOMEM;
+	}
+
+	hctx->tags = blk_mq_init_tags(hctx->queue_depth, node);
+	if (!hctx->tags)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int blk_mq_init_hw_queues(struct request_queue *q,
+				 struct blk_mq_reg *reg, void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i, j;
+
+	/*
+	 * Initialize hardware queues
+	 */
+	queue_for_each_hw_ctx(q, hctx, i) {
+		int node;
+
+		node = hctx->numa_node;
+		if (node == NUMA_NO_NODE)
+			node = hctx->numa_node = reg->numa_node;
+
+		INIT_DELAYED_WORK(&hctx->run_work, blk_mq_work_fn);
+		spin_lock_init(&hctx->lock);
+		INIT_LIST_HEAD(&hctx->dispatch);
+		hctx->queue = q;
+		hctx->queue_num = i;
+		hctx->queue_depth = reg->queue_depth;
+
+		hctx->ctxs = kmalloc_node(nr_cpu_ids * sizeof(void *),
+					  GFP_KERNEL, node);
+		if (!hctx->ctxs)
+			break;
+
+		hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(nr_cpu_ids) *
+					     sizeof(unsigned long),
+					     GFP_KERNEL, node);
+		if (!hctx->ctx_map)
+			break;
+
+		if (blk_mq_init_rq_map(hctx, reg->cmd_size, node))
+			break;
+
+		if (reg->ops->init_hctx &&
+		    reg->ops->init_hctx(hctx, driver_data, i))
+			break;
+	}
+
+	if (i == q->nr_hw_queues)
+		return 0;
+
+	/*
+	 * Init failed
+	 */
+	queue_for_each_hw_ctx(q, hctx, j) {
+		if (j < i && reg->ops->exit_hctx)
+			reg->ops->exit_hctx(hctx, j);
+		blk_mq_free_hw_queue(hctx);
+		q->queue_hw_ctx[j] = NULL;
+	}
+
+	return 1;
+}
+
+static void blk_mq_init_cpu_queues(struct request_queue *q,
+				   struct blk_mq_reg *reg)
+{
+	unsigned int i;
+
+	for_each_possible_cpu(i) {
+		struct blk_mq_ctx *__ctx = per_cpu_ptr(q->queue_ctx, i);
+		struct blk_mq_hw_ctx *hctx;
+
+		memset(__ctx, 0, sizeof(*__ctx));
+		__ctx->cpu = i;
+		spin_lock_init(&__ctx->lock);
+		INIT_LIST_HEAD(&__ctx->rq_list);
+		__ctx->queue = q;
+
+		/*
+		 * Set local node, IFF we have more than one hw queue. If
+		 * not, we remain on the home node of the device
+		 */
+		hctx = reg->ops->map_queue(q, i);
+		if (reg->nr_hw_queues > 1 && hctx->numa_node == NUMA_NO_NODE)
+			hctx->numa_node = cpu_to_node(i);
+	}
+}
+
+static void blk_mq_map_swqueue(struct request_queue *q, struct blk_mq_reg *reg)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		cpumask_clear(hctx->cpumask);
+		hctx->nr_ctx = 0;
+	}
+
+	/*
+	 * Map software to hardware queues
+	 */
+	for_each_possible_cpu(i) {
+		ctx = per_cpu_ptr(q->queue_ctx, i);
+		hctx = reg->ops->map_queue(q, i);
+		cpumask_set_cpu(i, hctx->cpumask);
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+}
+
+/**
+ * blk_mq_init_queue - set up a multiqueue request queue
+ * @reg:	hardware queues, their depth and the driver operations
+ * @driver_data: passed to ->init_hctx
+ *
+ * Description:
+ *     Allocates a request queue with a software queue per cpu, mapped
+ *     onto @reg->nr_hw_queues hardware queues of @reg->queue_depth
+ *     requests each.  Must be paired with blk_cleanup_queue().
+ *
+ *     Returns the queue, or an ERR_PTR() on failure.
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct blk_mq_hw_ctx **hctxs;
+	struct blk_mq_ctx *ctx;
+	struct request_queue *q;
+	int i;
+
+	if (!reg->nr_hw_queues ||
+	    !reg->ops->queue_rq || !reg->ops->map_queue ||
+	    !reg->queue_depth || reg->queue_depth > BLK_MQ_MAX_DEPTH)
+		return ERR_PTR(-EINVAL);
+
+	ctx = alloc_percpu(struct blk_mq_ctx);
+	if (!ctx)
+		return ERR_PTR(-ENOMEM);
+
+	hctxs = kzalloc_node(reg->nr_hw_queues * sizeof(*hctxs), GFP_KERNEL,
+			     reg->numa_node);
+	if (!hctxs)
+		goto err_percpu;
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		hctxs[i] = kzalloc_node(sizeof(struct blk_mq_hw_ctx),
+					GFP_KERNEL, reg->numa_node);
+		if (!hctxs[i])
+			goto err_hctxs;
+
+		if (!zalloc_cpumask_var(&hctxs[i]->cpumask, GFP_KERNEL))
+			goto err_hctxs;
+
+		hctxs[i]->numa_node = NUMA_NO_NODE;
+		hctxs[i]->queue_num = i;
+	}
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		goto err_hctxs;
+
+	q->mq_map = kzalloc_node(nr_cpu_ids * sizeof(*q->mq_map), GFP_KERNEL,
+				 reg->numa_node);
+	if (!q->mq_map)
+		goto err_map;
+	if (blk_mq_update_queue_map(q->mq_map, reg->nr_hw_queues))
+		goto err_map;
+
+	setup_timer(&q->timeout, blk_mq_rq_timer, (unsigned long) q);
+	blk_queue_rq_timeout(q, reg->timeout ? reg->timeout : 30 * HZ);
+
+	q->nr_queues = nr_cpu_ids;
+	q->nr_hw_queues = reg->nr_hw_queues;
+
+	q->queue_ctx = ctx;
+	q->queue_hw_ctx = hctxs;
+
+	q->queue_flags |= QUEUE_FLAG_MQ_DEFAULT;
+
+	/*
+	 * This also sets hw/phys segments, boundary and size
+	 */
+	blk_queue_make_request(q, blk_mq_make_request);
+
+	if (reg->ops->complete)
+		blk_queue_softirq_done(q, reg->ops->complete);
+	else
+		blk_queue_softirq_done(q, blk_mq_end_io_default);
+
+	q->sg_reserved_size = INT_MAX;
+
+	blk_mq_init_cpu_queues(q, reg);
+
+	if (blk_mq_init_hw_queues(q, reg, driver_data))
+		goto err_hw;
+
+	blk_mq_map_swqueue(q, reg);
+
+	/* the queue is complete, from now on it is torn down as mq */
+	q->mq_ops = reg->ops;
+	return q;
+
+err_hw:
+	/* blk_mq_init_hw_queues() freed the hardware queues */
+	kfree(hctxs);
+	free_percpu(ctx);
+	q->queue_hw_ctx = NULL;
+	q->queue_ctx = NULL;
+	q->nr_hw_queues = 0;
+	kfree(q->mq_map);
+	q->mq_map = NULL;
+	blk_cleanup_queue(q);
+	return ERR_PTR(-ENOMEM);
+err_map:
+	kfree(q->mq_map);
+	q->mq_map = NULL;
+	blk_cleanup_queue(q);
+err_hctxs:
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		if (!hctxs[i])
+			break;
+		free_cpumask_var(hctxs[i]->cpumask);
+		kfree(hctxs[i]);
+	}
+	kfree(hctxs);
+err_percpu:
+	free_percpu(ctx);
+	return ERR_PTR(-ENOMEM);
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/*
+ * Wait for all the requests of @q to come back.  Called with @q marked
+ * dead, so no new requests come in.
+ */
+void blk_mq_drain_queue(struct request_queue *q)
+{
+	while (true) {
+		struct blk_mq_hw_ctx *hctx;
+		bool busy = false;
+		int i;
+
+		blk_mq_run_queues(q, false);
+
+		queue_for_each_hw_ctx(q, hctx, i)
+			busy |= !blk_mq_tags_idle(hctx->tags);
+
+		if (!busy)
+			break;
+		msleep(10);
+	}
+}
+
+void blk_mq_free_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (q->mq_ops->exit_hctx)
+			q->mq_ops->exit_hctx(hctx, i);
+		blk_mq_free_hw_queue(hctx);
+	}
+
+	kfree(q->queue_hw_ctx);
+	free_percpu(q->queue_ctx);
+	kfree(q->mq_map);
+
+	q->queue_hw_ctx = NULL;
+	q->queue_ctx = NULL;
+	q->mq_map = NULL;
+}
@@ -84,6 +84,8 @@ static DEFINE_MUTEX(loop_index_mutex);
 
 static int max_part;
 static int part_shift;
+static int nr_workers = 1;
+static bool drop_cache;
 
 /*
  * Transfer functions
@@ -403,6 +405,29 @@ lo_receive(struct loop_device *lo, struct bio *bio, int bsize, loff_t pos)
 	return 0;
 }
 
+/*
+ * With LO_FLAGS_DROP_CACHE the backing file does not keep a second copy of
+ * what the page cache of the loop device already holds: writes go through
+ * to the backing store, and the pages the bio went through are dropped
+ * from the backing file's cache once it is done.
+ */
+static int lo_drop_backing_pages(struct loop_device *lo, struct bio *bio,
+				 loff_t pos, int rw)
+{
+	struct address_space *mapping = lo->lo_backing_file->f_mapping;
+	loff_t end = pos + bio->bi_size - 1;
+	int ret = 0;
+
+	if (rw == WRITE) {
+		ret = filemap_write_and_wait_range(mapping, pos, end);
+		if (unlikely(ret))
+			ret = -EIO;
+	}
+	invalidate_mapping_pages(mapping, pos >> PAGE_CACHE_SHIFT,
+				 end >> PAGE_CACHE_SHIFT);
+	return ret;
+}
+
 static int do_bio_filebacked(struct loop_device *lo, struct bio *bio)
 {
 	loff_t pos;
@@ -446,14 +471,21 @@ static int do_bio_filebacked(struct loop_device *lo, struct bio *bio)
 
 		ret = lo_send(lo, bio, pos);
 
+		if (!ret && (lo->lo_flags & LO_FLAGS_DROP_CACHE))
+			ret = lo_drop_backing_pages(lo, bio, pos, WRITE);
+
 		if ((bio->bi_rw & REQ_FUA) && !ret) {
 			ret = vfs_fsync(file, 0);
 			if (unlikely(ret && ret != -EINVAL))
 				ret = -EIO;
 		}
-	} else
+	} else {
 		ret = lo_receive(lo, bio, lo->lo_blocksize, pos);
 
+		if (!ret && (lo->lo_flags & LO_FLAGS_DROP_CACHE))
+			lo_drop_backing_pages(lo, bio, pos, READ);
+	}
+
 out:
 	return ret;
 }
@@ -466,12 +498,54 @@ static void loop_add_bio(struct loop_device *lo, struct bio *bio)
 	bio_list_add(&lo->lo_bio_list, bio);
 }
 
+/*
+ * Can a worker take the first pending bio?  A switch bio (no bi_bdev)
+ * waits for the bios ahead of it to finish and then runs alone, so that
+ * it sees the backing file quiesced.
+ */
+static bool loop_bio_ready(struct loop_device *lo)
+{
+	struct bio *bio = lo->lo_bio_list.head;
+
+	if (!bio || lo->lo_barrier)
+		return false;
+	return bio->bi_bdev || !lo->lo_active;
+}
+
 /*
  * Grab first pending buffer
  */
 static struct bio *loop_get_bio(struct loop_device *lo)
 {
-	return bio_list_pop(&lo->lo_bio_list);
+	struct bio *bio;
+
+	if (!loop_bio_ready(lo))
+		return NULL;
+
+	bio = bio_list_pop(&lo->lo_bio_list);
+	if (unlikely(!bio->bi_bdev))
+		lo->lo_barrier = true;
+	lo->lo_active++;
+	return bio;
+}
+
+/*
+ * A worker is done with its bio, let the others know if a switch bio was
+ * waiting for it or if it was the switch itself.
+ */
+static void loop_put_bio(struct loop_device *lo, bool barrier)
+{
+	bool wake;
+
+	spin_lock_irq(&lo->lo_lock);
+	lo->lo_active--;
+	if (barrier)
+		lo->lo_barrier = false;
+	wake = loop_bio_ready(lo) && (barrier || !lo->lo_active);
+	spin_unlock_irq(&lo->lo_lock);
+
+	if (wake)
+		wake_up_all(&lo->lo_event);
 }
 
 static void loop_make_request(struct request_queue *q, struct bio *old_bio)
@@ -523,6 +597,9 @@ static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
  * on reads for block backed loop, as that is too heavy to do from
  * b_end_io context where irqs may be disabled.
  *
+ * A device has nr_workers of these, each handling one bio at a time, so
+ * that the backing file sees as many I/Os in flight.
+ *
  * Loop explanation:  loop_clr_fd() sets lo_state to Lo_rundown before
  * calling kthread_stop().  Therefore once kthread_should_stop() is
  * true, make_request will not place any more requests.  Therefore
@@ -533,28 +610,59 @@ static int loop_thread(void *data)
 {
 	struct loop_device *lo = data;
 	struct bio *bio;
+	bool barrier;
 
 	set_user_nice(current, -20);
 
 	while (!kthread_should_stop() || !bio_list_empty(&lo->lo_bio_list)) {
 
-		wait_event_interruptible(lo->lo_event,
-				!bio_list_empty(&lo->lo_bio_list) ||
-				kthread_should_stop());
+		wait_event_interruptible_exclusive(lo->lo_event,
+				loop_bio_ready(lo) || kthread_should_stop());
 
-		if (bio_list_empty(&lo->lo_bio_list))
-			continue;
 		spin_lock_irq(&lo->lo_lock);
 		bio = loop_get_bio(lo);
 		spin_unlock_irq(&lo->lo_lock);
 
-		BUG_ON(!bio);
+		if (!bio)
+			continue;
+		barrier = !bio->bi_bdev;
 		loop_handle_bio(lo, bio);
+		loop_put_bio(lo, barrier);
 	}
 
 	return 0;
 }
 
+static void loop_stop_threads(struct loop_device *lo)
+{
+	while (lo->lo_nr_threads)
+		kthread_stop(lo->lo_threads[--lo->lo_nr_threads]);
+	kfree(lo->lo_threads);
+	lo->lo_threads = NULL;
+}
+
+static int loop_start_threads(struct loop_device *lo)
+{
+	struct task_struct *thread;
+	int i;
+
+	lo->lo_threads = kcalloc(nr_workers, sizeof(*lo->lo_threads),
+				 GFP_KERNEL);
+	if (!lo->lo_threads)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_workers; i++) {
+		thread = kthread_create(loop_thread, lo, "loop%d:%d",
+					lo->lo_number, i);
+		if (IS_ERR(thread)) {
+			loop_stop_threads(lo);
+			return PTR_ERR(thread);
+		}
+		lo->lo_threads[lo->lo_nr_threads++] = thread;
+	}
+	return 0;
+}
+
 /*
  * loop_switch performs the hard work of switching a backing store.
  * First it needs to flush existing IO, it does this by sending a magic
@@ -581,7 +689,7 @@ static int loop_switch(struct loop_device *lo, struct file *file)
 static int loop_flush(struct loop_device *lo)
 {
 	/* loop not yet configured, no running thread, nothing to flush */
-	if (!lo->lo_thread)
+	if (!lo->lo_nr_threads)
 		return 0;
 
 	return loop_switch(lo, NULL);
@@ -743,11 +851,25 @@ static ssize_t loop_attr_partscan_show(struct loop_device *lo, char *buf)
 	return sprintf(buf, "%s\n", partscan ? "1" : "0");
 }
 
+static ssize_t loop_attr_drop_cache_show(struct loop_device *lo, char *buf)
+{
+	int drop = (lo->lo_flags & LO_FLAGS_DROP_CACHE);
+
+	return sprintf(buf, "%s\n", drop ? "1" : "0");
+}
+
+static ssize_t loop_attr_workers_show(struct loop_device *lo, char *buf)
+{
+	return sprintf(buf, "%d\n", lo->lo_nr_threads);
+}
+
 LOOP_ATTR_RO(backing_file);
 LOOP_ATTR_RO(offset);
 LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
 LOOP_ATTR_RO(partscan);
+LOOP_ATTR_RO(drop_cache);
+LOOP_ATTR_RO(workers);
 
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
@@ -755,6 +877,8 @@ static struct attribute *loop_attrs[] = {
 	&loop_attr_sizelimit.attr,
 	&loop_attr_autoclear.attr,
 	&loop_attr_partscan.attr,
+	&loop_attr_drop_cache.attr,
+	&loop_attr_workers.attr,
 	NULL,
 };
 
@@ -812,7 +936,7 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	struct address_space *mapping;
 	unsigned lo_blocksize;
 	int		lo_flags = 0;
-	int		error;
+	int		error, i;
 	loff_t		size;
 
 	/* This is safe, since we have a reference from open(). */
@@ -854,6 +978,9 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	    !file->f_op->write)
 		lo_flags |= LO_FLAGS_READ_ONLY;
 
+	if (drop_cache)
+		lo_flags |= LO_FLAGS_DROP_CACHE;
+
 	lo_blocksize = S_ISBLK(inode->i_mode) ?
 		inode->i_bdev->bd_block_size : PAGE_SIZE;
 
@@ -873,6 +1000,8 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	lo->transfer = transfer_none;
 	lo->ioctl = NULL;
 	lo->lo_sizelimit = 0;
+	lo->lo_active = 0;
+	lo->lo_barrier = false;
 	lo->old_gfp_mask = mapping_gfp_mask(mapping);
 	mapping_set_gfp_mask(mapping, lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
 
@@ -896,14 +1025,12 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 
 	set_blocksize(bdev, lo_blocksize);
 
-	lo->lo_thread = kthread_create(loop_thread, lo, "loop%d",
-						lo->lo_number);
-	if (IS_ERR(lo->lo_thread)) {
-		error = PTR_ERR(lo->lo_thread);
+	error = loop_start_threads(lo);
+	if (error)
 		goto out_clr;
-	}
 	lo->lo_state = Lo_bound;
-	wake_up_process(lo->lo_thread);
+	for (i = 0; i < lo->lo_nr_threads; i++)
+		wake_up_process(lo->lo_threads[i]);
 	if (part_shift)
 		lo->lo_flags |= LO_FLAGS_PARTSCAN;
 	if (lo->lo_flags & LO_FLAGS_PARTSCAN)
@@ -912,7 +1039,6 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 
 out_clr:
 	loop_sysfs_exit(lo);
-	lo->lo_thread = NULL;
 	lo->lo_device = NULL;
 	lo->lo_backing_file = NULL;
 	lo->lo_flags = 0;
@@ -999,7 +1125,7 @@ static int loop_clr_fd(struct loop_device *lo)
 	lo->lo_state = Lo_rundown;
 	spin_unlock_irq(&lo->lo_lock);
 
-	kthread_stop(lo->lo_thread);
+	loop_stop_threads(lo);
 
 	spin_lock_irq(&lo->lo_lock);
 	lo->lo_backing_file = NULL;
@@ -1013,7 +1139,6 @@ static int loop_clr_fd(struct loop_device *lo)
 	lo->lo_offset = 0;
 	lo->lo_sizelimit = 0;
 	lo->lo_encrypt_key_size = 0;
-	lo->lo_thread = NULL;
 	memset(lo->lo_encrypt_key, 0, LO_KEY_SIZE);
 	memset(lo->lo_crypt_name, 0, LO_NAME_SIZE);
 	memset(lo->lo_file_name, 0, LO_NAME_SIZE);
@@ -1102,6 +1227,10 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 	     (info->lo_flags & LO_FLAGS_AUTOCLEAR))
 		lo->lo_flags ^= LO_FLAGS_AUTOCLEAR;
 
+	if ((lo->lo_flags & LO_FLAGS_DROP_CACHE) !=
+	     (info->lo_flags & LO_FLAGS_DROP_CACHE))
+		lo->lo_flags ^= LO_FLAGS_DROP_CACHE;
+
 	if ((info->lo_flags & LO_FLAGS_PARTSCAN) &&
 	     !(lo->lo_flags & LO_FLAGS_PARTSCAN)) {
 		lo->lo_flags |= LO_FLAGS_PARTSCAN;
@@ -1563,6 +1692,10 @@ module_param(max_loop, int, S_IRUGO);
 MODULE_PARM_DESC(max_loop, "Maximum number of loop devices");
 module_param(max_part, int, S_IRUGO);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per loop device");
+module_param(nr_workers, int, S_IRUGO);
+MODULE_PARM_DESC(nr_workers, "Number of threads doing the I/O of a loop device, at most one per possible cpu");
+module_param(drop_cache, bool, S_IRUGO);
+MODULE_PARM_DESC(drop_cache, "Write through and drop the backing file's cached pages by default");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
@@ -1671,7 +1804,6 @@ static int loop_add(struct loop_device **l, int i)
 	disk->flags |= GENHD_FL_EXT_DEVT;
 	mutex_init(&lo->lo_ctl_mutex);
 	lo->lo_number		= i;
-	lo->lo_thread		= NULL;
 	init_waitqueue_head(&lo->lo_event);
 	spin_lock_init(&lo->lo_lock);
 	disk->major		= LOOP_MAJOR;
@@ -1854,6 +1986,8 @@ static int __init loop_init(void)
 	if (max_loop > 1UL << (MINORBITS - part_shift))
 		return -EINVAL;
 
+	nr_workers = clamp(nr_workers, 1, (int)num_possible_cpus());
+
 	/*
 	 * If max_loop is specified, create that many devices upfront.
 	 * This also becomes a hard limit. If max_loop is not specified,
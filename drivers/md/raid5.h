@@ -211,6 +211,8 @@ struct stripe_head {
 	enum check_states	check_state;
 	enum reconstruct_states reconstruct_state;
 	spinlock_t		stripe_lock;
+	int			cpu;		/* where it was set up */
+	struct r5worker_group	*group;		/* handle_list it is on */
 	/**
 	 * struct stripe_operations
 	 * @target - STRIPE_OP_COMPUTE_BLK target
@@ -365,6 +367,24 @@ struct disk_info {
 	struct md_rdev	*rdev, *replacement;
 };
 
+/*
+ * Stripes that are ready to be handled are queued on the handle_list of
+ * the worker group of the node they were set up on, and handled by up to
+ * worker_cnt_per_group workers of that group at the same time.
+ */
+struct r5worker {
+	struct work_struct	work;
+	struct r5worker_group	*group;
+	bool			working;
+};
+
+struct r5worker_group {
+	struct list_head	handle_list;
+	struct r5conf		*conf;
+	struct r5worker		*workers;
+	int			stripes_cnt;
+};
+
 struct r5conf {
 	struct hlist_head	*stripe_hashtbl;
 	struct mddev		*mddev;
@@ -460,6 +480,9 @@ struct r5conf {
 	 * the new thread here until we fully activate the array.
 	 */
 	struct md_thread	*thread;
+	struct r5worker_group	*worker_groups;
+	int			group_cnt;
+	int			worker_cnt_per_group;
 };
 
 /*
@@ -30,8 +30,10 @@
 #include <linux/highmem.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
+#include <linux/lz4.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/cpumask.h>
 
 #include "zram_drv.h"
 
@@ -42,16 +44,6 @@ struct zram *zram_devices;
 /* Module params (documentation at end) */
 static unsigned int num_devices;
 
-static void zram_stat_inc(u32 *v)
-{
-	*v = *v + 1;
-}
-
-static void zram_stat_dec(u32 *v)
-{
-	*v = *v - 1;
-}
-
 static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
 {
 	spin_lock(&zram->stat64_lock);
@@ -145,27 +137,188 @@ static void zram_free_page(struct zram *zram, size_t index)
 		 */
 		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
 			zram_clear_flag(zram, index, ZRAM_ZERO);
-			zram_stat_dec(&zram->stats.pages_zero);
+			atomic_dec(&zram->stats.pages_zero);
 		}
 		return;
 	}
 
 	if (unlikely(size > max_zpage_size))
-		zram_stat_dec(&zram->stats.bad_compress);
+		atomic_dec(&zram->stats.bad_compress);
 
 	zs_free(zram->mem_pool, handle);
 
 	if (size <= PAGE_SIZE / 2)
-		zram_stat_dec(&zram->stats.good_compress);
+		atomic_dec(&zram->stats.good_compress);
 
 	zram_stat64_sub(zram, &zram->stats.compr_size,
 			zram->table[index].size);
-	zram_stat_dec(&zram->stats.pages_stored);
+	atomic_dec(&zram->stats.pages_stored);
 
 	zram->table[index].handle = 0;
 	zram->table[index].size = 0;
 }
 
+static const struct zram_backend zram_backends[] = {
+	{
+		.name		= "lzo",
+		.workmem_size	= LZO1X_MEM_COMPRESS,
+		.compress	= lzo1x_1_compress,
+		.decompress	= lzo1x_decompress_safe,
+	},
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+	{
+		.name		= "lz4",
+		.workmem_size	= LZ4_MEM_COMPRESS,
+		.compress	= lz4_compress,
+		.decompress	= lz4_decompress_safe,
+	},
+#endif
+};
+
+/* @name may come from sysfs and end in a newline */
+const struct zram_backend *zram_backend_find(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(zram_backends); i++)
+		if (sysfs_streq(name, zram_backends[i].name))
+			return &zram_backends[i];
+
+	return NULL;
+}
+
+/* List the backends, the one in use in brackets */
+ssize_t zram_backend_show(const struct zram_backend *cur, char *buf)
+{
+	ssize_t sz = 0;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(zram_backends); i++) {
+		if (&zram_backends[i] == cur)
+			sz += sprintf(buf + sz, "[%s] ", zram_backends[i].name);
+		else
+			sz += sprintf(buf + sz, "%s ", zram_backends[i].name);
+	}
+	buf[sz - 1] = '\n';
+
+	return sz;
+}
+
+static void zram_strm_free(struct zram_strm *zstrm)
+{
+	kfree(zstrm->workmem);
+	free_pages((unsigned long)zstrm->buffer, 1);
+	kfree(zstrm);
+}
+
+static struct zram_strm *zram_strm_alloc(struct zram *zram, gfp_t flags)
+{
+	struct zram_strm *zstrm;
+
+	zstrm = kmalloc(sizeof(*zstrm), flags);
+	if (!zstrm)
+		return NULL;
+
+	zstrm->workmem = kzalloc(zram->backend->workmem_size, flags);
+	zstrm->buffer = (void *)__get_free_pages(flags | __GFP_ZERO, 1);
+	if (!zstrm->workmem || !zstrm->buffer) {
+		zram_strm_free(zstrm);
+		return NULL;
+	}
+
+	return zstrm;
+}
+
+/*
+ * Get an idle compression stream, creating a new one if fewer than
+ * max_strm exist.  We are on the swap out path, so creating one must not
+ * recurse into I/O and is allowed to fail: then, and when max_strm are
+ * busy, wait for a stream to be released.  There is always at least the
+ * stream created by zram_init_device().
+ */
+static struct zram_strm *zram_strm_find(struct zram *zram)
+{
+	struct zram_strm *zstrm;
+
+	while (1) {
+		spin_lock(&zram->strm_lock);
+		if (!list_empty(&zram->idle_strm)) {
+			zstrm = list_first_entry(&zram->idle_strm,
+						 struct zram_strm, list);
+			list_del(&zstrm->list);
+			spin_unlock(&zram->strm_lock);
+			return zstrm;
+		}
+
+		if (zram->avail_strm >= zram->max_strm) {
+			spin_unlock(&zram->strm_lock);
+			wait_event(zram->strm_wait,
+				   !list_empty(&zram->idle_strm));
+			continue;
+		}
+
+		zram->avail_strm++;
+		spin_unlock(&zram->strm_lock);
+
+		zstrm = zram_strm_alloc(zram, GFP_NOIO);
+		if (zstrm)
+			return zstrm;
+
+		spin_lock(&zram->strm_lock);
+		zram->avail_strm--;
+		spin_unlock(&zram->strm_lock);
+		wait_event(zram->strm_wait, !list_empty(&zram->idle_strm));
+	}
+}
+
+static void zram_strm_release(struct zram *zram, struct zram_strm *zstrm)
+{
+	spin_lock(&zram->strm_lock);
+	if (zram->avail_strm <= zram->max_strm) {
+		list_add(&zstrm->list, &zram->idle_strm);
+		spin_unlock(&zram->strm_lock);
+		wake_up(&zram->strm_wait);
+		return;
+	}
+
+	/* max_strm was lowered while we were compressing */
+	zram->avail_strm--;
+	spin_unlock(&zram->strm_lock);
+	zram_strm_free(zstrm);
+}
+
+/* Free idle streams until at most @num are left */
+static void zram_strm_shrink(struct zram *zram, int num)
+{
+	struct zram_strm *zstrm;
+	LIST_HEAD(victims);
+
+	spin_lock(&zram->strm_lock);
+	while (zram->avail_strm > num && !list_empty(&zram->idle_strm)) {
+		zstrm = list_first_entry(&zram->idle_strm,
+					 struct zram_strm, list);
+		list_move(&zstrm->list, &victims);
+		zram->avail_strm--;
+	}
+	spin_unlock(&zram->strm_lock);
+
+	while (!list_empty(&victims)) {
+		zstrm = list_first_entry(&victims, struct zram_strm, list);
+		list_del(&zstrm->list);
+		zram_strm_free(zstrm);
+	}
+}
+
+void zram_set_max_strm(struct zram *zram, int num)
+{
+	spin_lock(&zram->strm_lock);
+	zram->max_strm = num;
+	spin_unlock(&zram->strm_lock);
+
+	/* the streams in use are freed as they are released */
+	zram_strm_shrink(zram, num);
+}
+
 static void handle_zero_page(struct bio_vec *bvec)
 {
 	struct page *page = bvec->bv_page;
@@ -185,7 +338,7 @@ static inline int is_partial_io(struct bio_vec *bvec)
 
 static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 {
-	int ret = LZO_E_OK;
+	int ret = 0;
 	size_t clen = PAGE_SIZE;
 	unsigned char *cmem;
 	unsigned long handle = zram->table[index].handle;
@@ -199,12 +352,12 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	if (zram->table[index].size == PAGE_SIZE)
 		memcpy(mem, cmem, PAGE_SIZE);
 	else
-		ret = lzo1x_decompress_safe(cmem, zram->table[index].size,
+		ret = zram->backend->decompress(cmem, zram->table[index].size,
 						mem, &clen);
 	zs_unmap_object(zram->mem_pool, handle);
 
 	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
 		zram_stat64_inc(zram, &zram->stats.failed_reads);
 		return ret;
@@ -222,11 +375,14 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 
 	page = bvec->bv_page;
 
+	read_lock(&zram->tb_lock);
 	if (unlikely(!zram->table[index].handle) ||
 			zram_test_flag(zram, index, ZRAM_ZERO)) {
+		read_unlock(&zram->tb_lock);
 		handle_zero_page(bvec);
 		return 0;
 	}
+	read_unlock(&zram->tb_lock);
 
 	user_mem = kmap_atomic(page);
 	if (is_partial_io(bvec))
@@ -241,9 +397,11 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 		goto out_cleanup;
 	}
 
+	read_lock(&zram->tb_lock);
 	ret = zram_decompress_page(zram, uncmem, index);
+	read_unlock(&zram->tb_lock);
 	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
 		zram_stat64_inc(zram, &zram->stats.failed_reads);
 		goto out_cleanup;
@@ -270,9 +428,9 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	unsigned long handle;
 	struct page *page;
 	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
+	struct zram_strm *zstrm = NULL;
 
 	page = bvec->bv_page;
-	src = zram->compress_buffer;
 
 	if (is_partial_io(bvec)) {
 		/*
@@ -285,18 +443,16 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			ret = -ENOMEM;
 			goto out;
 		}
+		read_lock(&zram->tb_lock);
 		ret = zram_decompress_page(zram, uncmem, index);
+		read_unlock(&zram->tb_lock);
 		if (ret)
 			goto out;
 	}
 
-	/*
-	 * System overwrites unused sectors. Free memory associated
-	 * with this sector now.
-	 */
-	if (zram->table[index].handle ||
-	    zram_test_flag(zram, index, ZRAM_ZERO))
-		zram_free_page(zram, index);
+	/* May sleep, so get it before mapping the page */
+	zstrm = zram_strm_find(zram);
+	src = zstrm->buffer;
 
 	user_mem = kmap_atomic(page);
 
@@ -312,14 +468,19 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	if (page_zero_filled(uncmem)) {
 		if (!is_partial_io(bvec))
 			kunmap_atomic(user_mem);
-		zram_stat_inc(&zram->stats.pages_zero);
+		write_lock(&zram->tb_lock);
+		zram_free_page(zram, index);
 		zram_set_flag(zram, index, ZRAM_ZERO);
+		write_unlock(&zram->tb_lock);
+		atomic_inc(&zram->stats.pages_zero);
 		ret = 0;
 		goto out;
 	}
 
-	ret = lzo1x_1_compress(uncmem, PAGE_SIZE, src, &clen,
-			       zram->compress_workmem);
+	/* the buffer is two pages, room for the worst case of any backend */
+	clen = 2 * PAGE_SIZE;
+	ret = zram->backend->compress(uncmem, PAGE_SIZE, src, &clen,
+				      zstrm->workmem);
 
 	if (!is_partial_io(bvec)) {
 		kunmap_atomic(user_mem);
@@ -327,13 +488,13 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		uncmem = NULL;
 	}
 
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Compression failed! err=%d\n", ret);
 		goto out;
 	}
 
 	if (unlikely(clen > max_zpage_size)) {
-		zram_stat_inc(&zram->stats.bad_compress);
+		atomic_inc(&zram->stats.bad_compress);
 		clen = PAGE_SIZE;
 		src = NULL;
 		if (is_partial_io(bvec))
@@ -357,16 +518,28 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 
 	zs_unmap_object(zram->mem_pool, handle);
 
+	zram_strm_release(zram, zstrm);
+	zstrm = NULL;
+
+	/*
+	 * System overwrites unused sectors. Free memory associated
+	 * with this sector now.
+	 */
+	write_lock(&zram->tb_lock);
+	zram_free_page(zram, index);
 	zram->table[index].handle = handle;
 	zram->table[index].size = clen;
+	write_unlock(&zram->tb_lock);
 
 	/* Update stats */
 	zram_stat64_add(zram, &zram->stats.compr_size, clen);
-	zram_stat_inc(&zram->stats.pages_stored);
+	atomic_inc(&zram->stats.pages_stored);
 	if (clen <= PAGE_SIZE / 2)
-		zram_stat_inc(&zram->stats.good_compress);
+		atomic_inc(&zram->stats.good_compress);
 
 out:
+	if (zstrm)
+		zram_strm_release(zram, zstrm);
 	if (is_partial_io(bvec))
 		kfree(uncmem);
 
@@ -384,10 +557,15 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 		down_read(&zram->lock);
 		ret = zram_bvec_read(zram, bvec, index, offset, bio);
 		up_read(&zram->lock);
-	} else {
+	} else if (is_partial_io(bvec)) {
 		down_write(&zram->lock);
 		ret = zram_bvec_write(zram, bvec, index, offset);
 		up_write(&zram->lock);
+	} else {
+		/* the stream and the table lock keep full page writes apart */
+		down_read(&zram->lock);
+		ret = zram_bvec_write(zram, bvec, index, offset);
+		up_read(&zram->lock);
 	}
 
 	return ret;
@@ -508,12 +686,8 @@ void __zram_reset_device(struct zram *zram)
 
 	zram->init_done = 0;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	/* Free the compression streams, all of them are idle now */
+	zram_strm_shrink(zram, 0);
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
@@ -547,6 +721,7 @@ int zram_init_device(struct zram *zram)
 {
 	int ret;
 	size_t num_pages;
+	struct zram_strm *zstrm;
 
 	down_write(&zram->init_lock);
 
@@ -557,20 +732,16 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail_no_table;
-	}
-
-	zram->compress_buffer =
-		(void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
+	zstrm = zram_strm_alloc(zram, GFP_KERNEL);
+	if (!zstrm) {
+		pr_err("Error allocating compression stream\n");
 		ret = -ENOMEM;
 		goto fail_no_table;
 	}
+	spin_lock(&zram->strm_lock);
+	list_add(&zstrm->list, &zram->idle_strm);
+	zram->avail_strm = 1;
+	spin_unlock(&zram->strm_lock);
 
 	num_pages = zram->disksize >> PAGE_SHIFT;
 	zram->table = vzalloc(num_pages * sizeof(*zram->table));
@@ -614,7 +785,9 @@ static void zram_slot_free_notify(struct block_device *bdev,
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	write_lock(&zram->tb_lock);
 	zram_free_page(zram, index);
+	write_unlock(&zram->tb_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -629,8 +802,15 @@ static int create_device(struct zram *zram, int device_id)
 
 	init_rwsem(&zram->lock);
 	init_rwsem(&zram->init_lock);
+	rwlock_init(&zram->tb_lock);
 	spin_lock_init(&zram->stat64_lock);
 
+	spin_lock_init(&zram->strm_lock);
+	INIT_LIST_HEAD(&zram->idle_strm);
+	init_waitqueue_head(&zram->strm_wait);
+	zram->max_strm = num_online_cpus();
+	zram->backend = &zram_backends[0];
+
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
 		pr_err("Error allocating disk queue for device %d\n",
@@ -17,6 +17,8 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/wait.h>
 
 #include "../zsmalloc/zsmalloc.h"
 
@@ -80,20 +82,52 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 bad_compress;	/* % of pages with compression ratio>=75% */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t bad_compress;	/* % of pages with compression ratio>=75% */
+};
+
+/* A compression algorithm zram can store pages with */
+struct zram_backend {
+	const char *name;
+	size_t workmem_size;
+	int (*compress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem);
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			  unsigned char *dst, size_t *dst_len);
+};
+
+/* Workspace for compressing one page */
+struct zram_strm {
+	void *workmem;		/* backend->workmem_size bytes */
+	void *buffer;		/* compressed output, two pages */
+	struct list_head list;
 };
 
 struct zram {
 	struct zs_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
 	struct table *table;
+	/* Chosen through sysfs, cannot change while the device is set up */
+	const struct zram_backend *backend;
+	rwlock_t tb_lock;	/* protect table entries */
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct rw_semaphore lock; /* protect compression buffers and table
-				   * against concurrent read and writes */
+	/*
+	 * Taken for read by every I/O and for write by partial page writes,
+	 * which read, modify and write back a whole page.
+	 */
+	struct rw_semaphore lock;
+
+	/*
+	 * Compression streams.  They are created on demand, up to max_strm,
+	 * and a writer waits for an idle one once that many are busy.
+	 */
+	spinlock_t strm_lock;
+	struct list_head idle_strm;
+	int avail_strm;
+	int max_strm;
+	wait_queue_head_t strm_wait;
+
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -116,5 +150,8 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void __zram_reset_device(struct zram *zram);
+extern void zram_set_max_strm(struct zram *zram, int num);
+extern const struct zram_backend *zram_backend_find(const char *name);
+extern ssize_t zram_backend_show(const struct zram_backend *cur, char *buf);
 
 #endif
@@ -34,6 +34,15 @@ static int experimental_zcopytx;
 module_param(experimental_zcopytx, int, 0444);
 MODULE_PARM_DESC(experimental_zcopytx, "Enable Experimental Zero Copy TX");
 
+static bool worker_per_vq;
+module_param(worker_per_vq, bool, 0644);
+MODULE_PARM_DESC(worker_per_vq, "Run TX and RX of a device on their own threads");
+
+static unsigned int tx_busyloop_timeout;
+module_param(tx_busyloop_timeout, uint, 0644);
+MODULE_PARM_DESC(tx_busyloop_timeout,
+		 "Microseconds to busy poll an empty TX ring before waiting for a kick");
+
 /* Max number of bytes transferred before requeueing the job.
  * Using this limit prevents one virtqueue from starving others. */
 #define VHOST_NET_WEIGHT 0x80000
@@ -202,6 +211,10 @@ static void handle_tx(struct vhost_net *net)
 				set_bit(SOCK_ASYNC_NOSPACE, &sock->flags);
 				break;
 			}
+			if (tx_busyloop_timeout &&
+			    vhost_vq_busy_poll(&net->dev, vq,
+					       tx_busyloop_timeout))
+				continue;
 			if (unlikely(vhost_enable_notify(&net->dev, vq))) {
 				vhost_disable_notify(&net->dev, vq);
 				continue;
@@ -519,8 +532,12 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		return r;
 	}
 
-	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, POLLOUT, dev);
-	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, POLLIN, dev);
+	dev->worker_per_vq = worker_per_vq;
+
+	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, POLLOUT, dev,
+			n->vqs + VHOST_NET_VQ_TX);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, POLLIN, dev,
+			n->vqs + VHOST_NET_VQ_RX);
 	n->tx_poll_state = VHOST_NET_POLL_DISABLED;
 
 	f->private_data = n;
@@ -11,6 +11,7 @@
 #include <linux/vhost.h>
 #include <linux/miscdevice.h>
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/mutex.h>
 #include <linux/workqueue.h>
 #include <linux/rcupdate.h>
@@ -24,9 +25,17 @@
  * Using this limit prevents one virtqueue from starving others. */
 #define VHOST_TEST_WEIGHT 0x80000
 
+static bool worker_per_vq;
+module_param(worker_per_vq, bool, 0644);
+MODULE_PARM_DESC(worker_per_vq, "Run every queue of a device on its own thread");
+
+static unsigned int busyloop_timeout;
+module_param(busyloop_timeout, uint, 0644);
+MODULE_PARM_DESC(busyloop_timeout,
+		 "Microseconds to busy poll an empty ring before waiting for a kick");
+
 enum {
-	VHOST_TEST_VQ = 0,
-	VHOST_TEST_VQ_MAX = 1,
+	VHOST_TEST_VQ_MAX = VHOST_TEST_MAX_VQS,
 };
 
 struct vhost_test {
@@ -36,9 +45,8 @@ struct vhost_test {
 
 /* Expects to be always run from workqueue - which acts as
  * read-size critical section for our kind of RCU. */
-static void handle_vq(struct vhost_test *n)
+static void handle_vq(struct vhost_test *n, struct vhost_virtqueue *vq)
 {
-	struct vhost_virtqueue *vq = &n->dev.vqs[VHOST_TEST_VQ];
 	unsigned out, in;
 	int head;
 	size_t len, total_len = 0;
@@ -61,6 +69,9 @@ static void handle_vq(struct vhost_test *n)
 			break;
 		/* Nothing new?  Wait for eventfd to tell us they refilled. */
 		if (head == vq->num) {
+			if (busyloop_timeout &&
+			    vhost_vq_busy_poll(&n->dev, vq, busyloop_timeout))
+				continue;
 			if (unlikely(vhost_enable_notify(&n->dev, vq))) {
 				vhost_disable_notify(&n->dev, vq);
 				continue;
@@ -95,25 +106,27 @@ static void handle_vq_kick(struct vhost_work *work)
 						  poll.work);
 	struct vhost_test *n = container_of(vq->dev, struct vhost_test, dev);
 
-	handle_vq(n);
+	handle_vq(n, vq);
 }
 
 static int vhost_test_open(struct inode *inode, struct file *f)
 {
 	struct vhost_test *n = kmalloc(sizeof *n, GFP_KERNEL);
 	struct vhost_dev *dev;
-	int r;
+	int i, r;
 
 	if (!n)
 		return -ENOMEM;
 
 	dev = &n->dev;
-	n->vqs[VHOST_TEST_VQ].handle_kick = handle_vq_kick;
+	for (i = 0; i < VHOST_TEST_VQ_MAX; ++i)
+		n->vqs[i].handle_kick = handle_vq_kick;
 	r = vhost_dev_init(dev, n->vqs, VHOST_TEST_VQ_MAX);
 	if (r < 0) {
 		kfree(n);
 		return r;
 	}
+	dev->worker_per_vq = worker_per_vq;
 
 	f->private_data = n;
 
@@ -135,7 +148,10 @@ static void *vhost_test_stop_vq(struct vhost_test *n,
 
 static void vhost_test_stop(struct vhost_test *n, void **privatep)
 {
-	*privatep = vhost_test_stop_vq(n, n->vqs + VHOST_TEST_VQ);
+	int i;
+
+	for (i = 0; i < VHOST_TEST_VQ_MAX; ++i)
+		*privatep = vhost_test_stop_vq(n, n->vqs + i);
 }
 
 static void vhost_test_flush_vq(struct vhost_test *n, int index)
@@ -145,7 +161,10 @@ static void vhost_test_flush_vq(struct vhost_test *n, int index)
 
 static void vhost_test_flush(struct vhost_test *n)
 {
-	vhost_test_flush_vq(n, VHOST_TEST_VQ);
+	int i;
+
+	for (i = 0; i < VHOST_TEST_VQ_MAX; ++i)
+		vhost_test_flush_vq(n, i);
 }
 
 static int vhost_test_release(struct inode *inode, struct file *f)
@@ -188,7 +207,8 @@ static long vhost_test_run(struct vhost_test *n, int test)
 	for (index = 0; index < n->dev.nvqs; ++index) {
 		vq = n->vqs + index;
 		mutex_lock(&vq->mutex);
-		priv = test ? n : NULL;
+		/* Leave alone the queues the simulator did not set up. */
+		priv = test && vq->kick ? n : NULL;
 
 		/* start polling new socket */
 		oldpriv = rcu_dereference_protected(vq->private_data,
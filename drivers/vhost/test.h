@@ -4,4 +4,8 @@
 /* Start a given test on the virtio null device. 0 stops all tests. */
 #define VHOST_TEST_RUN _IOW(VHOST_VIRTIO, 0x31, int)
 
+/* Queues of the virtio null device. Set up the ones a test uses, starting
+ * from queue 0; the others stay idle. */
+#define VHOST_TEST_MAX_VQS 16
+
 #endif
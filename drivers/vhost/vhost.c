@@ -25,6 +25,7 @@
 #include <linux/slab.h>
 #include <linux/kthread.h>
 #include <linux/cgroup.h>
+#include <linux/cpuset.h>
 
 #include <linux/net.h>
 #include <linux/if_packet.h>
@@ -60,6 +61,10 @@ static int vhost_poll_wakeup(wait_queue_t *wait, unsigned mode, int sync,
 	if (!((unsigned long)key & poll->mask))
 		return 0;
 
+	/* A guest kick is signalled from the vcpu thread that did it. */
+	if (poll->vq && poll == &poll->vq->poll)
+		poll->vq->worker->kick_node = numa_node_id();
+
 	vhost_poll_queue(poll);
 	return 0;
 }
@@ -73,14 +78,17 @@ void vhost_work_init(struct vhost_work *work, vhost_work_fn_t fn)
 	work->queue_seq = work->done_seq = 0;
 }
 
-/* Init poll structure */
+/* Init poll structure. The work runs on the worker of @vq, if given, and on
+ * the worker of @dev otherwise. */
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     unsigned long mask, struct vhost_dev *dev)
+		     unsigned long mask, struct vhost_dev *dev,
+		     struct vhost_virtqueue *vq)
 {
 	init_waitqueue_func_entry(&poll->wait, vhost_poll_wakeup);
 	init_poll_funcptr(&poll->table, vhost_poll_func);
 	poll->mask = mask;
 	poll->dev = dev;
+	poll->vq = vq;
 
 	vhost_work_init(&poll->work, fn);
 }
@@ -103,30 +111,36 @@ void vhost_poll_stop(struct vhost_poll *poll)
 	remove_wait_queue(poll->wqh, &poll->wait);
 }
 
-static bool vhost_work_seq_done(struct vhost_dev *dev, struct vhost_work *work,
-				unsigned seq)
+static struct vhost_worker *vhost_poll_worker(struct vhost_poll *poll)
+{
+	return poll->vq ? poll->vq->worker : &poll->dev->worker;
+}
+
+static bool vhost_work_seq_done(struct vhost_worker *worker,
+				struct vhost_work *work, unsigned seq)
 {
 	int left;
 
-	spin_lock_irq(&dev->work_lock);
+	spin_lock_irq(&worker->work_lock);
 	left = seq - work->done_seq;
-	spin_unlock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
 	return left <= 0;
 }
 
-static void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
+static void vhost_work_flush(struct vhost_worker *worker,
+			     struct vhost_work *work)
 {
 	unsigned seq;
 	int flushing;
 
-	spin_lock_irq(&dev->work_lock);
+	spin_lock_irq(&worker->work_lock);
 	seq = work->queue_seq;
 	work->flushing++;
-	spin_unlock_irq(&dev->work_lock);
-	wait_event(work->done, vhost_work_seq_done(dev, work, seq));
-	spin_lock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
+	wait_event(work->done, vhost_work_seq_done(worker, work, seq));
+	spin_lock_irq(&worker->work_lock);
 	flushing = --work->flushing;
-	spin_unlock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
 	BUG_ON(flushing < 0);
 }
 
@@ -134,25 +148,31 @@ static void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
  * locks that are also used by the callback. */
 void vhost_poll_flush(struct vhost_poll *poll)
 {
-	vhost_work_flush(poll->dev, &poll->work);
+	vhost_work_flush(vhost_poll_worker(poll), &poll->work);
 }
 
-void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
+static void vhost_worker_queue(struct vhost_worker *worker,
+			       struct vhost_work *work)
 {
 	unsigned long flags;
 
-	spin_lock_irqsave(&dev->work_lock, flags);
+	spin_lock_irqsave(&worker->work_lock, flags);
 	if (list_empty(&work->node)) {
-		list_add_tail(&work->node, &dev->work_list);
+		list_add_tail(&work->node, &worker->work_list);
 		work->queue_seq++;
-		wake_up_process(dev->worker);
+		wake_up_process(worker->task);
 	}
-	spin_unlock_irqrestore(&dev->work_lock, flags);
+	spin_unlock_irqrestore(&worker->work_lock, flags);
+}
+
+void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
+{
+	vhost_worker_queue(&dev->worker, work);
 }
 
 void vhost_poll_queue(struct vhost_poll *poll)
 {
-	vhost_work_queue(poll->dev, &poll->work);
+	vhost_worker_queue(vhost_poll_worker(poll), &poll->work);
 }
 
 static void vhost_vq_reset(struct vhost_dev *dev,
@@ -185,9 +205,39 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 	vq->ubufs = NULL;
 }
 
+static void vhost_worker_init(struct vhost_dev *dev,
+			      struct vhost_worker *worker)
+{
+	spin_lock_init(&worker->work_lock);
+	INIT_LIST_HEAD(&worker->work_list);
+	worker->task = NULL;
+	worker->dev = dev;
+	worker->node = NUMA_NO_NODE;
+	worker->kick_node = NUMA_NO_NODE;
+}
+
+/* Move a virtqueue worker to the node of the vcpu kicking the queue, so it
+ * runs close to the guest memory. It may share any CPU of that node, the
+ * vcpu's own included. Stay within the CPUs its cpuset (the owner's) allows
+ * now; a later cpuset change overrides the affinity set here. */
+static void vhost_worker_follow_kick(struct vhost_worker *worker)
+{
+	int node = ACCESS_ONCE(worker->kick_node);
+
+	if (node == worker->node || node == NUMA_NO_NODE)
+		return;
+	worker->node = node;
+
+	cpuset_cpus_allowed(current, worker->cpus);
+	if (cpumask_intersects(worker->cpus, cpumask_of_node(node)))
+		cpumask_and(worker->cpus, worker->cpus, cpumask_of_node(node));
+	set_cpus_allowed_ptr(current, worker->cpus);
+}
+
 static int vhost_worker(void *data)
 {
-	struct vhost_dev *dev = data;
+	struct vhost_worker *worker = data;
+	struct vhost_dev *dev = worker->dev;
 	struct vhost_work *work = NULL;
 	unsigned uninitialized_var(seq);
 	mm_segment_t oldfs = get_fs();
@@ -199,7 +249,7 @@ static int vhost_worker(void *data)
 		/* mb paired w/ kthread_stop */
 		set_current_state(TASK_INTERRUPTIBLE);
 
-		spin_lock_irq(&dev->work_lock);
+		spin_lock_irq(&worker->work_lock);
 		if (work) {
 			work->done_seq = seq;
 			if (work->flushing)
@@ -207,21 +257,23 @@ static int vhost_worker(void *data)
 		}
 
 		if (kthread_should_stop()) {
-			spin_unlock_irq(&dev->work_lock);
+			spin_unlock_irq(&worker->work_lock);
 			__set_current_state(TASK_RUNNING);
 			break;
 		}
-		if (!list_empty(&dev->work_list)) {
-			work = list_first_entry(&dev->work_list,
+		if (!list_empty(&worker->work_list)) {
+			work = list_first_entry(&worker->work_list,
 						struct vhost_work, node);
 			list_del_init(&work->node);
 			seq = work->queue_seq;
 		} else
 			work = NULL;
-		spin_unlock_irq(&dev->work_lock);
+		spin_unlock_irq(&worker->work_lock);
 
 		if (work) {
 			__set_current_state(TASK_RUNNING);
+			if (worker != &dev->worker)
+				vhost_worker_follow_kick(worker);
 			work->fn(work);
 			if (need_resched())
 				schedule();
@@ -302,9 +354,8 @@ long vhost_dev_init(struct vhost_dev *dev,
 	dev->log_file = NULL;
 	dev->memory = NULL;
 	dev->mm = NULL;
-	spin_lock_init(&dev->work_lock);
-	INIT_LIST_HEAD(&dev->work_list);
-	dev->worker = NULL;
+	vhost_worker_init(dev, &dev->worker);
+	dev->worker_per_vq = false;
 
 	for (i = 0; i < dev->nvqs; ++i) {
 		dev->vqs[i].log = NULL;
@@ -312,11 +363,13 @@ long vhost_dev_init(struct vhost_dev *dev,
 		dev->vqs[i].heads = NULL;
 		dev->vqs[i].ubuf_info = NULL;
 		dev->vqs[i].dev = dev;
+		dev->vqs[i].worker = &dev->worker;
 		mutex_init(&dev->vqs[i].mutex);
 		vhost_vq_reset(dev, dev->vqs + i);
 		if (dev->vqs[i].handle_kick)
 			vhost_poll_init(&dev->vqs[i].poll,
-					dev->vqs[i].handle_kick, POLLIN, dev);
+					dev->vqs[i].handle_kick, POLLIN, dev,
+					dev->vqs + i);
 	}
 
 	return 0;
@@ -343,22 +396,87 @@ static void vhost_attach_cgroups_work(struct vhost_work *work)
 	s->ret = cgroup_attach_task_all(s->owner, current);
 }
 
-static int vhost_attach_cgroups(struct vhost_dev *dev)
+static int vhost_attach_cgroups(struct vhost_worker *worker)
 {
 	struct vhost_attach_cgroups_struct attach;
 
 	attach.owner = current;
 	vhost_work_init(&attach.work, vhost_attach_cgroups_work);
-	vhost_work_queue(dev, &attach.work);
-	vhost_work_flush(dev, &attach.work);
+	vhost_worker_queue(worker, &attach.work);
+	vhost_work_flush(worker, &attach.work);
 	return attach.ret;
 }
 
+/* Start the thread of @worker, for virtqueue @index or, if @index is
+ * negative, for the whole device. Caller should have device mutex. */
+static int vhost_worker_start(struct vhost_dev *dev,
+			      struct vhost_worker *worker, int index)
+{
+	struct task_struct *task;
+	int err;
+
+	if (!alloc_cpumask_var(&worker->cpus, GFP_KERNEL))
+		return -ENOMEM;
+
+	if (index < 0)
+		task = kthread_create(vhost_worker, worker, "vhost-%d",
+				      current->pid);
+	else
+		task = kthread_create(vhost_worker, worker, "vhost-%d-%d",
+				      current->pid, index);
+	if (IS_ERR(task)) {
+		err = PTR_ERR(task);
+		goto err_task;
+	}
+
+	worker->task = task;
+	wake_up_process(task);		/* avoid contributing to loadavg */
+
+	err = vhost_attach_cgroups(worker);
+	if (err)
+		goto err_cgroup;
+	return 0;
+
+err_cgroup:
+	kthread_stop(task);
+	worker->task = NULL;
+err_task:
+	free_cpumask_var(worker->cpus);
+	return err;
+}
+
+static void vhost_worker_stop(struct vhost_worker *worker)
+{
+	WARN_ON(!list_empty(&worker->work_list));
+	if (!worker->task)
+		return;
+	kthread_stop(worker->task);
+	worker->task = NULL;
+	free_cpumask_var(worker->cpus);
+}
+
+/* Stop all workers, and point the virtqueues back at the device worker. */
+static void vhost_dev_stop_workers(struct vhost_dev *dev)
+{
+	struct vhost_worker *worker;
+	int i;
+
+	for (i = 0; i < dev->nvqs; ++i) {
+		worker = dev->vqs[i].worker;
+		if (worker == &dev->worker)
+			continue;
+		vhost_worker_stop(worker);
+		dev->vqs[i].worker = &dev->worker;
+		kfree(worker);
+	}
+	vhost_worker_stop(&dev->worker);
+}
+
 /* Caller should have device mutex */
 static long vhost_dev_set_owner(struct vhost_dev *dev)
 {
-	struct task_struct *worker;
-	int err;
+	struct vhost_worker *worker;
+	int i, err;
 
 	/* Is there an owner already? */
 	if (dev->mm) {
@@ -368,28 +486,33 @@ static long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	/* No owner, become one */
 	dev->mm = get_task_mm(current);
-	worker = kthread_create(vhost_worker, dev, "vhost-%d", current->pid);
-	if (IS_ERR(worker)) {
-		err = PTR_ERR(worker);
-		goto err_worker;
-	}
 
-	dev->worker = worker;
-	wake_up_process(worker);	/* avoid contributing to loadavg */
-
-	err = vhost_attach_cgroups(dev);
+	err = vhost_worker_start(dev, &dev->worker, -1);
 	if (err)
-		goto err_cgroup;
+		goto err_worker;
+
+	for (i = 0; dev->worker_per_vq && i < dev->nvqs; ++i) {
+		worker = kmalloc(sizeof *worker, GFP_KERNEL);
+		if (!worker) {
+			err = -ENOMEM;
+			goto err_worker;
+		}
+		vhost_worker_init(dev, worker);
+		err = vhost_worker_start(dev, worker, i);
+		if (err) {
+			kfree(worker);
+			goto err_worker;
+		}
+		dev->vqs[i].worker = worker;
+	}
 
 	err = vhost_dev_alloc_iovecs(dev);
 	if (err)
-		goto err_cgroup;
+		goto err_worker;
 
 	return 0;
-err_cgroup:
-	kthread_stop(worker);
-	dev->worker = NULL;
 err_worker:
+	vhost_dev_stop_workers(dev);
 	if (dev->mm)
 		mmput(dev->mm);
 	dev->mm = NULL;
@@ -479,11 +602,7 @@ void vhost_dev_cleanup(struct vhost_dev *dev, bool locked)
 					locked ==
 						lockdep_is_held(&dev->mutex)));
 	RCU_INIT_POINTER(dev->memory, NULL);
-	WARN_ON(!list_empty(&dev->work_list));
-	if (dev->worker) {
-		kthread_stop(dev->worker);
-		dev->worker = NULL;
-	}
+	vhost_dev_stop_workers(dev);
 	if (dev->mm)
 		mmput(dev->mm);
 	dev->mm = NULL;
@@ -1565,6 +1684,38 @@ void vhost_disable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	}
 }
 
+/* Has the guest not added any buffers we did not see yet? */
+bool vhost_vq_avail_empty(struct vhost_dev *dev, struct vhost_virtqueue *vq)
+{
+	u16 avail_idx;
+
+	/* Let the caller run into the fault and report it. */
+	if (__get_user(avail_idx, &vq->avail->idx))
+		return false;
+
+	return avail_idx == vq->avail_idx;
+}
+
+/* Busy poll an empty ring for up to @timeout microseconds, with guest
+ * notifications still disabled, so a guest adding buffers at a steady rate
+ * does not exit to kick us for each of them. Gives up early when other work
+ * or tasks are waiting for this worker. Returns true if the guest added
+ * buffers meanwhile. */
+bool vhost_vq_busy_poll(struct vhost_dev *dev, struct vhost_virtqueue *vq,
+			unsigned long timeout)
+{
+	u64 endtime = local_clock() + (u64)timeout * NSEC_PER_USEC;
+
+	while (vhost_vq_avail_empty(dev, vq)) {
+		if (need_resched() || signal_pending(current) ||
+		    !list_empty(&vq->worker->work_list) ||
+		    local_clock() >= endtime)
+			return false;
+		cpu_relax();
+	}
+	return true;
+}
+
 static void vhost_zerocopy_done_signal(struct kref *kref)
 {
 	struct vhost_ubuf_ref *ubufs = container_of(kref, struct vhost_ubuf_ref,
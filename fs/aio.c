@@ -35,6 +35,8 @@
 #include <linux/eventfd.h>
 #include <linux/blkdev.h>
 #include <linux/compat.h>
+#include <linux/interrupt.h>
+#include <linux/percpu.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -59,18 +61,61 @@ static struct workqueue_struct *aio_wq;
 static void aio_kick_handler(struct work_struct *);
 static void aio_queue_work(struct kioctx *);
 
+/*
+ * Index of the contexts of an mm, so that lookup_ioctx() does not walk
+ * mm->ioctx_list. The index is also stored in the id field of the ring,
+ * which user space can scribble on, so a miss falls back to the list.
+ */
+struct kioctx_table {
+	struct rcu_head		rcu;
+	unsigned		nr;
+	struct kioctx		*table[];
+};
+
+#define AIO_TABLE_MIN	4
+
+/*
+ * Completions from interrupt context are staged per cpu and flushed into
+ * the rings by a tasklet when the interrupt is done, so ctx_lock is taken,
+ * the ring is mapped and the waiters are woken up once per run of events
+ * of a context instead of once per event.
+ */
+#define AIO_BATCH_CPU	64
+
+struct aio_batch_event {
+	struct kiocb		*iocb;
+	long			res;
+	long			res2;
+};
+
+struct aio_batch_cpu {
+	unsigned		nr;
+	struct aio_batch_event	events[AIO_BATCH_CPU];
+	struct tasklet_struct	tasklet;
+};
+
+static DEFINE_PER_CPU(struct aio_batch_cpu, aio_batch_cpu);
+
+static void aio_batch_tasklet(unsigned long cpu);
+
 /* aio_setup
  *	Creates the slab caches used by the aio routines, panic on
  *	failure as this is done early during the boot sequence.
  */
 static int __init aio_setup(void)
 {
+	int cpu;
+
 	kiocb_cachep = KMEM_CACHE(kiocb, SLAB_HWCACHE_ALIGN|SLAB_PANIC);
 	kioctx_cachep = KMEM_CACHE(kioctx,SLAB_HWCACHE_ALIGN|SLAB_PANIC);
 
 	aio_wq = alloc_workqueue("aio", 0, 1);	/* used to limit concurrency */
 	BUG_ON(!aio_wq);
 
+	for_each_possible_cpu(cpu)
+		tasklet_init(&per_cpu(aio_batch_cpu, cpu).tasklet,
+			     aio_batch_tasklet, cpu);
+
 	pr_debug("aio_setup: sizeof(struct page) = %d\n", (int)sizeof(struct page));
 
 	return 0;
@@ -154,7 +199,7 @@ static int aio_setup_ring(struct kioctx *ctx)
 
 	ring = kmap_atomic(info->ring_pages[0]);
 	ring->nr = nr_events;	/* user copy */
-	ring->id = ctx->user_id;
+	ring->id = ~0U;		/* set by ioctx_add_table() */
 	ring->head = ring->tail = 0;
 	ring->magic = AIO_RING_MAGIC;
 	ring->compat_features = AIO_RING_COMPAT_FEATURES;
@@ -229,6 +274,72 @@ static inline void put_ioctx(struct kioctx *kioctx)
 		__put_ioctx(kioctx);
 }
 
+/* ioctx_add_table
+ *	Links the ctx into mm->ioctx_list and a free slot of mm->ioctx_table,
+ *	doubling the table if it is full.
+ */
+static int ioctx_add_table(struct kioctx *ctx, struct mm_struct *mm)
+{
+	struct kioctx_table *table, *old;
+	struct aio_ring *ring;
+	unsigned i, nr;
+
+	spin_lock(&mm->ioctx_lock);
+	for (;;) {
+		table = rcu_dereference_protected(mm->ioctx_table,
+					lockdep_is_held(&mm->ioctx_lock));
+		for (i = 0; table && i < table->nr; i++) {
+			if (table->table[i])
+				continue;
+			ctx->id = i;
+			rcu_assign_pointer(table->table[i], ctx);
+			hlist_add_head_rcu(&ctx->list, &mm->ioctx_list);
+			spin_unlock(&mm->ioctx_lock);
+
+			ring = kmap_atomic(ctx->ring_info.ring_pages[0]);
+			ring->id = ctx->id;
+			kunmap_atomic(ring);
+			return 0;
+		}
+
+		nr = table ? table->nr * 2 : AIO_TABLE_MIN;
+		spin_unlock(&mm->ioctx_lock);
+
+		table = kzalloc(sizeof(*table) + nr * sizeof(struct kioctx *),
+				GFP_KERNEL);
+		if (!table)
+			return -ENOMEM;
+		table->nr = nr;
+
+		spin_lock(&mm->ioctx_lock);
+		old = rcu_dereference_protected(mm->ioctx_table,
+					lockdep_is_held(&mm->ioctx_lock));
+		if (old && old->nr >= nr) {
+			/* somebody else grew it meanwhile */
+			kfree(table);
+			continue;
+		}
+		if (old)
+			memcpy(table->table, old->table,
+			       old->nr * sizeof(struct kioctx *));
+		rcu_assign_pointer(mm->ioctx_table, table);
+		if (old)
+			kfree_rcu(old, rcu);
+	}
+}
+
+/* ioctx_del_table
+ *	Frees the slot of the ctx. Called with mm->ioctx_lock held, or from
+ *	exit_aio() when nobody else can look at the mm.
+ */
+static void ioctx_del_table(struct kioctx *ctx, struct mm_struct *mm)
+{
+	struct kioctx_table *table = rcu_dereference_protected(mm->ioctx_table, 1);
+
+	if (table && ctx->id < table->nr && table->table[ctx->id] == ctx)
+		rcu_assign_pointer(table->table[ctx->id], NULL);
+}
+
 /* ioctx_alloc
  *	Allocates and initializes an ioctx.  Returns an ERR_PTR if it failed.
  */
@@ -278,15 +389,21 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	aio_nr += ctx->max_reqs;
 	spin_unlock(&aio_nr_lock);
 
-	/* now link into global list. */
-	spin_lock(&mm->ioctx_lock);
-	hlist_add_head_rcu(&ctx->list, &mm->ioctx_list);
-	spin_unlock(&mm->ioctx_lock);
+	/* now link into the list and the table of the mm. */
+	err = ioctx_add_table(ctx, mm);
+	if (err)
+		goto out_cleanup_nr;
 
 	dprintk("aio: allocated ioctx %p[%ld]: mm=%p mask=0x%x\n",
 		ctx, ctx->user_id, current->mm, ctx->ring_info.nr);
 	return ctx;
 
+out_cleanup_nr:
+	spin_lock(&aio_nr_lock);
+	aio_nr -= ctx->max_reqs;
+	spin_unlock(&aio_nr_lock);
+	aio_free_ring(ctx);
+	goto out_freectx;
 out_cleanup:
 	err = -EAGAIN;
 	aio_free_ring(ctx);
@@ -373,6 +490,7 @@ void exit_aio(struct mm_struct *mm)
 	while (!hlist_empty(&mm->ioctx_list)) {
 		ctx = hlist_entry(mm->ioctx_list.first, struct kioctx, list);
 		hlist_del_rcu(&ctx->list);
+		ioctx_del_table(ctx, mm);
 
 		kill_ctx(ctx);
 
@@ -394,6 +512,10 @@ void exit_aio(struct mm_struct *mm)
 		ctx->ring_info.mmap_size = 0;
 		put_ioctx(ctx);
 	}
+
+	/* lookup_ioctx() only runs on current->mm, nobody can see the table */
+	kfree(rcu_dereference_protected(mm->ioctx_table, 1));
+	mm->ioctx_table = NULL;
 }
 
 /* aio_get_req
@@ -586,12 +708,29 @@ EXPORT_SYMBOL(aio_put_req);
 
 static struct kioctx *lookup_ioctx(unsigned long ctx_id)
 {
+	struct aio_ring __user *ring = (void __user *)ctx_id;
 	struct mm_struct *mm = current->mm;
 	struct kioctx *ctx, *ret = NULL;
+	struct kioctx_table *table;
 	struct hlist_node *n;
+	unsigned id;
+
+	/* the ctx_id is the address of the ring, whose id indexes the table */
+	if (get_user(id, &ring->id))
+		id = ~0U;
 
 	rcu_read_lock();
 
+	table = rcu_dereference(mm->ioctx_table);
+	if (table && id < table->nr) {
+		ctx = rcu_dereference(table->table[id]);
+		if (ctx && ctx->user_id == ctx_id && !ctx->dead &&
+		    try_get_ioctx(ctx)) {
+			ret = ctx;
+			goto out;
+		}
+	}
+
 	hlist_for_each_entry_rcu(ctx, n, &mm->ioctx_list, list) {
 		/*
 		 * RCU protects us against accessing freed memory but
@@ -605,6 +744,7 @@ static struct kioctx *lookup_ioctx(unsigned long ctx_id)
 		}
 	}
 
+out:
 	rcu_read_unlock();
 	return ret;
 }
@@ -884,19 +1024,142 @@ void kick_iocb(struct kiocb *iocb)
 }
 EXPORT_SYMBOL(kick_iocb);
 
+/* __aio_complete_events
+ *	Adds the completion events of @nr requests of @ctx to the ring with
+ *	one tail update, and disposes of the requests. Called with
+ *	ctx->ctx_lock held and irqs disabled. Returns the result of
+ *	__aio_put_req() for the last request.
+ */
+static int __aio_complete_events(struct kioctx *ctx,
+				 struct aio_batch_event *ev, unsigned nr)
+{
+	struct aio_ring_info	*info = &ctx->ring_info;
+	struct aio_ring	*ring;
+	struct io_event	*event;
+	struct kiocb	*iocb;
+	unsigned long	tail = info->tail;
+	unsigned	i, added = 0;
+	int		ret = 0;
+
+	for (i = 0; i < nr; i++) {
+		iocb = ev[i].iocb;
+
+		if (iocb->ki_run_list.prev && !list_empty(&iocb->ki_run_list))
+			list_del_init(&iocb->ki_run_list);
+
+		/*
+		 * cancelled requests don't get events, userland was given one
+		 * when the event got cancelled.
+		 */
+		if (kiocbIsCancelled(iocb))
+			continue;
+
+		event = aio_ring_event(info, tail);
+		if (++tail >= info->nr)
+			tail = 0;
+
+		event->obj = (u64)(unsigned long)iocb->ki_obj.user;
+		event->data = iocb->ki_user_data;
+		event->res = ev[i].res;
+		event->res2 = ev[i].res2;
+
+		dprintk("aio_complete: %p[%lu]: %p: %p %Lx %lx %lx\n",
+			ctx, tail, iocb, iocb->ki_obj.user, iocb->ki_user_data,
+			ev[i].res, ev[i].res2);
+
+		put_aio_ring_event(event);
+		added++;
+	}
+
+	if (added) {
+		/* after flagging the requests as done, we
+		 * must never even look at them again
+		 */
+		smp_wmb();	/* make events visible before updating tail */
+
+		ring = kmap_atomic(info->ring_pages[0]);
+		info->tail = tail;
+		ring->tail = tail;
+		kunmap_atomic(ring);
+
+		pr_debug("added %u events to ring %p at [%lu]\n", added, ctx, tail);
+	}
+
+	for (i = 0; i < nr; i++) {
+		iocb = ev[i].iocb;
+
+		/*
+		 * Check if the user asked us to deliver the result through an
+		 * eventfd. The eventfd_signal() function is safe to be called
+		 * from IRQ context.
+		 */
+		if (iocb->ki_eventfd != NULL && !kiocbIsCancelled(iocb))
+			eventfd_signal(iocb->ki_eventfd, 1);
+
+		/* everything turned out well, dispose of the aiocb. */
+		ret = __aio_put_req(ctx, iocb);
+	}
+
+	/*
+	 * We have to order our ring_info tail store above and test
+	 * of the wait list below outside the wait lock.  This is
+	 * like in wake_up_bit() where clearing a bit has to be
+	 * ordered with the unlocked test.
+	 */
+	smp_mb();
+
+	if (waitqueue_active(&ctx->wait))
+		wake_up(&ctx->wait);
+
+	return ret;
+}
+
+/* aio_batch_flush
+ *	Moves the staged events of a cpu into the rings, one ctx_lock round
+ *	per run of events of the same context. Called with irqs disabled.
+ */
+static void aio_batch_flush(struct aio_batch_cpu *batch)
+{
+	struct kioctx *ctx;
+	unsigned i = 0, j;
+
+	while (i < batch->nr) {
+		ctx = batch->events[i].iocb->ki_ctx;
+		for (j = i + 1; j < batch->nr; j++)
+			if (batch->events[j].iocb->ki_ctx != ctx)
+				break;
+
+		spin_lock(&ctx->ctx_lock);
+		__aio_complete_events(ctx, &batch->events[i], j - i);
+		spin_unlock(&ctx->ctx_lock);
+		i = j;
+	}
+	batch->nr = 0;
+}
+
+static void aio_batch_tasklet(unsigned long cpu)
+{
+	unsigned long flags;
+
+	/* after a cpu hotplug, this may run on another cpu than @cpu */
+	local_irq_save(flags);
+	aio_batch_flush(&per_cpu(aio_batch_cpu, cpu));
+	local_irq_restore(flags);
+}
+
 /* aio_complete
  *	Called when the io request on the given iocb is complete.
  *	Returns true if this is the last user of the request.  The 
  *	only other user of the request can be the cancellation code.
+ *	A completion from interrupt context is only staged and returns 0;
+ *	the request is disposed of when the staged events are flushed.
  */
 int aio_complete(struct kiocb *iocb, long res, long res2)
 {
 	struct kioctx	*ctx = iocb->ki_ctx;
-	struct aio_ring_info	*info;
-	struct aio_ring	*ring;
-	struct io_event	*event;
+	struct aio_batch_event ev = { .iocb = iocb, .res = res, .res2 = res2 };
+	struct aio_batch_cpu *batch;
 	unsigned long	flags;
-	unsigned long	tail;
 	int		ret;
 
 	/*
@@ -914,7 +1177,17 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 		return 1;
 	}
 
-	info = &ctx->ring_info;
+	if (in_interrupt()) {
+		local_irq_save(flags);
+		batch = &__get_cpu_var(aio_batch_cpu);
+		if (batch->nr == AIO_BATCH_CPU)
+			aio_batch_flush(batch);
+		batch->events[batch->nr++] = ev;
+		if (batch->nr == 1)
+			tasklet_schedule(&batch->tasklet);
+		local_irq_restore(flags);
+		return 0;
+	}
 
 	/* add a completion event to the ring buffer.
 	 * must be done holding ctx->ctx_lock to prevent
@@ -923,69 +1196,7 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 	 * context.
 	 */
 	spin_lock_irqsave(&ctx->ctx_lock, flags);
-
-	if (iocb->ki_run_list.prev && !list_empty(&iocb->ki_run_list))
-		list_del_init(&iocb->ki_run_list);
-
-	/*
-	 * cancelled requests don't get events, userland was given one
-	 * when the event got cancelled.
-	 */
-	if (kiocbIsCancelled(iocb))
-		goto put_rq;
-
-	ring = kmap_atomic(info->ring_pages[0]);
-
-	tail = info->tail;
-	event = aio_ring_event(info, tail);
-	if (++tail >= info->nr)
-		tail = 0;
-
-	event->obj = (u64)(unsigned long)iocb->ki_obj.user;
-	event->data = iocb->ki_user_data;
-	event->res = res;
-	event->res2 = res2;
-
-	dprintk("aio_complete: %p[%lu]: %p: %p %Lx %lx %lx\n",
-		ctx, tail, iocb, iocb->ki_obj.user, iocb->ki_user_data,
-		res, res2);
-
-	/* after flagging the request as done, we
-	 * must never even look at it again
-	 */
-	smp_wmb();	/* make event visible before updating tail */
-
-	info->tail = tail;
-	ring->tail = tail;
-
-	put_aio_ring_event(event);
-	kunmap_atomic(ring);
-
-	pr_debug("added to ring %p at [%lu]\n", iocb, tail);
-
-	/*
-	 * Check if the user asked us to deliver the result through an
-	 * eventfd. The eventfd_signal() function is safe to be called
-	 * from IRQ context.
-	 */
-	if (iocb->ki_eventfd != NULL)
-		eventfd_signal(iocb->ki_eventfd, 1);
-
-put_rq:
-	/* everything turned out well, dispose of the aiocb. */
-	ret = __aio_put_req(ctx, iocb);
-
-	/*
-	 * We have to order our ring_info tail store above and test
-	 * of the wait list below outside the wait lock.  This is
-	 * like in wake_up_bit() where clearing a bit has to be
-	 * ordered with the unlocked test.
-	 */
-	smp_mb();
-
-	if (waitqueue_active(&ctx->wait))
-		wake_up(&ctx->wait);
-
+	ret = __aio_complete_events(ctx, &ev, 1);
 	spin_unlock_irqrestore(&ctx->ctx_lock, flags);
 	return ret;
 }
@@ -1199,6 +1410,7 @@ static void io_destroy(struct kioctx *ioctx)
 	was_dead = ioctx->dead;
 	ioctx->dead = 1;
 	hlist_del_rcu(&ioctx->list);
+	ioctx_del_table(ioctx, mm);
 	spin_unlock(&mm->ioctx_lock);
 
 	dprintk("aio_release(%p)\n", ioctx);
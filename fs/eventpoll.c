@@ -34,6 +34,7 @@
 #include <linux/mutex.h>
 #include <linux/anon_inodes.h>
 #include <linux/device.h>
+#include <linux/percpu.h>
 #include <asm/uaccess.h>
 #include <asm/io.h>
 #include <asm/mman.h>
@@ -85,10 +86,25 @@
  * Events that require holding "epmutex" are very rare, while for
  * normal operations the epoll private "ep->mtx" will guarantee
  * a better scalability.
+ *
+ * An eventpoll created with EPOLL_PERCPU has a ready list per cpu, each
+ * protected by its own spinlock, and the poll callback only takes the
+ * lock of the local one. It takes "ep->lock" only for items with
+ * EPOLLWAKEUP, to activate their wakeup source under it. The per-cpu
+ * lists are merged into ep->rdllist by ep_scan_ready_list(), with
+ * "ep->mtx" and "ep->lock" held, so their locks nest inside "ep->lock".
+ * The waiters on ep->wq are added and removed holding both "ep->lock" and
+ * the wait queue lock, since the per-cpu poll callback wakes them up with
+ * only the latter.
  */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLWAKEUP | EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLWAKEUP | EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE)
+
+/* Events that can be waited for with EPOLLEXCLUSIVE */
+#define EPOLLEXCLUSIVE_OK_BITS (POLLIN | POLLOUT | POLLERR | POLLHUP | \
+				POLLRDNORM | POLLWRNORM | EPOLLWAKEUP | \
+				EPOLLET | EPOLLEXCLUSIVE)
 
 /* Maximum number of nesting allowed inside epoll sets */
 #define EP_MAX_NESTS 4
@@ -160,6 +176,19 @@ struct epitem {
 
 	/* The structure that describe the interested events and the source fd */
 	struct epoll_event event;
+
+	/*
+	 * With EPOLL_PERCPU, the per-cpu ready list this item is queued on,
+	 * or NULL, and the list header used to link it there.
+	 */
+	struct ep_rdllist *pcpu_rdl;
+	struct list_head pcpu_rdllink;
+};
+
+/* Per-cpu ready list of an eventpoll created with EPOLL_PERCPU */
+struct ep_rdllist {
+	spinlock_t lock;
+	struct list_head list;
 };
 
 /*
@@ -188,6 +217,9 @@ struct eventpoll {
 	/* List of ready file descriptors */
 	struct list_head rdllist;
 
+	/* Per-cpu lists the poll callback queues to, with EPOLL_PERCPU */
+	struct ep_rdllist __percpu *pcpu_rdllist;
+
 	/* RB tree root used to store monitored fd structs */
 	struct rb_root rbr;
 
@@ -366,7 +398,66 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
  */
 static inline int ep_events_available(struct eventpoll *ep)
 {
-	return !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
+	int cpu;
+
+	if (!list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR)
+		return 1;
+
+	if (ep->pcpu_rdllist) {
+		for_each_possible_cpu(cpu)
+			if (!list_empty(&per_cpu_ptr(ep->pcpu_rdllist, cpu)->list))
+				return 1;
+	}
+	return 0;
+}
+
+/*
+ * Moves the items of the per-cpu ready lists to @head, unless they are
+ * already on a list through their ->rdllink. Must be called with "mtx" and
+ * "ep->lock" held.
+ */
+static void ep_merge_pcpu_ready(struct eventpoll *ep, struct list_head *head)
+{
+	struct ep_rdllist *rdl;
+	struct epitem *epi, *tmp;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		rdl = per_cpu_ptr(ep->pcpu_rdllist, cpu);
+		if (list_empty(&rdl->list))
+			continue;
+
+		spin_lock(&rdl->lock);
+		list_for_each_entry_safe(epi, tmp, &rdl->list, pcpu_rdllink) {
+			list_del_init(&epi->pcpu_rdllink);
+			/* pairs with the cmpxchg() in ep_poll_callback_pcpu() */
+			smp_wmb();
+			epi->pcpu_rdl = NULL;
+			if (!ep_is_linked(&epi->rdllink)) {
+				list_add_tail(&epi->rdllink, head);
+				__pm_stay_awake(epi->ws);
+			}
+		}
+		spin_unlock(&rdl->lock);
+	}
+}
+
+/*
+ * Takes an item off the per-cpu ready list it is queued on, if any. Its poll
+ * callbacks must be unregistered already.
+ */
+static void ep_unqueue_pcpu_ready(struct epitem *epi)
+{
+	struct ep_rdllist *rdl = epi->pcpu_rdl;
+	unsigned long flags;
+
+	if (!rdl)
+		return;
+
+	spin_lock_irqsave(&rdl->lock, flags);
+	list_del_init(&epi->pcpu_rdllink);
+	epi->pcpu_rdl = NULL;
+	spin_unlock_irqrestore(&rdl->lock, flags);
 }
 
 /**
@@ -569,9 +660,11 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	 * happening while looping w/out locks, are not lost. We cannot
 	 * have the poll callback to queue directly on ep->rdllist,
 	 * because we want the "sproc" callback to be able to do it
-	 * in a lockless way.
+	 * in a lockless way. The per-cpu ready lists are merged first.
 	 */
 	spin_lock_irqsave(&ep->lock, flags);
+	if (ep->pcpu_rdllist)
+		ep_merge_pcpu_ready(ep, &ep->rdllist);
 	list_splice_init(&ep->rdllist, &txlist);
 	ep->ovflist = NULL;
 	spin_unlock_irqrestore(&ep->lock, flags);
@@ -607,6 +700,14 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	 */
 	ep->ovflist = EP_UNACTIVE_PTR;
 
+	/*
+	 * The per-cpu poll callback does not use ep->ovflist. It queued the
+	 * events of the meantime on the per-cpu lists, pick them up here the
+	 * same way.
+	 */
+	if (ep->pcpu_rdllist)
+		ep_merge_pcpu_ready(ep, &ep->rdllist);
+
 	/*
 	 * Quickly re-inject items left on "txlist".
 	 */
@@ -666,6 +767,8 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 		list_del_init(&epi->rdllink);
 	spin_unlock_irqrestore(&ep->lock, flags);
 
+	ep_unqueue_pcpu_ready(epi);
+
 	wakeup_source_unregister(epi->ws);
 
 	/* At this point it is safe to free the eventpoll item */
@@ -717,6 +820,7 @@ static void ep_free(struct eventpoll *ep)
 
 	mutex_unlock(&epmutex);
 	mutex_destroy(&ep->mtx);
+	free_percpu(ep->pcpu_rdllist);
 	free_uid(ep->user);
 	wakeup_source_unregister(ep->ws);
 	kfree(ep);
@@ -829,11 +933,12 @@ void eventpoll_release_file(struct file *file)
 	mutex_unlock(&epmutex);
 }
 
-static int ep_alloc(struct eventpoll **pep)
+static int ep_alloc(struct eventpoll **pep, int flags)
 {
-	int error;
+	int error, cpu;
 	struct user_struct *user;
 	struct eventpoll *ep;
+	struct ep_rdllist *rdl;
 
 	user = get_current_user();
 	error = -ENOMEM;
@@ -841,6 +946,17 @@ static int ep_alloc(struct eventpoll **pep)
 	if (unlikely(!ep))
 		goto free_uid;
 
+	if (flags & EPOLL_PERCPU) {
+		ep->pcpu_rdllist = alloc_percpu(struct ep_rdllist);
+		if (unlikely(!ep->pcpu_rdllist))
+			goto free_ep;
+		for_each_possible_cpu(cpu) {
+			rdl = per_cpu_ptr(ep->pcpu_rdllist, cpu);
+			spin_lock_init(&rdl->lock);
+			INIT_LIST_HEAD(&rdl->list);
+		}
+	}
+
 	spin_lock_init(&ep->lock);
 	mutex_init(&ep->mtx);
 	init_waitqueue_head(&ep->wq);
@@ -854,6 +970,8 @@ static int ep_alloc(struct eventpoll **pep)
 
 	return 0;
 
+free_ep:
+	kfree(ep);
 free_uid:
 	free_uid(user);
 	return error;
@@ -888,14 +1006,78 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
 	return epir;
 }
 
+/*
+ * The poll callback of an eventpoll created with EPOLL_PERCPU. The item is
+ * queued on the ready list of the local cpu, without taking "ep->lock", and
+ * one waiter is woken up. Returns whether a waiter was woken up.
+ */
+static int ep_poll_callback_pcpu(struct epitem *epi, void *key)
+{
+	struct eventpoll *ep = epi->ep;
+	struct ep_rdllist *rdl;
+	struct wakeup_source *ws;
+	unsigned long flags;
+	int ewake = 0;
+
+	/* see ep_poll_callback() */
+	if (!(epi->event.events & ~EP_PRIVATE_BITS))
+		return 0;
+	if (key && !((unsigned long) key & epi->event.events))
+		return 0;
+
+	/*
+	 * Whoever sets ->pcpu_rdl queues the item. If it is set already, the
+	 * item is on some cpu's list and ep_scan_ready_list() will find it.
+	 * An EPOLLWAKEUP item still takes "ep->lock", so that its wakeup
+	 * source is activated under it, as ep_poll_callback() does, and
+	 * ep_scan_ready_list() cannot deliver the item in between.
+	 */
+	local_irq_save(flags);
+	rdl = this_cpu_ptr(ep->pcpu_rdllist);
+	if (!epi->pcpu_rdl && !cmpxchg(&epi->pcpu_rdl, NULL, rdl)) {
+		ws = ACCESS_ONCE(epi->ws);
+		if (ws)
+			spin_lock(&ep->lock);
+		spin_lock(&rdl->lock);
+		list_add_tail(&epi->pcpu_rdllink, &rdl->list);
+		spin_unlock(&rdl->lock);
+		if (ws) {
+			__pm_stay_awake(epi->ws);
+			spin_unlock(&ep->lock);
+		}
+	}
+	local_irq_restore(flags);
+
+	/*
+	 * The item must be visible on the list before we look for waiters,
+	 * pairs with set_current_state() in ep_poll().
+	 */
+	smp_mb();
+	if (waitqueue_active(&ep->wq)) {
+		wake_up(&ep->wq);
+		ewake = 1;
+	}
+	if (waitqueue_active(&ep->poll_wait)) {
+		ep_poll_safewake(&ep->poll_wait);
+		ewake = 1;
+	}
+
+	return ewake;
+}
+
 /*
  * This is the callback that is passed to the wait queue wakeup
  * mechanism. It is called by the stored file descriptors when they
  * have events to report.
+ *
+ * For an item added with EPOLLEXCLUSIVE, the wait queue entry is exclusive
+ * and the return value tells the waker whether this eventpoll took the
+ * event, that is whether somebody was waiting on it. If not, the waker
+ * carries on with the next exclusive entry, the next eventpoll.
  */
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
-	int pwake = 0;
+	int pwake = 0, ewake = 0;
 	unsigned long flags;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
@@ -911,6 +1093,11 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 		list_del_init(&wait->task_list);
 	}
 
+	if (ep->pcpu_rdllist) {
+		ewake = ep_poll_callback_pcpu(epi, key);
+		goto out;
+	}
+
 	spin_lock_irqsave(&ep->lock, flags);
 
 	/*
@@ -963,10 +1150,14 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
 	 * wait list.
 	 */
-	if (waitqueue_active(&ep->wq))
+	if (waitqueue_active(&ep->wq)) {
 		wake_up_locked(&ep->wq);
-	if (waitqueue_active(&ep->poll_wait))
+		ewake = 1;
+	}
+	if (waitqueue_active(&ep->poll_wait)) {
 		pwake++;
+		ewake = 1;
+	}
 
 out_unlock:
 	spin_unlock_irqrestore(&ep->lock, flags);
@@ -975,7 +1166,13 @@ out_unlock:
 	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
-	return 1;
+out:
+	/* POLLFREE unhooked the entry, the waker must not count it */
+	if (!(epi->event.events & EPOLLEXCLUSIVE) ||
+	    ((unsigned long)key & POLLFREE))
+		ewake = 1;
+
+	return ewake;
 }
 
 /*
@@ -992,7 +1189,10 @@ static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
 		init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
 		pwq->whead = whead;
 		pwq->base = epi;
-		add_wait_queue(whead, &pwq->wait);
+		if (epi->event.events & EPOLLEXCLUSIVE)
+			add_wait_queue_exclusive(whead, &pwq->wait);
+		else
+			add_wait_queue(whead, &pwq->wait);
 		list_add_tail(&pwq->llink, &epi->pwqlist);
 		epi->nwait++;
 	} else {
@@ -1166,6 +1366,8 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	epi->event = *event;
 	epi->nwait = 0;
 	epi->next = EP_UNACTIVE_PTR;
+	epi->pcpu_rdl = NULL;
+	INIT_LIST_HEAD(&epi->pcpu_rdllink);
 	if (epi->event.events & EPOLLWAKEUP) {
 		error = ep_create_wakeup_source(epi);
 		if (error)
@@ -1260,6 +1462,8 @@ error_unregister:
 		list_del_init(&epi->rdllink);
 	spin_unlock_irqrestore(&ep->lock, flags);
 
+	ep_unqueue_pcpu_ready(epi);
+
 	wakeup_source_unregister(epi->ws);
 
 error_create_wakeup_source:
@@ -1498,7 +1702,9 @@ fetch_events:
 		 * ep_poll_callback() when events will become available.
 		 */
 		init_waitqueue_entry(&wait, current);
+		spin_lock(&ep->wq.lock);
 		__add_wait_queue_exclusive(&ep->wq, &wait);
+		spin_unlock(&ep->wq.lock);
 
 		for (;;) {
 			/*
@@ -1520,7 +1726,9 @@ fetch_events:
 
 			spin_lock_irqsave(&ep->lock, flags);
 		}
+		spin_lock(&ep->wq.lock);
 		__remove_wait_queue(&ep->wq, &wait);
+		spin_unlock(&ep->wq.lock);
 
 		set_current_state(TASK_RUNNING);
 	}
@@ -1651,12 +1859,14 @@ SYSCALL_DEFINE1(epoll_create1, int, flags)
 	/* Check the EPOLL_* constant for consistency.  */
 	BUILD_BUG_ON(EPOLL_CLOEXEC != O_CLOEXEC);
 
-	if (flags & ~EPOLL_CLOEXEC)
+	BUILD_BUG_ON(EPOLL_PERCPU & EPOLL_CLOEXEC);
+
+	if (flags & ~(EPOLL_CLOEXEC | EPOLL_PERCPU))
 		return -EINVAL;
 	/*
 	 * Create the internal data structure ("struct eventpoll").
 	 */
-	error = ep_alloc(&ep);
+	error = ep_alloc(&ep, flags);
 	if (error < 0)
 		return error;
 	/*
@@ -1742,6 +1952,20 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	if (file == tfile || !is_file_epoll(file))
 		goto error_tgt_fput;
 
+	/*
+	 * EPOLLEXCLUSIVE only makes sense when adding a file, and only
+	 * together with the events a plain wakeup of the file can mean. It
+	 * is not allowed on epoll files, which would make the wakeup of
+	 * nested epoll sets depend on their waiters.
+	 */
+	if (ep_op_has_event(op) && (epds.events & EPOLLEXCLUSIVE)) {
+		if (op == EPOLL_CTL_MOD)
+			goto error_tgt_fput;
+		if (is_file_epoll(tfile) ||
+		    (epds.events & ~EPOLLEXCLUSIVE_OK_BITS))
+			goto error_tgt_fput;
+	}
+
 	/*
 	 * At this point it is safe to assume that the "private_data" contains
 	 * our own data structure.
@@ -1802,8 +2026,11 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 		break;
 	case EPOLL_CTL_MOD:
 		if (epi) {
-			epds.events |= POLLERR | POLLHUP;
-			error = ep_modify(ep, epi, &epds);
+			/* the wait queue entries of the item stay exclusive */
+			if (!(epi->event.events & EPOLLEXCLUSIVE)) {
+				epds.events |= POLLERR | POLLHUP;
+				error = ep_modify(ep, epi, &epds);
+			}
 		} else
 			error = -ENOENT;
 		break;
@@ -19,13 +19,14 @@
 #include <linux/pipe_fs_i.h>
 #include <linux/swap.h>
 #include <linux/splice.h>
+#include <linux/percpu.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_dev *fuse_get_dev(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
@@ -34,6 +35,19 @@ static struct fuse_conn *fuse_get_conn(struct file *file)
 	return file->private_data;
 }
 
+static struct fuse_conn *fuse_get_conn(struct file *file)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+
+	return fud ? fud->fc : NULL;
+}
+
+/* The queue of the CPU we run on, it is fine to migrate away from it */
+static struct fuse_queue *fuse_local_queue(struct fuse_conn *fc)
+{
+	return __this_cpu_ptr(fc->queues);
+}
+
 static void fuse_request_init(struct fuse_req *req)
 {
 	memset(req, 0, sizeof(*req));
@@ -226,28 +240,66 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 	return nbytes;
 }
 
-static u64 fuse_get_unique(struct fuse_conn *fc)
+/*
+ * The low queue_shift bits of a unique ID are the index of the queue
+ * the request is on, so the reply finds it without searching all the
+ * queues.  Requests not on a queue (FORGET) use index nr_cpu_ids and
+ * the counter of the connection, under fc->lock.  Counters start from
+ * one, as zero is special.
+ */
+static u64 fuse_get_unique(struct fuse_conn *fc, struct fuse_queue *q)
 {
-	fc->reqctr++;
-	/* zero is special */
-	if (fc->reqctr == 0)
-		fc->reqctr = 1;
+	if (!q)
+		return (++fc->reqctr << fc->queue_shift) | nr_cpu_ids;
 
-	return fc->reqctr;
+	return (++q->reqctr << fc->queue_shift) | q->index;
+}
+
+static struct fuse_queue *fuse_unique_queue(struct fuse_conn *fc, u64 unique)
+{
+	unsigned index = unique & ((1ULL << fc->queue_shift) - 1);
+
+	if (index >= nr_cpu_ids || !cpu_possible(index))
+		return NULL;
+
+	return per_cpu_ptr(fc->queues, index);
+}
+
+/*
+ * Wake up a reader for a new request or interrupt on the queue: one
+ * bound to the queue if there is one waiting, else any idle reader,
+ * which will take it over. When more than one request is pending, an
+ * idle reader is woken as well to help the bound one with the backlog.
+ * Called with q->lock held.
+ */
+static void wake_reader(struct fuse_conn *fc, struct fuse_queue *q)
+{
+	/* Readers add themselves to the waitqueue, then check the lists */
+	smp_mb();
+	if (!waitqueue_active(&q->waitq)) {
+		wake_up(&fc->waitq);
+	} else {
+		wake_up(&q->waitq);
+		if (!list_empty(&q->pending) && !list_is_singular(&q->pending))
+			wake_up(&fc->waitq);
+	}
+	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 }
 
-static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
+/* Called with q->lock held */
+static void queue_request(struct fuse_conn *fc, struct fuse_queue *q,
+			  struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	req->queue = q;
+	list_add_tail(&req->list, &q->pending);
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	wake_reader(fc, q);
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
@@ -272,13 +324,16 @@ static void flush_bg_queue(struct fuse_conn *fc)
 {
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
+		struct fuse_queue *q = fuse_local_queue(fc);
 		struct fuse_req *req;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		spin_lock(&q->lock);
+		req->in.h.unique = fuse_get_unique(fc, q);
+		queue_request(fc, q, req);
+		spin_unlock(&q->lock);
 	}
 }
 
@@ -290,17 +345,21 @@ static void flush_bg_queue(struct fuse_conn *fc)
  * the 'end' callback is called if given, else the reference to the
  * request is released
  *
- * Called with fc->lock, unlocks it
+ * Called with the lock of the queue of the request, if it was queued,
+ * unlocks it
  */
 static void request_end(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
+__releases(req->queue->lock)
 {
 	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 	req->end = NULL;
 	list_del(&req->list);
 	list_del(&req->intr_entry);
 	req->state = FUSE_REQ_FINISHED;
+	if (req->queue)
+		spin_unlock(&req->queue->lock);
 	if (req->background) {
+		spin_lock(&fc->lock);
 		if (fc->num_background == fc->max_background) {
 			fc->blocked = 0;
 			wake_up_all(&fc->blocked_waitq);
@@ -313,8 +372,8 @@ __releases(fc->lock)
 		fc->num_background--;
 		fc->active_background--;
 		flush_bg_queue(fc);
+		spin_unlock(&fc->lock);
 	}
-	spin_unlock(&fc->lock);
 	wake_up(&req->waitq);
 	if (end)
 		end(fc, req);
@@ -323,27 +382,29 @@ __releases(fc->lock)
 
 static void wait_answer_interruptible(struct fuse_conn *fc,
 				      struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(req->queue->lock)
+__acquires(req->queue->lock)
 {
 	if (signal_pending(current))
 		return;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&req->queue->lock);
 	wait_event_interruptible(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	spin_lock(&req->queue->lock);
 }
 
-static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
+/* Called with q->lock held */
+static void queue_interrupt(struct fuse_conn *fc, struct fuse_queue *q,
+			    struct fuse_req *req)
 {
-	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	list_add_tail(&req->intr_entry, &q->interrupts);
+	wake_reader(fc, q);
 }
 
+/* Called with the lock of the queue of the request held */
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(req->queue->lock)
+__acquires(req->queue->lock)
 {
 	if (!fc->no_interrupt) {
 		/* Any signal may interrupt this */
@@ -356,7 +417,7 @@ __acquires(fc->lock)
 
 		req->interrupted = 1;
 		if (req->state == FUSE_REQ_SENT)
-			queue_interrupt(fc, req);
+			queue_interrupt(fc, req->queue, req);
 	}
 
 	if (!req->force) {
@@ -385,9 +446,9 @@ __acquires(fc->lock)
 	 * Either request is already in userspace, or it was forced.
 	 * Wait it out.
 	 */
-	spin_unlock(&fc->lock);
+	spin_unlock(&req->queue->lock);
 	wait_event(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	spin_lock(&req->queue->lock);
 
 	if (!req->aborted)
 		return;
@@ -400,30 +461,32 @@ __acquires(fc->lock)
 		   locked state, there mustn't be any filesystem
 		   operation (e.g. page fault), since that could lead
 		   to deadlock */
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->queue->lock);
 		wait_event(req->waitq, !req->locked);
-		spin_lock(&fc->lock);
+		spin_lock(&req->queue->lock);
 	}
 }
 
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_queue *q = fuse_local_queue(fc);
+
 	req->isreply = 1;
-	spin_lock(&fc->lock);
+	spin_lock(&q->lock);
 	if (!fc->connected)
 		req->out.h.error = -ENOTCONN;
 	else if (fc->conn_error)
 		req->out.h.error = -ECONNREFUSED;
 	else {
-		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		req->in.h.unique = fuse_get_unique(fc, q);
+		queue_request(fc, q, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
 		__fuse_get_request(req);
 
 		request_wait_answer(fc, req);
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 }
 EXPORT_SYMBOL_GPL(fuse_request_send);
 
@@ -450,6 +513,7 @@ static void fuse_request_send_nowait(struct fuse_conn *fc, struct fuse_req *req)
 		fuse_request_send_nowait_locked(fc, req);
 		spin_unlock(&fc->lock);
 	} else {
+		spin_unlock(&fc->lock);
 		req->out.h.error = -ENOTCONN;
 		request_end(fc, req);
 	}
@@ -465,16 +529,17 @@ EXPORT_SYMBOL_GPL(fuse_request_send_background);
 static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 					  struct fuse_req *req, u64 unique)
 {
+	struct fuse_queue *q = fuse_local_queue(fc);
 	int err = -ENODEV;
 
 	req->isreply = 0;
 	req->in.h.unique = unique;
-	spin_lock(&fc->lock);
+	spin_lock(&q->lock);
 	if (fc->connected) {
-		queue_request(fc, req);
+		queue_request(fc, q, req);
 		err = 0;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 
 	return err;
 }
@@ -500,12 +565,12 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	int err = 0;
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->queue->lock);
 		if (req->aborted)
 			err = -ENOENT;
 		else
 			req->locked = 1;
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->queue->lock);
 	}
 	return err;
 }
@@ -518,11 +583,11 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
 static void unlock_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->queue->lock);
 		req->locked = 0;
 		if (req->aborted)
 			wake_up(&req->waitq);
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->queue->lock);
 	}
 }
 
@@ -752,12 +817,12 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 		lru_cache_add_file(newpage);
 
 	err = 0;
-	spin_lock(&cs->fc->lock);
+	spin_lock(&cs->req->queue->lock);
 	if (cs->req->aborted)
 		err = -ENOENT;
 	else
 		*pagep = newpage;
-	spin_unlock(&cs->fc->lock);
+	spin_unlock(&cs->req->queue->lock);
 
 	if (err) {
 		unlock_page(newpage);
@@ -910,30 +975,79 @@ static int forget_pending(struct fuse_conn *fc)
 	return fc->forget_list_head.next != NULL;
 }
 
+static int queue_pending(struct fuse_queue *q)
+{
+	return !list_empty(&q->pending) || !list_empty(&q->interrupts);
+}
+
 static int request_pending(struct fuse_conn *fc)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
-		forget_pending(fc);
+	int cpu;
+
+	if (forget_pending(fc))
+		return 1;
+
+	for_each_possible_cpu(cpu)
+		if (queue_pending(per_cpu_ptr(fc->queues, cpu)))
+			return 1;
+
+	return 0;
 }
 
-/* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+/*
+ * Find a queue with a request or interrupt to read: the own queue of
+ * the reader, else the first one after it that has one.
+ */
+static struct fuse_queue *find_queue(struct fuse_conn *fc,
+				     struct fuse_queue *own)
+{
+	struct fuse_queue *q;
+	int cpu;
+
+	if (!own)
+		own = fuse_local_queue(fc);
+	if (queue_pending(own))
+		return own;
+
+	cpu = own->index;
+	for (;;) {
+		cpu = cpumask_next(cpu, cpu_possible_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_possible_mask);
+		if (cpu == own->index)
+			return NULL;
+
+		q = per_cpu_ptr(fc->queues, cpu);
+		if (queue_pending(q))
+			return q;
+	}
+}
+
+/*
+ * Wait until a request is available on one of the queues.  A reader
+ * bound to a queue waits on it as well, so it is woken up first for
+ * requests queued there.
+ */
+static void request_wait(struct fuse_conn *fc, struct fuse_queue *own)
 {
 	DECLARE_WAITQUEUE(wait, current);
+	DECLARE_WAITQUEUE(own_wait, current);
 
 	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
+	if (own)
+		add_wait_queue_exclusive(&own->waitq, &own_wait);
+	for (;;) {
 		set_current_state(TASK_INTERRUPTIBLE);
+		if (!fc->connected || request_pending(fc))
+			break;
 		if (signal_pending(current))
 			break;
 
-		spin_unlock(&fc->lock);
 		schedule();
-		spin_lock(&fc->lock);
 	}
 	set_current_state(TASK_RUNNING);
+	if (own)
+		remove_wait_queue(&own->waitq, &own_wait);
 	remove_wait_queue(&fc->waitq, &wait);
 }
 
@@ -943,11 +1057,12 @@ __acquires(fc->lock)
  * Unlike other requests this is assembled on demand, without a need
  * to allocate a separate fuse_req structure.
  *
- * Called with fc->lock held, releases it
+ * Called with q->lock held, releases it
  */
-static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_copy_state *cs,
+static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_queue *q,
+			       struct fuse_copy_state *cs,
 			       size_t nbytes, struct fuse_req *req)
-__releases(fc->lock)
+__releases(q->lock)
 {
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
@@ -955,7 +1070,7 @@ __releases(fc->lock)
 	int err;
 
 	list_del_init(&req->intr_entry);
-	req->intr_unique = fuse_get_unique(fc);
+	req->intr_unique = fuse_get_unique(fc, q);
 	memset(&ih, 0, sizeof(ih));
 	memset(&arg, 0, sizeof(arg));
 	ih.len = reqsize;
@@ -963,7 +1078,7 @@ __releases(fc->lock)
 	ih.unique = req->intr_unique;
 	arg.unique = req->in.h.unique;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 	if (nbytes < reqsize)
 		return -EINVAL;
 
@@ -1010,7 +1125,7 @@ __releases(fc->lock)
 	struct fuse_in_header ih = {
 		.opcode = FUSE_FORGET,
 		.nodeid = forget->forget_one.nodeid,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_unique(fc, NULL),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
@@ -1041,7 +1156,7 @@ __releases(fc->lock)
 	struct fuse_batch_forget_in arg = { .count = 0 };
 	struct fuse_in_header ih = {
 		.opcode = FUSE_BATCH_FORGET,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_unique(fc, NULL),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
@@ -1102,42 +1217,63 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_queue *own = fuse_get_dev(file)->queue;
+	struct fuse_queue *q;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
 
  restart:
-	spin_lock(&fc->lock);
-	err = -EAGAIN;
 	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
 	    !request_pending(fc))
-		goto err_unlock;
+		return -EAGAIN;
+
+	request_wait(fc, own);
+	if (!fc->connected)
+		return -ENODEV;
+	if (!request_pending(fc)) {
+		if (signal_pending(current))
+			return -ERESTARTSYS;
+		/* Another reader took it */
+		goto restart;
+	}
 
-	request_wait(fc);
+	/* Interrupts first, then forgets interleaved with requests */
+	q = find_queue(fc, own);
+	if ((!q || list_empty(&q->interrupts)) && forget_pending(fc)) {
+		spin_lock(&fc->lock);
+		if (forget_pending(fc)) {
+			if (!q || fc->forget_batch-- > 0)
+				return fuse_read_forget(fc, cs, nbytes);
+
+			if (fc->forget_batch <= -8)
+				fc->forget_batch = 16;
+		}
+		spin_unlock(&fc->lock);
+	}
+	/* Another reader took it */
+	if (!q)
+		goto restart;
+
+	spin_lock(&q->lock);
 	err = -ENODEV;
 	if (!fc->connected)
 		goto err_unlock;
-	err = -ERESTARTSYS;
-	if (!request_pending(fc))
-		goto err_unlock;
 
-	if (!list_empty(&fc->interrupts)) {
-		req = list_entry(fc->interrupts.next, struct fuse_req,
+	if (!list_empty(&q->interrupts)) {
+		req = list_entry(q->interrupts.next, struct fuse_req,
 				 intr_entry);
-		return fuse_read_interrupt(fc, cs, nbytes, req);
+		return fuse_read_interrupt(fc, q, cs, nbytes, req);
 	}
 
-	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
-			return fuse_read_forget(fc, cs, nbytes);
-
-		if (fc->forget_batch <= -8)
-			fc->forget_batch = 16;
+	if (list_empty(&q->pending)) {
+		spin_unlock(&q->lock);
+		goto restart;
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	req = list_entry(q->pending.next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &q->io);
 
 	in = &req->in;
 	reqsize = in->h.len;
@@ -1150,14 +1286,14 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 		goto restart;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 	cs->req = req;
 	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
 		err = fuse_copy_args(cs, in->numargs, in->argpages,
 				     (struct fuse_arg *) in->args, 0);
 	fuse_copy_finish(cs);
-	spin_lock(&fc->lock);
+	spin_lock(&q->lock);
 	req->locked = 0;
 	if (req->aborted) {
 		request_end(fc, req);
@@ -1172,15 +1308,15 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		list_move_tail(&req->list, &q->processing);
 		if (req->interrupted)
-			queue_interrupt(fc, req);
-		spin_unlock(&fc->lock);
+			queue_interrupt(fc, q, req);
+		spin_unlock(&q->lock);
 	}
 	return reqsize;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 	return err;
 }
 
@@ -1659,11 +1795,11 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 }
 
 /* Look up request on processing list by unique ID */
-static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
+static struct fuse_req *request_find(struct fuse_queue *q, u64 unique)
 {
 	struct list_head *entry;
 
-	list_for_each(entry, &fc->processing) {
+	list_for_each(entry, &q->processing) {
 		struct fuse_req *req;
 		req = list_entry(entry, struct fuse_req, list);
 		if (req->in.h.unique == unique || req->intr_unique == unique)
@@ -1698,7 +1834,8 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
 /*
  * Write a single reply to a request.  First the header is copied from
  * the write buffer.  The request is then searched on the processing
- * list by the unique ID found in the header.  If found, then remove
+ * list of the queue the unique ID found in the header belongs to.
+ * Any device of the connection can take the reply.  If found, then remove
  * it from the list and copy the rest of the buffer to the request.
  * The request is finished by calling request_end()
  */
@@ -1706,6 +1843,7 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 				 struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_queue *q;
 	struct fuse_req *req;
 	struct fuse_out_header oh;
 
@@ -1733,19 +1871,23 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	if (oh.error <= -1000 || oh.error > 0)
 		goto err_finish;
 
-	spin_lock(&fc->lock);
 	err = -ENOENT;
+	q = fuse_unique_queue(fc, oh.unique);
+	if (!q)
+		goto err_finish;
+
+	spin_lock(&q->lock);
 	if (!fc->connected)
 		goto err_unlock;
 
-	req = request_find(fc, oh.unique);
+	req = request_find(q, oh.unique);
 	if (!req)
 		goto err_unlock;
 
 	if (req->aborted) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&q->lock);
 		fuse_copy_finish(cs);
-		spin_lock(&fc->lock);
+		spin_lock(&q->lock);
 		request_end(fc, req);
 		return -ENOENT;
 	}
@@ -1758,26 +1900,26 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 		if (oh.error == -ENOSYS)
 			fc->no_interrupt = 1;
 		else if (oh.error == -EAGAIN)
-			queue_interrupt(fc, req);
+			queue_interrupt(fc, q, req);
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&q->lock);
 		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
 	req->state = FUSE_REQ_WRITING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &q->io);
 	req->out.h = oh;
 	req->locked = 1;
 	cs->req = req;
 	if (!req->out.page_replace)
 		cs->move_pages = 0;
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	fuse_copy_finish(cs);
 
-	spin_lock(&fc->lock);
+	spin_lock(&q->lock);
 	req->locked = 0;
 	if (!err) {
 		if (req->aborted)
@@ -1789,7 +1931,7 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	return err ? err : nbytes;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
  err_finish:
 	fuse_copy_finish(cs);
 	return err;
@@ -1889,18 +2031,22 @@ out:
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_conn *fc;
+	if (!fud)
 		return POLLERR;
 
+	fc = fud->fc;
 	poll_wait(file, &fc->waitq, wait);
+	if (fud->queue)
+		poll_wait(file, &fud->queue->waitq, wait);
 
-	spin_lock(&fc->lock);
+	/* Pairs with the barrier in wake_reader() */
+	smp_mb();
 	if (!fc->connected)
 		mask = POLLERR;
 	else if (request_pending(fc))
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fc->lock);
 
 	return mask;
 }
@@ -1908,18 +2054,19 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 /*
  * Abort all requests on the given list (pending or processing)
  *
- * This function releases and reacquires fc->lock
+ * This function releases and reacquires q->lock
  */
-static void end_requests(struct fuse_conn *fc, struct list_head *head)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_requests(struct fuse_conn *fc, struct fuse_queue *q,
+			 struct list_head *head)
+__releases(q->lock)
+__acquires(q->lock)
 {
 	while (!list_empty(head)) {
 		struct fuse_req *req;
 		req = list_entry(head->next, struct fuse_req, list);
 		req->out.h.error = -ECONNABORTED;
 		request_end(fc, req);
-		spin_lock(&fc->lock);
+		spin_lock(&q->lock);
 	}
 }
 
@@ -1934,13 +2081,13 @@ __acquires(fc->lock)
  * called after waiting for the request to be unlocked (if it was
  * locked).
  */
-static void end_io_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_io_requests(struct fuse_conn *fc, struct fuse_queue *q)
+__releases(q->lock)
+__acquires(q->lock)
 {
-	while (!list_empty(&fc->io)) {
+	while (!list_empty(&q->io)) {
 		struct fuse_req *req =
-			list_entry(fc->io.next, struct fuse_req, list);
+			list_entry(q->io.next, struct fuse_req, list);
 		void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 
 		req->aborted = 1;
@@ -1951,25 +2098,38 @@ __acquires(fc->lock)
 		if (end) {
 			req->end = NULL;
 			__fuse_get_request(req);
-			spin_unlock(&fc->lock);
+			spin_unlock(&q->lock);
 			wait_event(req->waitq, !req->locked);
 			end(fc, req);
 			fuse_put_request(fc, req);
-			spin_lock(&fc->lock);
+			spin_lock(&q->lock);
 		}
 	}
 }
 
+/*
+ * Called with fc->connected cleared, so no new requests are queued
+ * and none of the queued ones progress to the io list
+ */
 static void end_queued_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
 {
+	int cpu;
+
+	spin_lock(&fc->lock);
 	fc->max_background = UINT_MAX;
 	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
-	end_requests(fc, &fc->processing);
 	while (forget_pending(fc))
 		kfree(dequeue_forget(fc, 1, NULL));
+	spin_unlock(&fc->lock);
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_queue *q = per_cpu_ptr(fc->queues, cpu);
+
+		spin_lock(&q->lock);
+		end_requests(fc, q, &q->pending);
+		end_requests(fc, q, &q->processing);
+		spin_unlock(&q->lock);
+	}
 }
 
 static void end_polls(struct fuse_conn *fc)
@@ -2001,6 +2161,8 @@ static void end_polls(struct fuse_conn *fc)
  * During the aborting, progression of requests from the pending and
  * processing lists onto the io list, and progression of new requests
  * onto the pending list is prevented by req->connected being false.
+ * It is checked under the lock of the queue, which is taken after
+ * clearing it.
  *
  * Progression of requests under I/O to the processing list is
  * prevented by the req->aborted flag being true for these requests.
@@ -2008,39 +2170,119 @@ static void end_polls(struct fuse_conn *fc)
  */
 void fuse_abort_conn(struct fuse_conn *fc)
 {
+	int cpu;
+
 	spin_lock(&fc->lock);
-	if (fc->connected) {
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_io_requests(fc);
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->waitq);
-		wake_up_all(&fc->blocked_waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	if (!fc->connected) {
+		spin_unlock(&fc->lock);
+		return;
 	}
+	fc->connected = 0;
+	fc->blocked = 0;
+	end_polls(fc);
 	spin_unlock(&fc->lock);
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_queue *q = per_cpu_ptr(fc->queues, cpu);
+
+		spin_lock(&q->lock);
+		end_io_requests(fc, q);
+		spin_unlock(&q->lock);
+	}
+	end_queued_requests(fc);
+	wake_up_all(&fc->waitq);
+	wake_up_all(&fc->blocked_waitq);
+	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc)
+{
+	struct fuse_dev *fud = kzalloc(sizeof(*fud), GFP_KERNEL);
+
+	if (fud) {
+		fud->fc = fc;
+		atomic_inc(&fc->dev_count);
+	}
+	return fud;
+}
+EXPORT_SYMBOL_GPL(fuse_dev_alloc);
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
-		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->blocked_waitq);
-		spin_unlock(&fc->lock);
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (fud) {
+		struct fuse_conn *fc = fud->fc;
+
+		/* The connection ends with the last device attached to it */
+		if (atomic_dec_and_test(&fc->dev_count)) {
+			spin_lock(&fc->lock);
+			fc->connected = 0;
+			fc->blocked = 0;
+			end_polls(fc);
+			spin_unlock(&fc->lock);
+			end_queued_requests(fc);
+			wake_up_all(&fc->blocked_waitq);
+		}
 		fuse_conn_put(fc);
+		kfree(fud);
 	}
 
 	return 0;
 }
 EXPORT_SYMBOL_GPL(fuse_dev_release);
 
+/*
+ * Attach a new device to the connection of an existing one.  The new
+ * device reads from the queue of the CPU the caller runs on first, so
+ * a daemon thread bound to a CPU gets the requests submitted there.
+ */
+static long fuse_dev_clone(struct file *file, int oldfd)
+{
+	struct fuse_dev *fud;
+	struct file *old;
+	int err = -EINVAL;
+
+	old = fget(oldfd);
+	if (!old)
+		return -EINVAL;
+
+	mutex_lock(&fuse_mutex);
+	if (old->f_op == file->f_op && old->private_data &&
+	    !file->private_data) {
+		struct fuse_conn *fc = fuse_get_conn(old);
+
+		err = -ENOMEM;
+		fud = fuse_dev_alloc(fuse_conn_get(fc));
+		if (fud) {
+			fud->queue = fuse_local_queue(fc);
+			file->private_data = fud;
+			err = 0;
+		} else
+			fuse_conn_put(fc);
+	}
+	mutex_unlock(&fuse_mutex);
+	fput(old);
+
+	return err;
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	u32 oldfd;
+
+	switch (cmd) {
+	case FUSE_DEV_IOC_CLONE:
+		if (get_user(oldfd, (u32 __user *) arg))
+			return -EFAULT;
+		return fuse_dev_clone(file, oldfd);
+
+	default:
+		return -ENOTTY;
+	}
+}
+
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
 	struct fuse_conn *fc = fuse_get_conn(file);
@@ -2063,6 +2305,8 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+	.compat_ioctl	= fuse_dev_ioctl,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
@@ -200,6 +200,8 @@ struct fuse_out {
 	struct fuse_arg args[3];
 };
 
+struct fuse_queue;
+
 /** The request state */
 enum fuse_req_state {
 	FUSE_REQ_INIT = 0,
@@ -215,7 +217,7 @@ enum fuse_req_state {
  */
 struct fuse_req {
 	/** This can be on either pending processing or io lists in
-	    fuse_conn */
+	    the queue */
 	struct list_head list;
 
 	/** Entry on the interrupts list  */
@@ -227,10 +229,13 @@ struct fuse_req {
 	/** Unique ID for the interrupt request */
 	u64 intr_unique;
 
+	/** The queue the request is on, set once when it is queued */
+	struct fuse_queue *queue;
+
 	/*
 	 * The following bitfields are either set once before the
 	 * request is queued or setting/clearing them is protected by
-	 * fuse_conn->lock
+	 * the lock of the queue
 	 */
 
 	/** True if the request has reply */
@@ -315,6 +320,52 @@ struct fuse_req {
 	struct file *stolen_file;
 };
 
+/**
+ * A queue of requests to userspace.
+ *
+ * There is one per CPU.  A request is queued on the queue of the CPU
+ * submitting it, and stays on it until it is finished.  Readers bound
+ * to a queue take requests from it first, and from the other queues
+ * when it is empty.
+ */
+struct fuse_queue {
+	/** Lock protecting the lists and the requests on them */
+	spinlock_t lock;
+
+	/** Index of the queue, kept in the unique ID of its requests */
+	unsigned index;
+
+	/** The next unique request id */
+	u64 reqctr;
+
+	/** Readers bound to the queue are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** The list of requests being processed */
+	struct list_head processing;
+
+	/** The list of requests under I/O */
+	struct list_head io;
+
+	/** Pending interrupts */
+	struct list_head interrupts;
+};
+
+/**
+ * An open /dev/fuse file attached to a connection.
+ */
+struct fuse_dev {
+	/** The connection */
+	struct fuse_conn *fc;
+
+	/** Queue this device reads from first, or NULL for the queue of
+	    the reading CPU */
+	struct fuse_queue *queue;
+};
+
 /**
  * A Fuse connection.
  *
@@ -350,14 +401,14 @@ struct fuse_conn {
 	/** Readers of the connection are waiting on this */
 	wait_queue_head_t waitq;
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Per-CPU queues of requests */
+	struct fuse_queue __percpu *queues;
 
-	/** The list of requests being processed */
-	struct list_head processing;
+	/** Number of low bits of a unique ID holding the queue index */
+	unsigned queue_shift;
 
-	/** The list of requests under I/O */
-	struct list_head io;
+	/** Number of devices attached to the connection */
+	atomic_t dev_count;
 
 	/** The next unique kernel file handle */
 	u64 khctr;
@@ -380,9 +431,6 @@ struct fuse_conn {
 	/** The list of background requests set aside for later queuing */
 	struct list_head bg_queue;
 
-	/** Pending interrupts */
-	struct list_head interrupts;
-
 	/** Queue of pending forgets */
 	struct fuse_forget_link forget_list_head;
 	struct fuse_forget_link *forget_list_tail;
@@ -401,7 +449,7 @@ struct fuse_conn {
 	/** waitq for reserved requests */
 	wait_queue_head_t reserved_req_waitq;
 
-	/** The next unique request id */
+	/** The next unique id for requests not on a queue (FORGET) */
 	u64 reqctr;
 
 	/** Connection established, cleared on umount, connection
@@ -716,7 +764,7 @@ void fuse_conn_kill(struct fuse_conn *fc);
 /**
  * Initialize fuse_conn
  */
-void fuse_conn_init(struct fuse_conn *fc);
+int fuse_conn_init(struct fuse_conn *fc);
 
 /**
  * Release reference to fuse_conn
@@ -785,6 +833,11 @@ long fuse_ioctl_common(struct file *file, unsigned int cmd,
 unsigned fuse_file_poll(struct file *file, poll_table *wait);
 int fuse_dev_release(struct inode *inode, struct file *file);
 
+/**
+ * Allocate a device for a connection, taking over a reference to it
+ */
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
+
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
 #endif /* _FS_FUSE_I_H */
@@ -20,6 +20,8 @@
 #include <linux/random.h>
 #include <linux/sched.h>
 #include <linux/exportfs.h>
+#include <linux/percpu.h>
+#include <linux/log2.h>
 
 MODULE_AUTHOR("Miklos Szeredi <miklos@szeredi.hu>");
 MODULE_DESCRIPTION("Filesystem in Userspace");
@@ -553,9 +555,29 @@ static int fuse_show_options(struct seq_file *m, struct dentry *root)
 	return 0;
 }
 
-void fuse_conn_init(struct fuse_conn *fc)
+int fuse_conn_init(struct fuse_conn *fc)
 {
+	int cpu;
+
 	memset(fc, 0, sizeof(*fc));
+	fc->queues = alloc_percpu(struct fuse_queue);
+	if (!fc->queues)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_queue *q = per_cpu_ptr(fc->queues, cpu);
+
+		spin_lock_init(&q->lock);
+		q->index = cpu;
+		init_waitqueue_head(&q->waitq);
+		INIT_LIST_HEAD(&q->pending);
+		INIT_LIST_HEAD(&q->processing);
+		INIT_LIST_HEAD(&q->io);
+		INIT_LIST_HEAD(&q->interrupts);
+	}
+	/* Queue indexes and nr_cpu_ids for requests not on a queue */
+	fc->queue_shift = ilog2(nr_cpu_ids) + 1;
+	atomic_set(&fc->dev_count, 0);
 	spin_lock_init(&fc->lock);
 	mutex_init(&fc->inst_mutex);
 	init_rwsem(&fc->killsb);
@@ -563,10 +585,6 @@ void fuse_conn_init(struct fuse_conn *fc)
 	init_waitqueue_head(&fc->waitq);
 	init_waitqueue_head(&fc->blocked_waitq);
 	init_waitqueue_head(&fc->reserved_req_waitq);
-	INIT_LIST_HEAD(&fc->pending);
-	INIT_LIST_HEAD(&fc->processing);
-	INIT_LIST_HEAD(&fc->io);
-	INIT_LIST_HEAD(&fc->interrupts);
 	INIT_LIST_HEAD(&fc->bg_queue);
 	INIT_LIST_HEAD(&fc->entry);
 	fc->forget_list_tail = &fc->forget_list_head;
@@ -579,6 +597,8 @@ void fuse_conn_init(struct fuse_conn *fc)
 	fc->blocked = 1;
 	fc->attr_version = 1;
 	get_random_bytes(&fc->scramble_key, sizeof(fc->scramble_key));
+
+	return 0;
 }
 EXPORT_SYMBOL_GPL(fuse_conn_init);
 
@@ -588,6 +608,7 @@ void fuse_conn_put(struct fuse_conn *fc)
 		if (fc->destroy_req)
 			fuse_request_free(fc->destroy_req);
 		mutex_destroy(&fc->inst_mutex);
+		free_percpu(fc->queues);
 		fc->release(fc);
 	}
 }
@@ -951,6 +972,7 @@ static int fuse_bdi_init(struct fuse_conn *fc, struct super_block *sb)
 static int fuse_fill_super(struct super_block *sb, void *data, int silent)
 {
 	struct fuse_conn *fc;
+	struct fuse_dev *fud;
 	struct inode *root;
 	struct fuse_mount_data d;
 	struct file *file;
@@ -997,7 +1019,11 @@ static int fuse_fill_super(struct super_block *sb, void *data, int silent)
 	if (!fc)
 		goto err_fput;
 
-	fuse_conn_init(fc);
+	err = fuse_conn_init(fc);
+	if (err) {
+		kfree(fc);
+		goto err_fput;
+	}
 
 	fc->dev = sb->s_dev;
 	fc->sb = sb;
@@ -1044,14 +1070,24 @@ static int fuse_fill_super(struct super_block *sb, void *data, int silent)
 	if (file->private_data)
 		goto err_unlock;
 
+	err = -ENOMEM;
+	fud = fuse_dev_alloc(fuse_conn_get(fc));
+	if (!fud) {
+		fuse_conn_put(fc);
+		goto err_unlock;
+	}
+
 	err = fuse_ctl_add_conn(fc);
-	if (err)
+	if (err) {
+		fuse_conn_put(fc);
+		kfree(fud);
 		goto err_unlock;
+	}
 
 	list_add_tail(&fc->entry, &fuse_conn_list);
 	sb->s_root = root_dentry;
 	fc->connected = 1;
-	file->private_data = fuse_conn_get(fc);
+	file->private_data = fud;
 	mutex_unlock(&fuse_mutex);
 	/*
 	 * atomic_dec_and_test() in fput() provides the necessary
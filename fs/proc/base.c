@@ -343,6 +343,50 @@ static int proc_pid_schedstat(struct task_struct *task, char *buffer)
 }
 #endif
 
+#ifdef CONFIG_FAIRAMP
+/*
+ * Provides /proc/PID/fairamp
+ *
+ * fast_exec slow_exec insts_fast insts_slow fast_round slow_round lagged
+ * home_node remote_exec insts_remote
+ * The format is documented in Documentation/filesystems/proc.txt. Only
+ * append new fields, never reorder or drop them. Fields that are not
+ * configured read as 0 (home_node as -1). lagged is fairamp_round_lag(),
+ * the value taskstats reports as fairamp_lagged.
+ */
+static int proc_pid_fairamp(struct task_struct *task, char *buffer)
+{
+	unsigned long long insts_fast = 0, insts_slow = 0;
+	unsigned long long fast_round = 0, slow_round = 0;
+	unsigned long long remote_exec = 0, insts_remote = 0;
+	long long lagged = 0;
+	int home_node = -1;
+
+#ifdef CONFIG_FAIRAMP_MEASURING_IPS
+	insts_fast = atomic64_read(&task->insts_fast);
+	insts_slow = atomic64_read(&task->insts_slow);
+#endif
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+	fast_round = task->se.fast_round;
+	slow_round = task->se.slow_round;
+	lagged = fairamp_round_lag(&task->se);
+#endif
+#ifdef CONFIG_FAIRAMP_NUMA
+	home_node = fairamp_home_node(task);
+	remote_exec = task->fairamp_remote_exec_runtime;
+#ifdef CONFIG_FAIRAMP_MEASURING_IPS
+	insts_remote = atomic64_read(&task->insts_remote);
+#endif
+#endif
+	return sprintf(buffer, "%llu %llu %llu %llu %llu %llu %lld %d %llu %llu\n",
+			(unsigned long long)task->se.sum_fast_exec_runtime,
+			(unsigned long long)task->se.sum_slow_exec_runtime,
+			insts_fast, insts_slow,
+			fast_round, slow_round, lagged,
+			home_node, remote_exec, insts_remote);
+}
+#endif
+
 #ifdef CONFIG_LATENCYTOP
 static int lstats_show_proc(struct seq_file *m, void *v)
 {
@@ -2696,6 +2740,9 @@ static const struct pid_entry tgid_base_stuff[] = {
 #ifdef CONFIG_SCHEDSTATS
 	INF("schedstat",  S_IRUGO, proc_pid_schedstat),
 #endif
+#ifdef CONFIG_FAIRAMP
+	INF("fairamp",    S_IRUGO, proc_pid_fairamp),
+#endif
 #ifdef CONFIG_LATENCYTOP
 	REG("latency",  S_IRUGO, proc_lstats_operations),
 #endif
@@ -3063,6 +3110,9 @@ static const struct pid_entry tid_base_stuff[] = {
 #ifdef CONFIG_SCHEDSTATS
 	INF("schedstat", S_IRUGO, proc_pid_schedstat),
 #endif
+#ifdef CONFIG_FAIRAMP
+	INF("fairamp",   S_IRUGO, proc_pid_fairamp),
+#endif
 #ifdef CONFIG_LATENCYTOP
 	REG("latency",  S_IRUGO, proc_lstats_operations),
 #endif
@@ -187,6 +187,7 @@ struct kioctx {
 	/* This needs improving */
 	unsigned long		user_id;
 	struct hlist_node	list;
+	unsigned		id;	/* index in mm->ioctx_table */
 
 	wait_queue_head_t	wait;
 
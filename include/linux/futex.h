@@ -64,4 +64,17 @@ static inline void exit_pi_state_list(struct task_struct *curr)
 {
 }
 #endif
+
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+extern int sysctl_futex_private_hash_bits;
+extern void futex_mm_private_hash(struct mm_struct *mm);
+extern void futex_mm_free(struct mm_struct *mm);
+#else
+static inline void futex_mm_private_hash(struct mm_struct *mm)
+{
+}
+static inline void futex_mm_free(struct mm_struct *mm)
+{
+}
+#endif
 #endif
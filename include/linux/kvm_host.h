@@ -203,6 +203,12 @@ struct kvm_vcpu {
 	int sigset_active;
 	sigset_t sigset;
 	struct kvm_vcpu_stat stat;
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+	int fairamp_gen; /* kvm->fairamp_gen applied to the vcpu thread */
+	bool fairamp_managed; /* the round slices below are applied */
+	u32 fairamp_fast_slice, fairamp_slow_slice;
+	u32 fairamp_saved_fast, fairamp_saved_slow; /* of the host, to give back */
+#endif
 
 #ifdef CONFIG_HAS_IOMEM
 	int mmio_needed;
@@ -326,6 +332,10 @@ struct kvm {
 	struct kvm_vcpu *vcpus[KVM_MAX_VCPUS];
 	atomic_t online_vcpus;
 	int last_boosted_vcpu;
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+	int fairamp_fast_share; /* percent of a fast core for all vcpus, 0: unmanaged */
+	atomic_t fairamp_gen;   /* bumped when the round slices of the vcpus change */
+#endif
 	struct list_head vm_list;
 	struct mutex lock;
 	struct kvm_io_bus *buses[KVM_NR_BUSES];
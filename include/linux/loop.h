@@ -55,7 +55,10 @@ struct loop_device {
 	struct bio_list		lo_bio_list;
 	int			lo_state;
 	struct mutex		lo_ctl_mutex;
-	struct task_struct	*lo_thread;
+	struct task_struct	**lo_threads;
+	int			lo_nr_threads;
+	int			lo_active;	/* bios being handled */
+	bool			lo_barrier;	/* a switch is running */
 	wait_queue_head_t	lo_event;
 
 	struct request_queue	*lo_queue;
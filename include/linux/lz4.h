@@ -0,0 +1,57 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+/*
+ * LZ4 Kernel Interface
+ *
+ * LZ4 is an LZ77 type compressor with a fixed, byte oriented encoding.
+ * It compresses about as well as LZO and decompresses several times
+ * faster.  LZ4HC writes the same format, spending much more time on
+ * finding matches; the result decompresses just as fast.
+ *
+ * The format is described at http://code.google.com/p/lz4/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define LZ4_HASH_LOG		12
+#define LZ4HC_HASH_LOG		15
+#define LZ4HC_CHAIN_SIZE	(1 << 16)
+
+#define LZ4_MEM_COMPRESS	((1 << LZ4_HASH_LOG) * sizeof(u32))
+#define LZ4HC_MEM_COMPRESS	((1 << LZ4HC_HASH_LOG) * sizeof(u32) + \
+				 LZ4HC_CHAIN_SIZE * sizeof(u16))
+
+/* Output of the compressors never exceeds this */
+#define lz4_compressbound(x)	((x) + ((x) / 255) + 16)
+
+/*
+ * Both compressors take the size of @dst in *@dst_len and return the
+ * compressed size there.  They fail with LZ4_E_OUTPUT_OVERRUN if the
+ * data does not fit, which can only happen when *@dst_len is less than
+ * lz4_compressbound(@src_len).
+ */
+
+/* This requires 'wrkmem' of size LZ4_MEM_COMPRESS */
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/* This requires 'wrkmem' of size LZ4HC_MEM_COMPRESS */
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/* safe decompression with overrun testing */
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len);
+
+/*
+ * Return values (< 0 = Error)
+ */
+#define LZ4_E_OK			0
+#define LZ4_E_ERROR			(-1)
+#define LZ4_E_INPUT_OVERRUN		(-4)
+#define LZ4_E_OUTPUT_OVERRUN		(-5)
+#define LZ4_E_LOOKBEHIND_OVERRUN	(-6)
+
+#endif
@@ -21,6 +21,8 @@
 #define AT_VECTOR_SIZE (2*(AT_VECTOR_SIZE_ARCH + AT_VECTOR_SIZE_BASE + 1))
 
 struct address_space;
+struct futex_hash_bucket;
+struct kioctx_table;
 
 #define USE_SPLIT_PTLOCKS	(NR_CPUS >= CONFIG_SPLIT_PTLOCK_CPUS)
 
@@ -372,6 +374,12 @@ struct mm_struct {
 #ifdef CONFIG_AIO
 	spinlock_t		ioctx_lock;
 	struct hlist_head	ioctx_list;
+	struct kioctx_table __rcu *ioctx_table;
+#endif
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+	/* hash of the PRIVATE futexes, NULL if they use the global one */
+	struct futex_hash_bucket *futex_hash;
+	unsigned int		futex_hash_bits;
 #endif
 #ifdef CONFIG_MM_OWNER
 	/*
@@ -395,6 +403,10 @@ struct mm_struct {
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	pgtable_t pmd_huge_pte; /* protected by page_table_lock */
 #endif
+#ifdef CONFIG_FAIRAMP_NUMA
+	int fairamp_numa_node; /* node FAIRAMP last moved the pages to, -1 if none */
+	unsigned long fairamp_numa_migrate_stamp; /* jiffies of that move */
+#endif
 #ifdef CONFIG_CPUMASK_OFFSTACK
 	struct cpumask cpumask_allocation;
 #endif
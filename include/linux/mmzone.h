@@ -540,6 +540,9 @@ static inline int zone_is_oom_locked(const struct zone *zone)
  */
 #define DEF_PRIORITY 12
 
+/* Upper limit of the kswapd threads per node, vm.kswapd_threads */
+#define MAX_KSWAPD_THREADS 16
+
 /* Maximum number of zones on a zonelist */
 #define MAX_ZONES_PER_ZONELIST (MAX_NUMNODES * MAX_NR_ZONES)
 
@@ -717,6 +720,16 @@ typedef struct pglist_data {
 	struct task_struct *kswapd;	/* Protected by lock_memory_hotplug() */
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+	/*
+	 * Helpers reclaim alongside kswapd while it balances the node, at
+	 * the order and classzone it published for the balance_seq run.
+	 */
+	struct task_struct *kswapd_helpers[MAX_KSWAPD_THREADS - 1]; /* ditto */
+	wait_queue_head_t kswapd_helper_wait;
+	unsigned long kswapd_balance_seq;
+	int kswapd_balance_order;
+	enum zone_type kswapd_balance_classzone_idx;
+	bool kswapd_balancing;
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
@@ -1152,6 +1152,11 @@ struct sched_entity {
 	u64			fast_round; /* (fast_vruntime / unit_fast_vruntime) */
 	u64			slow_round; /* (slow_vruntime / slow_vruntime) */
 	int			lagged;     /* basically, fast_round - slow_round. If only one of unit_vruntime == 0, INT_MAX or INT_MIN */
+	u64			lagged_sleep_start; /* rq clock when the task went to sleep, to decay @lagged on wakeup */
+	s64			round_offset; /* lag forgiven on wakeup or re-initialization, the rounds themselves only grow */
+#ifdef CONFIG_FAIRAMP_LOCK_BOOST
+	u64			lock_boost_expires; /* rq clock until which the lock holder is boosted, 0 if not boosted */
+#endif
 #endif
 
 	u64			sum_fast_exec_runtime_mprev; /* for measuring IPS, or just for statistics */
@@ -1249,6 +1254,23 @@ struct task_struct {
 	atomic_t insts_fast_ovf;
 	atomic64_t insts_slow;
 	atomic_t insts_slow_ovf;
+	u64 insts_fast_mprev; /* for measuring IPS */
+	u64 insts_slow_mprev; /* for measuring IPS */
+#endif
+
+#ifdef CONFIG_FAIRAMP_NUMA
+	int fairamp_home_node;   /* node of the recent page faults, -1 if unknown */
+	int fairamp_home_faults; /* votes for fairamp_home_node */
+	u64 fairamp_remote_exec_runtime; /* run time away from fairamp_home_node */
+#ifdef CONFIG_FAIRAMP_MEASURING_IPS
+	atomic64_t insts_remote; /* instructions away from fairamp_home_node */
+#endif
+	int fairamp_numa_work_node; /* target node of fairamp_numa_work, -1 if not queued */
+	unsigned long fairamp_numa_migrate_stamp; /* jiffies of the last page migration */
+	struct callback_head fairamp_numa_work;
+#endif
+#ifdef CONFIG_FAIRAMP_FORK_PLACE
+	struct fairamp_credit *fairamp_credit; /* credit pool of the process tree */
 #endif
 
 	unsigned int policy;
@@ -2068,6 +2090,92 @@ static inline void sched_autogroup_exit(struct signal_struct *sig) { }
 extern unsigned int sysctl_sched_cfs_bandwidth_slice;
 #endif
 
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+#define FAIRAMP_MAX_LAGGED 0xFF /* bound of rq->max_lagged and the tunables in rounds */
+
+/*
+ * Fast rounds owed (negative) or slow rounds owed (positive) by a task.
+ * fast_round and slow_round count the rounds completed so far and are
+ * exported as such, so the lag forgiven later is kept apart from them.
+ */
+static inline s64 fairamp_round_lag(struct sched_entity *se)
+{
+	return (s64)(se->fast_round - se->slow_round) - se->round_offset;
+}
+
+extern void fairamp_set_task_unit_vruntime(struct task_struct *p,
+		u32 unit_fast_vruntime, u32 unit_slow_vruntime);
+extern void fairamp_spin_yield(void);
+#else
+static inline void fairamp_spin_yield(void) { }
+#endif
+
+#ifdef CONFIG_FAIRAMP_SMT
+extern unsigned int sysctl_sched_fairamp_smt_share;
+extern unsigned int sysctl_sched_fairamp_smt_spread;
+#endif
+
+#ifdef CONFIG_FAIRAMP_NUMA
+extern unsigned int sysctl_sched_fairamp_numa_penalty;
+extern unsigned int sysctl_sched_fairamp_numa_migrate;
+
+#define FAIRAMP_HOME_FAULTS_MAX 64
+
+/*
+ * Majority vote over the recent page faults of current: a fault on the
+ * home node adds a vote, a fault elsewhere takes one, and the node of the
+ * fault becomes the home node when no vote is left.
+ */
+static inline void fairamp_account_fault(int nid)
+{
+	struct task_struct *p = current;
+
+	if (p->fairamp_home_node == nid) {
+		if (p->fairamp_home_faults < FAIRAMP_HOME_FAULTS_MAX)
+			p->fairamp_home_faults++;
+	} else if (p->fairamp_home_faults > 0) {
+		p->fairamp_home_faults--;
+	} else {
+		p->fairamp_home_node = nid;
+		p->fairamp_home_faults = 1;
+	}
+}
+
+static inline int fairamp_home_node(struct task_struct *p)
+{
+	return p->fairamp_home_faults ? p->fairamp_home_node : -1;
+}
+#else
+static inline void fairamp_account_fault(int nid) { }
+#endif
+
+#ifdef CONFIG_FAIRAMP_FORK_PLACE
+/*
+ * Fast/slow rounds left behind by the dead members of a process tree.
+ * Positive: the tree got more fast rounds than slow ones (a debt).
+ */
+struct fairamp_credit {
+	atomic_t count;
+	atomic_t lagged;
+};
+
+extern unsigned int sysctl_sched_fairamp_fork_lag;
+extern void fairamp_fork_credit(struct task_struct *p);
+extern void fairamp_put_credit(struct task_struct *p);
+#else
+static inline void fairamp_fork_credit(struct task_struct *p) { }
+static inline void fairamp_put_credit(struct task_struct *p) { }
+#endif
+
+#ifdef CONFIG_FAIRAMP_LOCK_BOOST
+extern unsigned int sysctl_sched_fairamp_lock_boost;
+extern void fairamp_lock_boost(struct task_struct *owner);
+extern void fairamp_lock_unboost(void);
+#else
+static inline void fairamp_lock_boost(struct task_struct *owner) { }
+static inline void fairamp_lock_unboost(void) { }
+#endif
+
 #ifdef CONFIG_RT_MUTEXES
 extern int rt_mutex_getprio(struct task_struct *p);
 extern void rt_mutex_setprio(struct task_struct *p, int prio);
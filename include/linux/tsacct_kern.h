@@ -33,6 +33,16 @@ static inline void acct_clear_integrals(struct task_struct *tsk)
 {}
 #endif /* CONFIG_TASK_XACCT */
 
+#if defined(CONFIG_TASKSTATS) && defined(CONFIG_FAIRAMP)
+extern void fairamp_add_tsk(struct taskstats *stats, struct task_struct *p);
+extern void fairamp_lag_tsk(struct taskstats *stats, struct task_struct *p);
+#else
+static inline void fairamp_add_tsk(struct taskstats *stats, struct task_struct *p)
+{}
+static inline void fairamp_lag_tsk(struct taskstats *stats, struct task_struct *p)
+{}
+#endif
+
 #endif
 
 
@@ -20,12 +20,21 @@
 
 /* Flags for epoll_create1.  */
 #define EPOLL_CLOEXEC O_CLOEXEC
+/* Keep ready events on per-cpu lists, merged when epoll_wait() collects them */
+#define EPOLL_PERCPU 0x00000001
 
 /* Valid opcodes to issue to sys_epoll_ctl() */
 #define EPOLL_CTL_ADD 1
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
 
+/*
+ * Wake up only one of the epoll instances waiting on the target file when it
+ * becomes ready, instead of all of them. Only valid with EPOLL_CTL_ADD, and
+ * not on epoll file descriptors.
+ */
+#define EPOLLEXCLUSIVE (1 << 28)
+
 /*
  * Request the handling of system wakeup events so as to prevent system suspends
  * from happening while those events are being processed.
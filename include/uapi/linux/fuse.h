@@ -66,6 +66,7 @@
 #define _LINUX_FUSE_H
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /*
  * Version negotiation:
@@ -674,4 +675,16 @@ struct fuse_notify_retrieve_in {
 	__u64	dummy4;
 };
 
+/*
+ * Device ioctls
+ *
+ * FUSE_DEV_IOC_CLONE attaches a newly opened /dev/fuse to the
+ * connection of the device whose fd is passed in.  Requests submitted
+ * on a CPU are queued for that CPU, and the clone reads the queue of
+ * the CPU it was cloned on first, so a daemon thread bound to a CPU
+ * should clone its device from there.
+ */
+#define FUSE_DEV_IOC_MAGIC		229
+#define FUSE_DEV_IOC_CLONE		_IOR(FUSE_DEV_IOC_MAGIC, 0, __u32)
+
 #endif /* _LINUX_FUSE_H */
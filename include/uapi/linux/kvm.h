@@ -626,6 +626,7 @@ struct kvm_ppc_smmu_info {
 #define KVM_CAP_READONLY_MEM 81
 #endif
 #define KVM_CAP_IRQFD_RESAMPLE 82
+#define KVM_CAP_FAIRAMP_FAST_SHARE 83
 
 #ifdef KVM_CAP_IRQ_ROUTING
 
@@ -848,6 +849,9 @@ struct kvm_s390_ucas_mapping {
 #define KVM_PPC_GET_SMMU_INFO	  _IOR(KVMIO,  0xa6, struct kvm_ppc_smmu_info)
 /* Available with KVM_CAP_PPC_ALLOC_HTAB */
 #define KVM_PPC_ALLOCATE_HTAB	  _IOWR(KVMIO, 0xa7, __u32)
+/* Available with KVM_CAP_FAIRAMP_FAST_SHARE */
+#define KVM_SET_FAIRAMP_FAST_SHARE _IO(KVMIO,  0xa8)
+#define KVM_GET_FAIRAMP_FAST_SHARE _IO(KVMIO,  0xa9)
 
 /*
  * ioctls for vcpu fds
@@ -21,6 +21,7 @@ enum {
 	LO_FLAGS_READ_ONLY	= 1,
 	LO_FLAGS_AUTOCLEAR	= 4,
 	LO_FLAGS_PARTSCAN	= 8,
+	LO_FLAGS_DROP_CACHE	= 32,
 };
 
 #include <asm/posix_types.h>	/* for __kernel_old_dev_t */
@@ -33,7 +33,7 @@
  */
 
 
-#define TASKSTATS_VERSION	8
+#define TASKSTATS_VERSION	9
 #define TS_COMM_LEN		32	/* should be >= TASK_COMM_LEN
 					 * in linux/sched.h */
 
@@ -163,6 +163,15 @@ struct taskstats {
 	/* Delay waiting for memory reclaim */
 	__u64	freepages_count;
 	__u64	freepages_delay_total;
+
+	/* v9: FAIRAMP fast/slow core accounting */
+	__u64	fairamp_fast_exec_runtime;	/* ns run on fast cores */
+	__u64	fairamp_slow_exec_runtime;	/* ns run on slow cores */
+	__u64	fairamp_insts_fast;		/* instructions retired on fast cores */
+	__u64	fairamp_insts_slow;		/* instructions retired on slow cores */
+	__u64	fairamp_fast_round;		/* completed fast rounds */
+	__u64	fairamp_slow_round;		/* completed slow rounds */
+	__s64	fairamp_lagged;			/* rounds owed, per thread only */
 };
 
 
@@ -213,6 +213,7 @@ void free_task(struct task_struct *tsk)
 #ifdef CONFIG_FAIRAMP
 	dealloc_fairamp_tasks(tsk);
 #endif
+	fairamp_put_credit(tsk);
 	account_kernel_stack(tsk->stack, -1);
 	arch_release_thread_info(tsk->stack);
 	free_thread_info(tsk->stack);
@@ -338,6 +339,9 @@ static struct task_struct *dup_task_struct(struct task_struct *orig)
 #endif
 	tsk->splice_pipe = NULL;
 	tsk->task_frag.page = NULL;
+#ifdef CONFIG_FAIRAMP_FORK_PLACE
+	tsk->fairamp_credit = NULL; /* taken in fairamp_fork_credit() */
+#endif
 
 	account_kernel_stack(ti, 1);
 
@@ -529,6 +533,7 @@ static void mm_init_aio(struct mm_struct *mm)
 #ifdef CONFIG_AIO
 	spin_lock_init(&mm->ioctx_lock);
 	INIT_HLIST_HEAD(&mm->ioctx_list);
+	mm->ioctx_table = NULL;
 #endif
 }
 
@@ -548,6 +553,13 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p)
 	mm->cached_hole_size = ~0UL;
 	mm_init_aio(mm);
 	mm_init_owner(mm, p);
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+	mm->futex_hash = NULL;
+#endif
+#ifdef CONFIG_FAIRAMP_NUMA
+	mm->fairamp_numa_node = -1;
+	mm->fairamp_numa_migrate_stamp = jiffies;
+#endif
 
 	if (likely(!mm_alloc_pgd(mm))) {
 		mm->def_flags = 0;
@@ -603,6 +615,7 @@ void __mmdrop(struct mm_struct *mm)
 	mm_free_pgd(mm);
 	destroy_context(mm);
 	mmu_notifier_mm_destroy(mm);
+	futex_mm_free(mm);
 	check_mm(mm);
 	free_mm(mm);
 }
@@ -890,6 +903,8 @@ static int copy_mm(unsigned long clone_flags, struct task_struct *tsk)
 		return 0;
 
 	if (clone_flags & CLONE_VM) {
+		if (clone_flags & CLONE_THREAD)
+			futex_mm_private_hash(oldmm);
 		atomic_inc(&oldmm->mm_users);
 		mm = oldmm;
 		goto good_mm;
@@ -1294,6 +1309,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 
 	/* Perform scheduler related setup. Assign this task to a CPU. */
 	sched_fork(p);
+	fairamp_fork_credit(p);
 
 	retval = perf_event_init_task(p);
 	if (retval)
@@ -60,6 +60,8 @@
 #include <linux/pid.h>
 #include <linux/nsproxy.h>
 #include <linux/ptrace.h>
+#include <linux/bootmem.h>
+#include <linux/log2.h>
 
 #include <asm/futex.h>
 
@@ -67,8 +69,6 @@
 
 int __read_mostly futex_cmpxchg_enabled;
 
-#define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
-
 /*
  * Futex flags used to encode options to functions and preserve them across
  * restarts.
@@ -146,19 +146,99 @@ static const struct futex_q futex_q_init = {
 struct futex_hash_bucket {
 	spinlock_t lock;
 	struct plist_head chain;
-};
+} ____cacheline_aligned_in_smp;
+
+/*
+ * The global hash is sized at boot from the number of possible cpus and
+ * spread over the NUMA nodes by alloc_large_system_hash().
+ */
+static unsigned long __read_mostly futex_hashsize;
+static struct futex_hash_bucket *futex_queues;
+
+static void futex_hash_init(struct futex_hash_bucket *fhb, unsigned long size)
+{
+	unsigned long i;
+
+	for (i = 0; i < size; i++) {
+		plist_head_init(&fhb[i].chain);
+		spin_lock_init(&fhb[i].lock);
+	}
+}
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+/*
+ * log2 of the number of buckets of the private hash of a multithreaded
+ * process, 0 disables the private hashes.
+ */
+int sysctl_futex_private_hash_bits __read_mostly;
+
+/*
+ * futex_mm_private_hash - give @mm its own hash for PRIVATE futexes
+ *
+ * Called when the first thread is cloned. The caller is the only user of
+ * @mm, so nobody waits on a private futex of @mm in the global hash and
+ * nobody else looks at mm->futex_hash. Failing is fine: the futexes of
+ * @mm just keep going to the global hash.
+ */
+void futex_mm_private_hash(struct mm_struct *mm)
+{
+	unsigned int bits = ACCESS_ONCE(sysctl_futex_private_hash_bits);
+	struct futex_hash_bucket *fhb;
+
+	if (!bits || mm->futex_hash || atomic_read(&mm->mm_users) != 1)
+		return;
+
+	fhb = kmalloc(sizeof(*fhb) << bits, GFP_KERNEL | __GFP_NOWARN);
+	if (!fhb)
+		return;
+	futex_hash_init(fhb, 1UL << bits);
+	mm->futex_hash_bits = bits;
+	mm->futex_hash = fhb;
+}
+
+void futex_mm_free(struct mm_struct *mm)
+{
+	kfree(mm->futex_hash);
+	mm->futex_hash = NULL;
+}
+
+/*
+ * Keys of PRIVATE futexes have neither FUT_OFF_INODE nor FUT_OFF_MMSHARED
+ * set, and only tasks of key->private.mm can build them.
+ */
+static inline struct futex_hash_bucket *
+hash_futex_private(union futex_key *key, u32 hash)
+{
+	struct mm_struct *mm = key->private.mm;
+
+	if (key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED))
+		return NULL;
+	if (!mm->futex_hash)
+		return NULL;
+	return &mm->futex_hash[hash & ((1UL << mm->futex_hash_bits) - 1)];
+}
+#else
+static inline struct futex_hash_bucket *
+hash_futex_private(union futex_key *key, u32 hash)
+{
+	return NULL;
+}
+#endif /* CONFIG_FUTEX_PRIVATE_HASH */
 
 /*
  * We hash on the keys returned from get_futex_key (see below).
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
+	struct futex_hash_bucket *hb;
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+
+	hb = hash_futex_private(key, hash);
+	if (hb)
+		return hb;
+	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
 /*
@@ -2033,6 +2113,13 @@ retry_private:
 		}
 	}
 
+	/*
+	 * pi_state->owner only changes under hb->lock, and the owner
+	 * clears it under hb->lock on exit. Boost it while we hold it:
+	 */
+	if (!trylock && q.pi_state)
+		fairamp_lock_boost(q.pi_state->owner);
+
 	/*
 	 * Only actually queue now that the atomic ops are done:
 	 */
@@ -2176,6 +2263,8 @@ out_unlock:
 	spin_unlock(&hb->lock);
 	put_futex_key(&key);
 
+	/* the lock went to a waiter, give back the boost the waiters gave us */
+	fairamp_lock_unboost();
 out:
 	return ret;
 
@@ -2731,8 +2820,21 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 static int __init futex_init(void)
 {
+	unsigned int futex_shift;
 	u32 curval;
-	int i;
+
+#if CONFIG_BASE_SMALL
+	futex_hashsize = 16;
+#else
+	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+#endif
+
+	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
+					       futex_hashsize, 0,
+					       futex_hashsize < 256 ? HASH_SMALL : 0,
+					       &futex_shift, NULL,
+					       futex_hashsize, futex_hashsize);
+	futex_hashsize = 1UL << futex_shift;
 
 	/*
 	 * This will fail and we want it. Some arch implementations do
@@ -2747,10 +2849,7 @@ static int __init futex_init(void)
 	if (cmpxchg_futex_value_locked(&curval, NULL, 0, 0) == -EFAULT)
 		futex_cmpxchg_enabled = 1;
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+	futex_hash_init(futex_queues, futex_hashsize);
 
 	return 0;
 }
@@ -238,6 +238,14 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 		}
 		__set_task_state(task, state);
 
+#ifdef CONFIG_FAIRAMP_LOCK_BOOST
+		/*
+		 * The owner cannot release the lock without wait_lock,
+		 * so it stays alive while we boost it:
+		 */
+		fairamp_lock_boost(ACCESS_ONCE(lock->owner));
+#endif
+
 		/* didn't get the lock, go to sleep: */
 		spin_unlock_mutex(&lock->wait_lock, flags);
 		schedule_preempt_disabled();
@@ -333,6 +341,9 @@ __mutex_unlock_common_slowpath(atomic_t *lock_count, int nested)
 	}
 
 	spin_unlock_mutex(&lock->wait_lock, flags);
+
+	/* the waiters do not need our critical section on a fast core anymore */
+	fairamp_lock_unboost();
 }
 
 /*
@@ -1610,6 +1610,11 @@ static void __sched_fork(struct task_struct *p)
 	p->se.fast_round			= 0;
 	p->se.slow_round			= 0;
 	p->se.lagged				= 0;
+	p->se.lagged_sleep_start		= 0;
+	p->se.round_offset			= 0;
+#ifdef CONFIG_FAIRAMP_LOCK_BOOST
+	p->se.lock_boost_expires		= 0;
+#endif
 #endif /* CONFIG_FAIRAMP_DO_SCHED */
 	p->se.sum_fast_exec_runtime_mprev	= 0;
 	p->se.sum_slow_exec_runtime_mprev	= 0;
@@ -1633,6 +1638,18 @@ static void __sched_fork(struct task_struct *p)
 	atomic_set(&p->insts_fast_ovf, 0);
 	atomic64_set(&p->insts_slow, 0);
 	atomic_set(&p->insts_slow_ovf, 0);
+	p->insts_fast_mprev = 0;
+	p->insts_slow_mprev = 0;
+#endif
+
+#ifdef CONFIG_FAIRAMP_NUMA
+	/* fairamp_home_node is inherited: the child starts with the pages of the parent */
+	p->fairamp_remote_exec_runtime = 0;
+#ifdef CONFIG_FAIRAMP_MEASURING_IPS
+	atomic64_set(&p->insts_remote, 0);
+#endif
+	p->fairamp_numa_work_node = -1;
+	p->fairamp_numa_migrate_stamp = 0;
 #endif
 }
 
@@ -4384,6 +4401,139 @@ void dealloc_fairamp_tasks(struct task_struct *p)
 	}
 }
 
+#ifdef CONFIG_FAIRAMP_LOCK_BOOST
+/**
+ * fairamp_lock_boost - pull a lock holder on a slow core to a fast core
+ * @owner: the task holding the lock current is about to block on
+ *
+ * Called by the waiters of a contended mutex or PI futex, so that the
+ * critical section is not stretched by the slow core while they wait.
+ * The boost ends when @owner releases a contended lock, or after
+ * sysctl_sched_fairamp_lock_boost usecs. The caller keeps @owner alive.
+ */
+void fairamp_lock_boost(struct task_struct *owner)
+{
+	struct sched_entity *se;
+	unsigned long flags;
+	struct rq *rq;
+
+	if (!owner || owner == current || !sysctl_sched_fairamp_lock_boost)
+		return;
+	/* racy, but a holder on a fast core needs no help anyway */
+	if (cpu_fast(task_cpu(owner)))
+		return;
+	/* racy as well, a task without unit vruntimes has no lag to boost */
+	se = &owner->se;
+	if (!se->unit_fast_vruntime || !se->unit_slow_vruntime)
+		return;
+
+	rq = task_rq_lock(owner, &flags);
+	if (owner->sched_class != &fair_sched_class || rq->is_fast)
+		goto out;
+
+	update_rq_clock(rq);
+	if (!se->lock_boost_expires)
+		fairamp_schedstat_inc(rq, fairamp_lock_boost);
+	se->lock_boost_expires = rq->clock +
+		(u64)sysctl_sched_fairamp_lock_boost * NSEC_PER_USEC;
+	fairamp_update_lagged(rq, owner);
+out:
+	task_rq_unlock(rq, owner, &flags);
+}
+EXPORT_SYMBOL_GPL(fairamp_lock_boost);
+
+/**
+ * fairamp_lock_unboost - end the lock boost of current
+ *
+ * Called when current releases a contended lock. From now on, the fast
+ * core time current got while boosted is paid back on slow cores.
+ */
+void fairamp_lock_unboost(void)
+{
+	struct task_struct *p = current;
+	unsigned long flags;
+	struct rq *rq;
+
+	if (likely(!p->se.lock_boost_expires))
+		return;
+
+	rq = task_rq_lock(p, &flags);
+	if (p->se.lock_boost_expires) {
+		p->se.lock_boost_expires = 0;
+		fairamp_schedstat_inc(rq, fairamp_lock_unboost);
+		fairamp_update_lagged(rq, p);
+	}
+	task_rq_unlock(rq, p, &flags);
+}
+#endif /* CONFIG_FAIRAMP_LOCK_BOOST */
+
+#ifdef CONFIG_FAIRAMP_FORK_PLACE
+/*
+ * fairamp_fork_credit - hand the credit pool of the process tree to a child
+ * @p: the new child, after sched_fork()
+ *
+ * The pool is created by the first fork of a task sharing both types of
+ * cores. The child takes its initial lag from the pool, so the rounds owed
+ * by the short-lived members of the tree survive them.
+ */
+void fairamp_fork_credit(struct task_struct *p)
+{
+	struct sched_entity *se = &p->se;
+	struct fairamp_credit *credit = current->fairamp_credit;
+	int old, lagged, limit = sysctl_sched_fairamp_fork_lag;
+
+	if (!limit || !se->unit_fast_vruntime || !se->unit_slow_vruntime)
+		return;
+
+	if (!credit) {
+		credit = kmalloc(sizeof(*credit), GFP_KERNEL);
+		if (!credit)
+			return;
+		atomic_set(&credit->count, 1);
+		atomic_set(&credit->lagged, 0);
+		current->fairamp_credit = credit;
+	}
+	atomic_inc(&credit->count);
+	p->fairamp_credit = credit;
+
+	do {
+		old = atomic_read(&credit->lagged);
+		lagged = clamp(old, -limit, limit);
+	} while (lagged && atomic_cmpxchg(&credit->lagged, old, old - lagged) != old);
+
+	/* the child is not on any rq yet */
+	se->round_offset = -lagged;
+	se->lagged = lagged;
+}
+
+/*
+ * fairamp_put_credit - return the lag of a dead task to its credit pool
+ * @p: the task being freed
+ */
+void fairamp_put_credit(struct task_struct *p)
+{
+	struct fairamp_credit *credit = p->fairamp_credit;
+	struct sched_entity *se = &p->se;
+	int old, lagged;
+
+	if (!credit)
+		return;
+	p->fairamp_credit = NULL;
+
+	if (se->unit_fast_vruntime && se->unit_slow_vruntime) {
+		lagged = clamp_t(s64, fairamp_round_lag(se),
+				-FAIRAMP_MAX_LAGGED, FAIRAMP_MAX_LAGGED);
+		do {
+			old = atomic_read(&credit->lagged);
+		} while (atomic_cmpxchg(&credit->lagged, old,
+				clamp(old + lagged, -FAIRAMP_MAX_LAGGED, FAIRAMP_MAX_LAGGED)) != old);
+	}
+
+	if (atomic_dec_and_test(&credit->count))
+		kfree(credit);
+}
+#endif /* CONFIG_FAIRAMP_FORK_PLACE */
+
 #ifdef CONFIG_FAIRAMP_DO_SCHED
 struct fairamp_unit_vruntime {
 	int num;
@@ -4392,86 +4542,92 @@ struct fairamp_unit_vruntime {
 	u32 unit_slow_vruntime;
 };
 
-static void 
-__do_set_unit_vruntime(struct task_struct *p, 
+/* adjust @unit_*_vruntime of one thread */
+static void
+__set_task_unit_vruntime(struct task_struct *t,
 					u32 unit_fast_vruntime, u32 unit_slow_vruntime)
 {
-	struct task_struct *t = p;
-	struct sched_entity *se;
+	struct sched_entity *se = &t->se;
 	unsigned long flags;
 	struct rq *rq;
 	int on_rq;
-	struct task_struct *pos;
-	fdbg("[%s] starts pid: %d fast_unit: %d slow_unit: %d\n", __func__, 
-			p->pid, unit_fast_vruntime, unit_slow_vruntime);
 
-	do {
-		se = &t->se;
-		fdbg("[%s] do pid: %d fast_unit: %d slow_unit: %d \n", __func__, 
-				t->pid, unit_fast_vruntime, unit_slow_vruntime);
-
-		/* if already adjusted as you want, return early and prevent the initialization */
-		if (se->lagged < 10 && se->lagged > -10 /* if lagged a lot, re-initialize is needed */
-				&& se->unit_fast_vruntime == unit_fast_vruntime
-				&& se->unit_slow_vruntime == unit_slow_vruntime)
-			goto traverse_next_thread; 
-
-		/* We have to be careful. The task might be in the middle of scheduling on another CPU. */
-		/* Ref: kernel/sched/core.c:set_user_nice() */
-		rq = task_rq_lock(t, &flags);
-
-		on_rq = t->on_rq;
-		if (on_rq)
-			dequeue_task(rq, t, 0);
-
-		/* re-initialization */
-		se->fast_round = 0;
-		se->slow_round = 0;
-
-		/* adjust @unit_*_vruntime */ 
-		se->unit_fast_vruntime = unit_fast_vruntime;
-		se->unit_slow_vruntime = unit_slow_vruntime;
-		
-		/* adjust @lagged */
-		if (unit_fast_vruntime == 0 && unit_slow_vruntime > 0)
-			se->lagged = INT_MAX; /* prevent scheduling on fast cores */
-		else if (unit_fast_vruntime > 0 && unit_slow_vruntime == 0)
-			se->lagged = INT_MIN; /* prevent scheduling on slow cores */
-		else
-			se->lagged = 0; /* even if unit_fast_vruntime == 0 && unit_slow_vruntime == 0
-								since this is the case that the task can be scheduled any cpu freely */
-
-		/* check cpu affinity */
-		if ((t->se.unit_fast_vruntime > 0 &&
-					!cpumask_intersects(&t->cpus_allowed, cpu_fast_mask))
-				 ||
-				 (t->se.unit_slow_vruntime > 0 &&
-					!cpumask_intersectsnot(&t->cpus_allowed, cpu_fast_mask))
-			) {
-			/* task_rq_lock is already acquired.
-				Here, we always widen the cpus_allowed.
-				We do not need to migration the thread */
-			do_set_cpus_allowed(t, cpu_online_mask);
-		}
+	fdbg("[%s] do pid: %d fast_unit: %d slow_unit: %d \n", __func__, 
+			t->pid, unit_fast_vruntime, unit_slow_vruntime);
+
+	/* if already adjusted as you want, return early and prevent the initialization */
+	if (se->lagged < FAIRAMP_REINIT_LAGGED && se->lagged > -FAIRAMP_REINIT_LAGGED /* if lagged a lot, re-initialize is needed */
+			&& se->unit_fast_vruntime == unit_fast_vruntime
+			&& se->unit_slow_vruntime == unit_slow_vruntime)
+		return;
 
-		if (on_rq) {
-			enqueue_task(rq, t, 0);
+	/* We have to be careful. The task might be in the middle of scheduling on another CPU. */
+	/* Ref: kernel/sched/core.c:set_user_nice() */
+	rq = task_rq_lock(t, &flags);
 
-			/* 
-			 * if the task is running and 
-			 * it has not to run on the currently running cpu,
-			 * then rescheduling its CPU
-			 */
-			if (task_running(rq, t)) {
-				if ((se->lagged == INT_MIN && rq->is_fast)
-						|| (se->lagged == INT_MAX && !rq->is_fast))
-					resched_task(rq->curr);
-			}
+	on_rq = t->on_rq;
+	if (on_rq)
+		dequeue_task(rq, t, 0);
+
+	/* re-initialization: forget the lag, keep counting the rounds */
+	se->round_offset = se->fast_round - se->slow_round;
+
+	/* adjust @unit_*_vruntime */ 
+	se->unit_fast_vruntime = unit_fast_vruntime;
+	se->unit_slow_vruntime = unit_slow_vruntime;
+	
+	/* adjust @lagged */
+	if (unit_fast_vruntime == 0 && unit_slow_vruntime > 0)
+		se->lagged = INT_MAX; /* prevent scheduling on fast cores */
+	else if (unit_fast_vruntime > 0 && unit_slow_vruntime == 0)
+		se->lagged = INT_MIN; /* prevent scheduling on slow cores */
+	else
+		se->lagged = 0; /* even if unit_fast_vruntime == 0 && unit_slow_vruntime == 0
+							since this is the case that the task can be scheduled any cpu freely */
+
+	/* check cpu affinity */
+	if ((t->se.unit_fast_vruntime > 0 &&
+				!cpumask_intersects(&t->cpus_allowed, cpu_fast_mask))
+			 ||
+			 (t->se.unit_slow_vruntime > 0 &&
+				!cpumask_intersectsnot(&t->cpus_allowed, cpu_fast_mask))
+		) {
+		/* task_rq_lock is already acquired.
+			Here, we always widen the cpus_allowed.
+			We do not need to migration the thread */
+		do_set_cpus_allowed(t, cpu_online_mask);
+	}
+
+	if (on_rq) {
+		enqueue_task(rq, t, 0);
+
+		/* 
+		 * if the task is running and 
+		 * it has not to run on the currently running cpu,
+		 * then rescheduling its CPU
+		 */
+		if (task_running(rq, t)) {
+			if ((se->lagged == INT_MIN && rq->is_fast)
+					|| (se->lagged == INT_MAX && !rq->is_fast))
+				resched_task(rq->curr);
 		}
+	}
 
-		task_rq_unlock(rq, t, &flags);
+	task_rq_unlock(rq, t, &flags);
+}
+
+static void 
+__do_set_unit_vruntime(struct task_struct *p, 
+					u32 unit_fast_vruntime, u32 unit_slow_vruntime)
+{
+	struct task_struct *t = p;
+	struct task_struct *pos;
+	fdbg("[%s] starts pid: %d fast_unit: %d slow_unit: %d\n", __func__, 
+			p->pid, unit_fast_vruntime, unit_slow_vruntime);
+
+	do {
+		__set_task_unit_vruntime(t, unit_fast_vruntime, unit_slow_vruntime);
 
-traverse_next_thread:
 		if (!list_empty(&t->children)) {
 			/* traverse children */
 			list_for_each_entry_rcu(pos, &t->children, sibling) {
@@ -4484,6 +4640,53 @@ traverse_next_thread:
 	fdbg("[%s] ends\n", __func__);
 }
 
+/**
+ * fairamp_set_task_unit_vruntime - set the fast/slow round slices of a thread
+ * @p: the thread, not its other threads or children unlike SET_UNIT_VRUNTIME
+ * @unit_fast_vruntime: fast round slice, 0 to keep @p off fast cores
+ * @unit_slow_vruntime: slow round slice, 0 to keep @p off slow cores
+ *
+ * For in-kernel users that manage their threads on their own (e.g. KVM vCPUs).
+ */
+void fairamp_set_task_unit_vruntime(struct task_struct *p,
+					u32 unit_fast_vruntime, u32 unit_slow_vruntime)
+{
+	__set_task_unit_vruntime(p, unit_fast_vruntime, unit_slow_vruntime);
+}
+EXPORT_SYMBOL_GPL(fairamp_set_task_unit_vruntime);
+
+/**
+ * fairamp_spin_yield - give up the rest of the fast round of current
+ *
+ * Called when current is known to be busy-waiting, e.g. on a pause-loop
+ * exit of a vCPU. Its fast core time is wasted, so the rest of the fast
+ * round is charged as consumed and current is swapped with a task lagged
+ * on a slow core, hopefully the one current waits for.
+ */
+void fairamp_spin_yield(void)
+{
+	struct task_struct *p = current;
+	struct sched_entity *se = &p->se;
+	unsigned long flags;
+	struct rq *rq;
+
+	if (!se->unit_fast_vruntime || !se->unit_slow_vruntime)
+		return;
+
+	rq = task_rq_lock(p, &flags);
+	/* nothing to give up on a slow core, or already due to leave */
+	if (!rq->is_fast || p->sched_class != &fair_sched_class || se->lagged > 0)
+		goto out;
+
+	se->fast_round++;
+	se->fast_vruntime = 0;
+	fairamp_schedstat_inc(rq, fairamp_spin_yield);
+	fairamp_update_lagged(rq, p);
+out:
+	task_rq_unlock(rq, p, &flags);
+}
+EXPORT_SYMBOL_GPL(fairamp_spin_yield);
+
 /* rcu_read_lock should be held in caller */
 static int _do_set_unit_vruntime(struct fairamp_unit_vruntime *info)
 {
@@ -4568,9 +4771,14 @@ static int __do_get_threads_info_current_only(struct fairamp_threads_info *info)
 			t->se.sum_fast_exec_runtime, t->se.sum_slow_exec_runtime);
 
 #ifdef CONFIG_FAIRAMP_MEASURING_IPS
-	/* no need to lock, since @insts_* are atomic64_t and @sum_*_runtime is only read. */
-	info->insts_fast += atomic64_xchg(&t->insts_fast, 0);
-	info->insts_slow += atomic64_xchg(&t->insts_slow, 0);
+	/* no need to lock, since @insts_* are atomic64_t and only read.
+	   They are cumulative for taskstats and /proc/<pid>/fairamp, so take the delta. */
+	temp = atomic64_read(&t->insts_fast);
+	info->insts_fast += temp - t->insts_fast_mprev;
+	t->insts_fast_mprev = temp;
+	temp = atomic64_read(&t->insts_slow);
+	info->insts_slow += temp - t->insts_slow_mprev;
+	t->insts_slow_mprev = temp;
 #endif
 
 	temp = t->se.sum_fast_exec_runtime;
@@ -4608,9 +4816,14 @@ __do_get_threads_info(struct task_struct *p,
 			 t->se.sum_fast_exec_runtime, t->se.sum_slow_exec_runtime, depth);
 
 #ifdef CONFIG_FAIRAMP_MEASURING_IPS
-		/* no need to lock, since @insts_* are atomic64_t and @sum_*_runtime is only read. */
-		info->insts_fast += atomic64_xchg(&t->insts_fast, 0);
-		info->insts_slow += atomic64_xchg(&t->insts_slow, 0);
+		/* no need to lock, since @insts_* are atomic64_t and only read.
+		   They are cumulative for taskstats and /proc/<pid>/fairamp, so take the delta. */
+		temp = atomic64_read(&t->insts_fast);
+		info->insts_fast += temp - t->insts_fast_mprev;
+		t->insts_fast_mprev = temp;
+		temp = atomic64_read(&t->insts_slow);
+		info->insts_slow += temp - t->insts_slow_mprev;
+		t->insts_slow_mprev = temp;
 #endif
 
 		temp = t->se.sum_fast_exec_runtime;
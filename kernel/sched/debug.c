@@ -371,6 +371,32 @@ do {									\
 	P(fairamp_balance_cpu_stop_succeed);
 	P(fairamp_balance_cpu_stop_already_while_double_locking);
 	P(fairamp_balance_cpu_stop_succeed_to_migrate_that_task);
+
+	/* related to place_entity_fairamp */
+	P(fairamp_sleeper_lag_decayed);
+
+	/* related to fairamp_spin_yield */
+	P(fairamp_spin_yield);
+
+#ifdef CONFIG_FAIRAMP_NUMA
+	/* related to fairamp_numa_move */
+	P(fairamp_numa_cross_node);
+	P(fairamp_numa_to_home);
+	P(fairamp_numa_migrate);
+#endif
+
+#ifdef CONFIG_FAIRAMP_FORK_PLACE
+	/* related to fairamp_fork_cpu */
+	P(fairamp_fork_place_fast);
+	P(fairamp_fork_place_slow);
+#endif
+
+#ifdef CONFIG_FAIRAMP_LOCK_BOOST
+	/* related to fairamp_lock_boost */
+	P(fairamp_lock_boost);
+	P(fairamp_lock_boost_expired);
+	P(fairamp_lock_unboost);
+#endif
 #endif
 
 #ifdef CONFIG_FAIRAMP_FAST_CORE_FIRST
@@ -383,6 +409,9 @@ do {									\
 	P(fairamp_balance_fast_core_balancing_give_up);
 	P(fairamp_balance_fast_core_balancing_try);
 	P(fairamp_balance_fast_core_balancing_succeed);
+#ifdef CONFIG_FAIRAMP_SMT
+	P(fairamp_balance_fast_core_first_smt_give_up);
+#endif
 	
 	/* related to fast_core_first_cpu_stop */
 	P(fairamp_fast_core_first_cpu_stop_called);
@@ -26,17 +26,13 @@
 #include <linux/slab.h>
 #include <linux/profile.h>
 #include <linux/interrupt.h>
+#include <linux/task_work.h>
+#include <linux/mempolicy.h>
 
 #include <trace/events/sched.h>
 
 #include "sched.h"
 
-#ifdef CONFIG_FAIRAMP_STAT
-#define fairamp_schedstat_inc(rq, var) schedstat_inc(rq, var)
-#else
-#define fairamp_schedstat_inc(rq, var) do{}while(0)
-#endif
-
 #ifndef fdbg
 /* refer to pr_devel() in include/linux/printk.h */
 #ifdef CONFIG_FAIRAMP_DEBUG
@@ -125,6 +121,59 @@ unsigned int __read_mostly sysctl_sched_shares_window = 10000000UL;
 unsigned int sysctl_sched_cfs_bandwidth_slice = 5000UL;
 #endif
 
+#ifdef CONFIG_FAIRAMP_LOCK_BOOST
+/*
+ * Upper bound of the fast core boost a lock holder on a slow core gets
+ * from its waiters. The boost normally ends when the holder releases a
+ * contended lock; 0 disables the boost.
+ *
+ * default: 2 msec, units: microseconds
+ */
+unsigned int sysctl_sched_fairamp_lock_boost = 2000UL;
+#endif
+
+#ifdef CONFIG_FAIRAMP_NUMA
+/*
+ * Rounds of lag a swap partner on another node must beat a partner that
+ * keeps the tasks on their home nodes by. (default: 2 rounds)
+ */
+unsigned int sysctl_sched_fairamp_numa_penalty = 2;
+
+/*
+ * Minimum interval between two page migrations of a process, made when a
+ * swap moves one of its threads away from its home node; 0 disables the
+ * migration.
+ *
+ * default: 0 (disabled), units: milliseconds
+ */
+unsigned int sysctl_sched_fairamp_numa_migrate = 0;
+#endif
+
+#ifdef CONFIG_FAIRAMP_SMT
+/*
+ * Throughput of one hardware thread while the other thread of its
+ * physical core is busy, in percent of the whole core. The fast/slow
+ * vruntime credited in __update_curr() is scaled by it.
+ * (default: 60%)
+ */
+unsigned int sysctl_sched_fairamp_smt_share = 60;
+
+/*
+ * Fast core first uses an idle fast cpu whose siblings are busy only
+ * when no physical fast core is fully idle. (default: 1, enabled)
+ */
+unsigned int sysctl_sched_fairamp_smt_spread = 1;
+#endif
+
+#ifdef CONFIG_FAIRAMP_FORK_PLACE
+/*
+ * Upper bound of the fast/slow round lag a new child takes from the credit
+ * pool of its process tree. 0 disables the pool and the fork/exec placement.
+ * (default: 4 rounds)
+ */
+unsigned int sysctl_sched_fairamp_fork_lag = 4;
+#endif
+
 /*
  * Increase the granularity value when there are more CPUs,
  * because with more CPUs the 'effective latency' as visible
@@ -673,6 +722,74 @@ static void update_cfs_shares(struct cfs_rq *cfs_rq);
 
 #ifdef CONFIG_FAIRAMP_DO_SCHED
 void update_rq_max_lagged(struct rq *, struct task_struct *, int, int);
+
+#ifdef CONFIG_FAIRAMP_SMT
+/*
+ * Count the busy SMT siblings of @cpu, stopping at @max. The lowest
+ * domain spans them when it shares cpu power.
+ */
+static int fairamp_busy_siblings(int cpu, int max)
+{
+	struct sched_domain *sd;
+	int sibling, busy = 0;
+
+	rcu_read_lock();
+	sd = rcu_dereference(cpu_rq(cpu)->sd);
+	if (sd && (sd->flags & SD_SHARE_CPUPOWER)) {
+		for_each_cpu(sibling, sched_domain_span(sd)) {
+			if (sibling != cpu && !idle_cpu(sibling) && ++busy >= max)
+				break;
+		}
+	}
+	rcu_read_unlock();
+	return busy;
+}
+
+/*
+ * Scale the round credit @delta by the occupancy of the SMT siblings.
+ * With k busy threads on the physical core, each thread is credited with
+ * 2 * sysctl_sched_fairamp_smt_share / k percent of the core. The busy
+ * siblings are sampled at the tick, not on every update of the runtime.
+ */
+static inline unsigned long fairamp_smt_scale(struct rq *rq, unsigned long delta)
+{
+	int busy = rq->fairamp_smt_busy + 1;
+	unsigned int share;
+
+	if (busy == 1)
+		return delta;
+
+	share = min(2 * sysctl_sched_fairamp_smt_share / busy, 100U);
+	return (unsigned long)div_u64((u64)delta * share, 100);
+}
+#else
+#define fairamp_smt_scale(rq, delta) (delta)
+#endif
+
+/*
+ * lagged of a task sharing both types of cores: fairamp_round_lag().
+ * A boosted lock holder looks lagged on slow cores until the boost ends.
+ * Its rounds keep counting, so the fast core time it gets while boosted
+ * is charged to fast_round and paid back on slow cores afterwards.
+ */
+static inline int fairamp_calc_lagged(struct rq *rq, struct sched_entity *se)
+{
+	int lagged = clamp_t(s64, fairamp_round_lag(se), INT_MIN + 1, INT_MAX - 1);
+
+#ifdef CONFIG_FAIRAMP_FAST_CORE_FIRST
+	if (lagged > FAIRAMP_MAX_LAGGED)
+		lagged = FAIRAMP_MAX_LAGGED;
+#endif
+#ifdef CONFIG_FAIRAMP_LOCK_BOOST
+	if (se->lock_boost_expires) {
+		if ((s64)(rq->clock - se->lock_boost_expires) < 0)
+			return min(lagged, FAIRAMP_LOCK_BOOST_LAGGED);
+		se->lock_boost_expires = 0;
+		fairamp_schedstat_inc(rq, fairamp_lock_boost_expired);
+	}
+#endif
+	return lagged;
+}
 #endif
 
 /*
@@ -710,8 +827,20 @@ __update_curr(struct cfs_rq *cfs_rq, struct sched_entity *curr,
 		curr->sum_slow_exec_runtime += delta_exec;
 #endif /* CONFIG_FAIRAMP */
 
+#ifdef CONFIG_FAIRAMP_NUMA
+	if (entity_is_task(curr)) {
+		struct task_struct *p = task_of(curr);
+		int home = fairamp_home_node(p);
+
+		if (home >= 0 && home != cpu_to_node(cpu_of(rq_of(cfs_rq))))
+			p->fairamp_remote_exec_runtime += delta_exec;
+	}
+#endif
+
 #ifdef CONFIG_FAIRAMP_DO_SCHED
 	if (curr->unit_fast_vruntime && curr->unit_slow_vruntime) {
+		/* a shared physical core delivers only a part of its speed */
+		delta_exec_weighted = fairamp_smt_scale(rq_of(cfs_rq), delta_exec_weighted);
 		if (is_fast) {
 			curr->fast_vruntime += delta_exec_weighted;
 			if (curr->unit_fast_vruntime) {
@@ -730,11 +859,7 @@ __update_curr(struct cfs_rq *cfs_rq, struct sched_entity *curr,
 			}
 		}
 
-		lagged = curr->fast_round - curr->slow_round;
-#ifdef CONFIG_FAIRAMP_FAST_CORE_FIRST
-		if (lagged > FAIRAMP_MAX_LAGGED)
-			lagged = FAIRAMP_MAX_LAGGED;
-#endif
+		lagged = fairamp_calc_lagged(rq_of(cfs_rq), curr);
 		if (curr->lagged != lagged) {
 			curr->lagged = lagged;
 			update_rq_max_lagged(rq_of(cfs_rq), task_of(curr), lagged, 1);
@@ -1146,6 +1271,62 @@ place_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int initial)
 	se->vruntime = vruntime;
 }
 
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+/*
+ * Renormalize the fast/slow rounds of a waking task.
+ *
+ * A sleeping task does not consume any round, while the tasks it competes
+ * with keep swapping between fast and slow cores, so the lag it carries is
+ * stale when it comes back. Like the sleeper credit of place_entity(), the
+ * lag is decayed by the rounds the task could have run on this rq during
+ * the sleep: a short sleep keeps almost all of it, a long one on a quiet rq
+ * drops it. The decayed part goes to round_offset, so the rounds completed
+ * keep counting up. Tasks bound to one type of cores (INT_MAX/INT_MIN
+ * lagged) are left alone.
+ */
+static void
+place_entity_fairamp(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	struct rq *rq = rq_of(cfs_rq);
+	u64 unit_round = se->unit_fast_vruntime + se->unit_slow_vruntime;
+	u64 slept, decay, lag;
+	s64 diff;
+
+	if (!se->unit_fast_vruntime || !se->unit_slow_vruntime)
+		return;
+
+	diff = fairamp_round_lag(se);
+	if (diff == 0)
+		return;
+
+	/*
+	 * The sleep time is measured with the clock of the waking rq, which
+	 * might not be the rq the task slept on. Ignore a backward clock.
+	 */
+	slept = 0;
+	if (se->lagged_sleep_start && (s64)(rq->clock - se->lagged_sleep_start) > 0)
+		slept = rq->clock - se->lagged_sleep_start;
+
+	/*
+	 * Rounds are counted in weighted vruntime, and the task would have
+	 * shared this rq with the tasks already queued on it.
+	 */
+	decay = calc_delta_fair((unsigned long)min_t(u64, slept, ULONG_MAX), se);
+	decay = div64_u64(decay, unit_round * (rq->nr_running + 1));
+
+	if (!decay)
+		return;
+
+	lag = diff > 0 ? diff : -diff;
+	decay = min(decay, lag);
+	se->round_offset += diff > 0 ? (s64)decay : -(s64)decay;
+	fairamp_schedstat_inc(rq, fairamp_sleeper_lag_decayed);
+
+	/* enqueue_task_fair() updates rq->max_lagged with the new value */
+	se->lagged = fairamp_calc_lagged(rq, se);
+}
+#endif /* CONFIG_FAIRAMP_DO_SCHED */
+
 static void check_enqueue_throttle(struct cfs_rq *cfs_rq);
 
 static void
@@ -1169,6 +1350,10 @@ enqueue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 	if (flags & ENQUEUE_WAKEUP) {
 		place_entity(cfs_rq, se, 0);
 		enqueue_sleeper(cfs_rq, se);
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+		if (entity_is_task(se))
+			place_entity_fairamp(cfs_rq, se);
+#endif
 	}
 
 	update_stats_enqueue(cfs_rq, se);
@@ -1249,6 +1434,9 @@ dequeue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 			if (tsk->state & TASK_UNINTERRUPTIBLE)
 				se->statistics.block_start = rq_of(cfs_rq)->clock;
 		}
+#endif
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+		se->lagged_sleep_start = rq_of(cfs_rq)->clock;
 #endif
 	}
 
@@ -1281,30 +1469,227 @@ inline int is_lagged(int lagged, struct rq *rq) {
 	return (lagged != 0) && ((lagged > 0) == rq->is_fast);
 }
 
+#ifdef CONFIG_FAIRAMP_SMT
+/* Are the SMT siblings of @cpu idle? */
+#define fairamp_siblings_idle(cpu) (!fairamp_busy_siblings(cpu, 1))
+
+#define fairamp_core_idle(cpu) (idle_cpu(cpu) && fairamp_siblings_idle(cpu))
+
+/*
+ * With sysctl_sched_fairamp_smt_spread, an idle fast cpu whose siblings
+ * are busy is only kept in @half_idle, in case no fast core is fully idle.
+ */
+static inline int fairamp_idle_enough(int cpu, int *half_idle)
+{
+	if (!sysctl_sched_fairamp_smt_spread || fairamp_siblings_idle(cpu))
+		return 1;
+	if (*half_idle < 0)
+		*half_idle = cpu;
+	return 0;
+}
+
+/* Is there a fully idle physical fast core? */
+static int fairamp_idle_fast_core_exists(void)
+{
+	int cpu;
+	for_each_cpu(cpu, cpu_fast_mask) {
+		if (fairamp_core_idle(cpu))
+			return 1;
+	}
+	return 0;
+}
+#endif /* CONFIG_FAIRAMP_SMT */
+
 static int idlest_fast_core(int my_lagged) {
 	int cpu;
 	int max_lagged = my_lagged;
 	int max_cpu = -1;
+#ifdef CONFIG_FAIRAMP_SMT
+	int half_idle = -1;
+#endif
 	for_each_cpu(cpu, cpu_fast_mask) {
-		if (idle_cpu(cpu))
+		if (idle_cpu(cpu)) {
+#ifdef CONFIG_FAIRAMP_SMT
+			if (!fairamp_idle_enough(cpu, &half_idle))
+				continue;
+#endif
 			return cpu;
+		}
 		if (cpu_rq(cpu)->max_lagged > max_lagged) {
 			max_cpu = cpu;
 			max_lagged = cpu_rq(cpu)->max_lagged;
 		}
 	}
+#ifdef CONFIG_FAIRAMP_SMT
+	if (half_idle >= 0)
+		return half_idle;
+#endif
 	return max_cpu;
 }
 #ifdef CONFIG_FAIRAMP_FAST_CORE_FIRST
 static int idle_fast_core(void) {
 	int cpu;
+#ifdef CONFIG_FAIRAMP_SMT
+	int half_idle = -1;
+#endif
 	for_each_cpu(cpu, cpu_fast_mask) {
-		if (idle_cpu(cpu))
+		if (idle_cpu(cpu)) {
+#ifdef CONFIG_FAIRAMP_SMT
+			if (!fairamp_idle_enough(cpu, &half_idle))
+				continue;
+#endif
 			return cpu;
+		}
 	}
+#ifdef CONFIG_FAIRAMP_SMT
+	return half_idle;
+#else
 	return -1;
+#endif
 }
 #endif /* CONFIG_FAIRAMP_FAST_CORE_FIRST */
+
+#ifdef CONFIG_FAIRAMP_NUMA
+/*
+ * Extra lag a candidate of fairamp_balance() on @rq needs, to be pulled to
+ * @this_cpu: a swap across nodes moves both tasks away from their memory,
+ * unless it brings the pulled task home. Called under rcu_read_lock(),
+ * which keeps rq->max_lagged_task alive.
+ */
+static inline int fairamp_numa_penalty(int this_cpu, struct rq *rq)
+{
+	struct task_struct *p;
+	int this_node = cpu_to_node(this_cpu);
+
+	if (cpu_to_node(cpu_of(rq)) == this_node)
+		return 0;
+
+	p = ACCESS_ONCE(rq->max_lagged_task);
+	if (p && fairamp_home_node(p) == this_node)
+		return 0;
+
+	return sysctl_sched_fairamp_numa_penalty;
+}
+
+static void fairamp_numa_migrate_work(struct callback_head *work)
+{
+	struct task_struct *p = current;
+	struct mm_struct *mm = p->mm;
+	int nid = xchg(&p->fairamp_numa_work_node, -1);
+	int home = fairamp_home_node(p);
+	unsigned long stamp;
+	nodemask_t from, to;
+	int mm_node;
+
+	if (nid < 0 || home < 0 || home == nid || !mm || (p->flags & PF_EXITING))
+		return;
+	/* swapped again before we got here */
+	if (cpu_to_node(raw_smp_processor_id()) != nid)
+		return;
+
+	/*
+	 * The pages belong to the mm, which the other threads share. If one
+	 * of them moved the pages here already, only the vote of @p has to
+	 * follow. Otherwise move them from where the last move put them, at
+	 * most once per interval for the whole mm, so that threads swapped
+	 * to different nodes do not pull the mm back and forth.
+	 */
+	mm_node = ACCESS_ONCE(mm->fairamp_numa_node);
+	if (mm_node == nid)
+		goto rehome;
+
+	stamp = ACCESS_ONCE(mm->fairamp_numa_migrate_stamp);
+	if (time_before(jiffies, stamp +
+			msecs_to_jiffies(sysctl_sched_fairamp_numa_migrate))) {
+		p->fairamp_numa_migrate_stamp = stamp;
+		return;
+	}
+	if (cmpxchg(&mm->fairamp_numa_migrate_stamp, stamp, jiffies) != stamp)
+		return;
+	p->fairamp_numa_migrate_stamp = jiffies;
+
+	from = nodemask_of_node(mm_node >= 0 ? mm_node : home);
+	to = nodemask_of_node(nid);
+	/* only the pages not shared with other processes */
+	if (do_migrate_pages(mm, &from, &to, MPOL_MF_MOVE) < 0)
+		return;
+	mm->fairamp_numa_node = nid;
+rehome:
+	p->fairamp_home_node = nid;
+	p->fairamp_home_faults = 1;
+}
+
+/*
+ * @p has been moved from @src_rq to @dst_rq by a FAIRAMP swap. Count the
+ * moves across nodes, and let @p take its pages along if it left its home
+ * node. Called with both rq->locks held.
+ */
+static void fairamp_numa_move(struct task_struct *p, struct rq *src_rq,
+		struct rq *dst_rq)
+{
+	int nid = cpu_to_node(cpu_of(dst_rq));
+	int home;
+
+	if (cpu_to_node(cpu_of(src_rq)) == nid)
+		return;
+	fairamp_schedstat_inc(src_rq, fairamp_numa_cross_node);
+
+	home = fairamp_home_node(p);
+	if (home < 0 || home == nid) {
+		fairamp_schedstat_inc(src_rq, fairamp_numa_to_home);
+		return;
+	}
+
+	if (!sysctl_sched_fairamp_numa_migrate || !p->mm || (p->flags & PF_EXITING))
+		return;
+	/* cheap filter, the work checks the rate limit of the mm */
+	if (time_before(jiffies, p->fairamp_numa_migrate_stamp +
+				msecs_to_jiffies(sysctl_sched_fairamp_numa_migrate)))
+		return;
+	if (cmpxchg(&p->fairamp_numa_work_node, -1, nid) != -1)
+		return;
+
+	init_task_work(&p->fairamp_numa_work, fairamp_numa_migrate_work);
+	if (task_work_add(p, &p->fairamp_numa_work, true))
+		p->fairamp_numa_work_node = -1;
+	else
+		fairamp_schedstat_inc(src_rq, fairamp_numa_migrate);
+}
+#endif /* CONFIG_FAIRAMP_NUMA */
+
+/*
+ * Re-evaluate @lagged of @p after its rounds or its lock boost changed
+ * out of __update_curr(). Called with rq->lock of @p held.
+ */
+void fairamp_update_lagged(struct rq *rq, struct task_struct *p)
+{
+	struct sched_entity *se = &p->se;
+	int lagged;
+
+	if (!se->unit_fast_vruntime || !se->unit_slow_vruntime)
+		return;
+
+	lagged = fairamp_calc_lagged(rq, se);
+	if (se->lagged == lagged)
+		return;
+	se->lagged = lagged;
+	if (!p->on_rq)
+		return;
+
+	update_rq_max_lagged(rq, p, lagged, 1);
+	if (!is_lagged(lagged, rq))
+		return;
+
+	/* same as check_preempt_tick(), but without waiting for the tick */
+	if (rq->is_fast) {
+		if (task_current(rq, p))
+			resched_task(p);
+	} else {
+		int cpu = idlest_fast_core(lagged);
+		if (cpu >= 0)
+			resched_cpu(cpu);
+	}
+}
 #endif /* CONFIG_FAIRAMP_DO_SCHED */
 
 /*
@@ -2813,6 +3198,67 @@ done:
 	return target;
 }
 
+#ifdef CONFIG_FAIRAMP_FORK_PLACE
+/*
+ * Place a new child (or an exec'ing task) on the core type it is owed.
+ * A child without a lag of its own follows the balance of its parent,
+ * which is current on fork. Returns -1 to leave it to the normal path.
+ */
+static int fairamp_fork_cpu(struct task_struct *p, int sd_flag)
+{
+	struct sched_entity *se = &p->se;
+	int lagged = se->lagged;
+	int cpu, best_cpu = -1;
+	unsigned long nr_running, best_nr_running = ULONG_MAX;
+
+	if (!(sd_flag & (SD_BALANCE_FORK | SD_BALANCE_EXEC)) || !sysctl_sched_fairamp_fork_lag)
+		return -1;
+	if (!se->unit_fast_vruntime || !se->unit_slow_vruntime)
+		return -1;
+
+	if (!lagged && (sd_flag & SD_BALANCE_FORK))
+		lagged = current->se.lagged;
+	if (!lagged)
+		return -1;
+
+	if (lagged < 0) {
+		/* owed fast rounds: an idle fast core, or the one with the most lagged tasks */
+		int max_lagged = lagged;
+		for_each_cpu_and(cpu, cpu_fast_mask, tsk_cpus_allowed(p)) {
+			if (!cpu_active(cpu))
+				continue;
+			if (idle_cpu(cpu)) {
+				best_cpu = cpu;
+				break;
+			}
+			if (cpu_rq(cpu)->max_lagged > max_lagged) {
+				best_cpu = cpu;
+				max_lagged = cpu_rq(cpu)->max_lagged;
+			}
+		}
+		if (best_cpu >= 0)
+			fairamp_schedstat_inc(this_rq(), fairamp_fork_place_fast);
+		return best_cpu;
+	}
+
+	/* owes slow rounds: the least loaded slow core */
+	for_each_cpu_and(cpu, cpu_active_mask, tsk_cpus_allowed(p)) {
+		if (cpumask_test_cpu(cpu, cpu_fast_mask))
+			continue;
+		nr_running = cpu_rq(cpu)->nr_running;
+		if (nr_running < best_nr_running) {
+			best_cpu = cpu;
+			best_nr_running = nr_running;
+			if (!nr_running)
+				break;
+		}
+	}
+	if (best_cpu >= 0)
+		fairamp_schedstat_inc(this_rq(), fairamp_fork_place_slow);
+	return best_cpu;
+}
+#endif /* CONFIG_FAIRAMP_FORK_PLACE */
+
 /*
  * sched_balance_self: balance the current task (running on cpu) in domains
  * that have the 'flag' flag set. In practice, this is SD_BALANCE_FORK and
@@ -2837,6 +3283,12 @@ select_task_rq_fair(struct task_struct *p, int sd_flag, int wake_flags)
 	if (p->nr_cpus_allowed == 1)
 		return prev_cpu;
 
+#ifdef CONFIG_FAIRAMP_FORK_PLACE
+	new_cpu = fairamp_fork_cpu(p, sd_flag);
+	if (new_cpu >= 0)
+		return new_cpu;
+#endif
+
 #ifdef CONFIG_FAIRAMP_FAST_CORE_FIRST
 	new_cpu = idle_fast_core();
 	if (new_cpu >= 0)
@@ -3215,6 +3667,9 @@ static void move_task_fairamp(struct task_struct *p, struct rq *src_rq, struct r
 	set_task_cpu(p, dst_rq->cpu);
 	activate_task(dst_rq, p, 0);
 	check_preempt_curr(dst_rq, p, 0);
+#ifdef CONFIG_FAIRAMP_NUMA
+	fairamp_numa_move(p, src_rq, dst_rq);
+#endif
 }
 #endif /* CONFIG_FAIRAMP_DO_SCHED */
 
@@ -4797,8 +5252,20 @@ void fairamp_balance(int this_cpu, struct rq *this_rq)
 	struct task_struct *this_task = NULL, *that_task = NULL;
 	unsigned long flags;
 	int this_active_balance = 0, that_active_balance = 0;
+#ifdef CONFIG_FAIRAMP_NUMA
+	int numa_lagged, best_numa_lagged = max_lagged_init;
+#endif
 
 	fairamp_schedstat_inc(this_rq, fairamp_balance_called); 
+
+#if defined(CONFIG_FAIRAMP_FAST_CORE_FIRST) && defined(CONFIG_FAIRAMP_SMT)
+	/* do not double up on a busy physical core, a fully idle one will pull */
+	if (fcf_mode && sysctl_sched_fairamp_smt_spread && !fairamp_siblings_idle(this_cpu)
+			&& fairamp_idle_fast_core_exists()) {
+		fairamp_schedstat_inc(this_rq, fairamp_balance_fast_core_first_smt_give_up);
+		return;
+	}
+#endif
 	
 	/*
 	 * Drop the rq->lock, but keep IRQ/preempt disabled.
@@ -4815,11 +5282,24 @@ void fairamp_balance(int this_cpu, struct rq *this_rq)
 			if (rq->active_balance || !rq->nr_running)
 				continue;
 
+#ifdef CONFIG_FAIRAMP_NUMA
+			/* the candidates on other nodes compete with a handicap */
+			if (rq->max_lagged >= max_lagged_init)
+				continue;
+			numa_lagged = rq->max_lagged + fairamp_numa_penalty(this_cpu, rq);
+			if (that_rq == NULL || numa_lagged < best_numa_lagged) {
+				that_cpu = cpu;
+				that_rq = rq;
+				max_lagged = rq->max_lagged;
+				best_numa_lagged = numa_lagged;
+			}
+#else
 			if (rq->max_lagged < max_lagged) {
 				that_cpu = cpu;
 				that_rq = rq;
 				max_lagged = rq->max_lagged;
 			}
+#endif
 		}
 
 		if (max_lagged < max_lagged_init)
@@ -5545,6 +6025,9 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &curr->se;
 
+#ifdef CONFIG_FAIRAMP_SMT
+	rq->fairamp_smt_busy = fairamp_busy_siblings(cpu_of(rq), INT_MAX);
+#endif
 	for_each_sched_entity(se) {
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
@@ -7,8 +7,11 @@
 
 #ifdef CONFIG_FAIRAMP_DO_SCHED
 /* constants for fairamp */
-#define FAIRAMP_MAX_LAGGED 0xFF
 #define GIVE_UP_MAX_LAGGED_THRESHOLD 3
+#define FAIRAMP_REINIT_LAGGED 10 /* |lagged| from which SET_UNIT_VRUNTIME re-initializes rounds */
+#endif
+#ifdef CONFIG_FAIRAMP_LOCK_BOOST
+#define FAIRAMP_LOCK_BOOST_LAGGED (-FAIRAMP_MAX_LAGGED) /* lagged of a boosted lock holder */
 #endif
 
 extern __read_mostly int scheduler_running;
@@ -430,6 +433,9 @@ struct rq {
 	int amp_balance; 
 	int max_lagged;
 	struct task_struct *max_lagged_task;
+#ifdef CONFIG_FAIRAMP_SMT
+	int fairamp_smt_busy; /* busy SMT siblings at the last tick */
+#endif
 #endif
 
 	struct list_head cfs_tasks;
@@ -501,6 +507,32 @@ struct rq {
 	unsigned int fairamp_balance_cpu_stop_succeed;
 	unsigned int fairamp_balance_cpu_stop_already_while_double_locking;
 	unsigned int fairamp_balance_cpu_stop_succeed_to_migrate_that_task;
+
+	/* related to place_entity_fairamp */
+	unsigned int fairamp_sleeper_lag_decayed;
+
+	/* related to fairamp_spin_yield */
+	unsigned int fairamp_spin_yield;
+
+#ifdef CONFIG_FAIRAMP_NUMA
+	/* related to fairamp_numa_move */
+	unsigned int fairamp_numa_cross_node;
+	unsigned int fairamp_numa_to_home;
+	unsigned int fairamp_numa_migrate;
+#endif
+
+#ifdef CONFIG_FAIRAMP_FORK_PLACE
+	/* related to fairamp_fork_cpu */
+	unsigned int fairamp_fork_place_fast;
+	unsigned int fairamp_fork_place_slow;
+#endif
+
+#ifdef CONFIG_FAIRAMP_LOCK_BOOST
+	/* related to fairamp_lock_boost */
+	unsigned int fairamp_lock_boost;
+	unsigned int fairamp_lock_boost_expired;
+	unsigned int fairamp_lock_unboost;
+#endif
 #endif
 
 #ifdef CONFIG_FAIRAMP_FAST_CORE_FIRST
@@ -513,6 +545,9 @@ struct rq {
 	unsigned int fairamp_balance_fast_core_balancing_give_up;
 	unsigned int fairamp_balance_fast_core_balancing_try;
 	unsigned int fairamp_balance_fast_core_balancing_succeed;
+#ifdef CONFIG_FAIRAMP_SMT
+	unsigned int fairamp_balance_fast_core_first_smt_give_up;
+#endif
 
 	/* related to fast_core_first_cpu_stop */
 	unsigned int fairamp_fast_core_first_cpu_stop_called;
@@ -599,6 +634,12 @@ extern int group_balance_cpu(struct sched_group *sg);
 #include "stats.h"
 #include "auto_group.h"
 
+#ifdef CONFIG_FAIRAMP_STAT
+#define fairamp_schedstat_inc(rq, var) schedstat_inc(rq, var)
+#else
+#define fairamp_schedstat_inc(rq, var) do{}while(0)
+#endif
+
 #ifdef CONFIG_CGROUP_SCHED
 
 /*
@@ -914,6 +955,7 @@ extern void trigger_load_balance(struct rq *rq, int cpu);
 extern void idle_balance(int this_cpu, struct rq *this_rq);
 #ifdef CONFIG_FAIRAMP_DO_SCHED
 extern void fairamp_balance(int this_cpu, struct rq *this_rq);
+extern void fairamp_update_lagged(struct rq *rq, struct task_struct *p);
 #endif
 #ifdef CONFIG_FAIRAMP_FAST_CORE_FIRST
 extern void fairamp_fast_core_first(int this_cpu, struct rq *this_rq, int that_cpu, struct rq *that_rq);
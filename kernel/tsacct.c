@@ -75,6 +75,36 @@ void bacct_add_tsk(struct user_namespace *user_ns,
 	strncpy(stats->ac_comm, tsk->comm, sizeof(stats->ac_comm));
 }
 
+#ifdef CONFIG_FAIRAMP
+/*
+ * accumulate fast/slow core accounting fields, so that a tgid gets
+ * the sum over its threads
+ */
+void fairamp_add_tsk(struct taskstats *stats, struct task_struct *p)
+{
+	stats->fairamp_fast_exec_runtime += p->se.sum_fast_exec_runtime;
+	stats->fairamp_slow_exec_runtime += p->se.sum_slow_exec_runtime;
+#ifdef CONFIG_FAIRAMP_MEASURING_IPS
+	stats->fairamp_insts_fast += atomic64_read(&p->insts_fast);
+	stats->fairamp_insts_slow += atomic64_read(&p->insts_slow);
+#endif
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+	stats->fairamp_fast_round += p->se.fast_round;
+	stats->fairamp_slow_round += p->se.slow_round;
+#endif
+}
+
+/*
+ * the lag of a single thread, as /proc/<pid>/fairamp shows it; a sum over
+ * threads would mean nothing, so tgid stats leave it 0
+ */
+void fairamp_lag_tsk(struct taskstats *stats, struct task_struct *p)
+{
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+	stats->fairamp_lagged = fairamp_round_lag(&p->se);
+#endif
+}
+#endif /* CONFIG_FAIRAMP */
 
 #ifdef CONFIG_TASK_XACCT
 
@@ -0,0 +1,161 @@
+/*
+ * LZ4 decompressor for the Linux kernel.
+ *
+ * Reads the legacy frame format written by "lz4 -l": a four byte magic
+ * number, then blocks of at most 8MB of output, each preceded by its
+ * compressed size as a little endian 32-bit value.  The stream has no
+ * end marker; it ends with the input, or where something that is not a
+ * block follows.  A magic number where a block size is expected starts
+ * a new stream, as happens when compressed files are concatenated.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifdef STATIC
+#include "lz4/lz4_decompress.c"
+#else
+#include <linux/decompress/unlz4.h>
+#endif
+
+#include <linux/types.h>
+#include <linux/lz4.h>
+#include <linux/decompress/mm.h>
+#include <linux/compiler.h>
+
+#include <asm/unaligned.h>
+
+#define ARCHIVE_MAGICNUMBER	0x184C2102
+#define LZ4_CHUNK_SIZE		(8 << 20)
+
+STATIC inline int INIT unlz4(u8 *input, int in_len,
+				int (*fill) (void *, unsigned int),
+				int (*flush) (void *, unsigned int),
+				u8 *output, int *posp,
+				void (*error) (char *x))
+{
+	int ret = -1;
+	int size = in_len;
+	unsigned int chunksize;
+	const unsigned int max_chunk = lz4_compressbound(LZ4_CHUNK_SIZE);
+	size_t dest_len;
+	u8 *inp, *inp_start, *outp;
+
+	if (output) {
+		outp = output;
+	} else if (!flush) {
+		error("NULL output pointer and no flush function provided");
+		goto exit;
+	} else {
+		outp = large_malloc(LZ4_CHUNK_SIZE);
+		if (!outp) {
+			error("Could not allocate output buffer");
+			goto exit;
+		}
+	}
+
+	if (input && fill) {
+		error("Both input pointer and fill function provided, don't know what to do");
+		goto exit_1;
+	} else if (input) {
+		inp = input;
+	} else if (!fill) {
+		error("NULL input pointer and missing fill function");
+		goto exit_1;
+	} else {
+		inp = large_malloc(max_chunk);
+		if (!inp) {
+			error("Could not allocate input buffer");
+			goto exit_1;
+		}
+	}
+	inp_start = inp;
+
+	if (posp)
+		*posp = 0;
+
+	if (fill)
+		size = fill(inp, 4);
+	if (size < 4 || get_unaligned_le32(inp) != ARCHIVE_MAGICNUMBER) {
+		error("invalid header");
+		goto exit_2;
+	}
+	if (!fill) {
+		inp += 4;
+		size -= 4;
+	}
+	if (posp)
+		*posp += 4;
+
+	for (;;) {
+		if (fill)
+			size = fill(inp, 4);
+		if (size < 0) {
+			error("data corrupted");
+			goto exit_2;
+		}
+		/* end of input, or padding after the last block */
+		if (size < 4)
+			break;
+
+		chunksize = get_unaligned_le32(inp);
+		if (chunksize == ARCHIVE_MAGICNUMBER) {
+			/* a concatenated stream */
+			if (!fill) {
+				inp += 4;
+				size -= 4;
+			}
+			if (posp)
+				*posp += 4;
+			continue;
+		}
+		/* anything that cannot be a block ends the stream */
+		if (chunksize == 0 || chunksize > max_chunk)
+			break;
+
+		if (fill) {
+			size = fill(inp, chunksize);
+		} else {
+			inp += 4;
+			size -= 4;
+		}
+		if (size < 0 || (unsigned int)size < chunksize) {
+			error("data corrupted");
+			goto exit_2;
+		}
+		if (posp)
+			*posp += 4;
+
+		dest_len = LZ4_CHUNK_SIZE;
+		if (lz4_decompress_safe(inp, chunksize, outp,
+					&dest_len) != LZ4_E_OK) {
+			error("Compressed data violation");
+			goto exit_2;
+		}
+
+		if (flush && flush(outp, dest_len) != dest_len)
+			goto exit_2;
+		if (output)
+			outp += dest_len;
+		if (posp)
+			*posp += chunksize;
+
+		if (!fill) {
+			inp += chunksize;
+			size -= chunksize;
+		}
+	}
+
+	ret = 0;
+exit_2:
+	if (!input)
+		large_free(inp_start);
+exit_1:
+	if (!output)
+		large_free(outp);
+exit:
+	return ret;
+}
+
+#define decompress unlz4
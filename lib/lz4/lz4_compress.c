@@ -0,0 +1,100 @@
+/*
+ * LZ4 - fast LZ compression
+ *
+ * One hash table of the last position each 4-byte prefix was seen at,
+ * and no attempt to find the longest match: the first candidate that
+ * matches is taken.  Where nothing matches, the scan speeds up, so
+ * incompressible data costs little time.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/* After 1 << SKIP_STRENGTH misses, skip ahead by two bytes, and so on */
+#define SKIP_STRENGTH	6
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	u32 *table = wrkmem;
+	const u8 *ip = src, *anchor = src, *ref;
+	const u8 * const iend = src + src_len;
+	const u8 * const mflimit = iend - MFLIMIT;
+	const u8 * const matchlimit = iend - LASTLITERALS;
+	u8 *op = dst;
+	u8 * const oend = dst + *dst_len;
+	unsigned int h, attempts;
+	size_t len;
+
+	if (src_len < MFLIMIT + 1)
+		goto last_literals;
+
+	memset(table, 0, LZ4_MEM_COMPRESS);
+	table[LZ4_HASH(ip, LZ4_HASH_LOG)] = 0;
+	ip++;
+
+	for (;;) {
+		/* find a match */
+		attempts = 1 << SKIP_STRENGTH;
+		for (;;) {
+			if (ip > mflimit)
+				goto last_literals;
+			h = LZ4_HASH(ip, LZ4_HASH_LOG);
+			ref = src + table[h];
+			table[h] = ip - src;
+			if (ip - ref <= MAX_DISTANCE &&
+			    LZ4_READ32(ref) == LZ4_READ32(ip))
+				break;
+			ip += attempts++ >> SKIP_STRENGTH;
+		}
+
+		/* extend it backwards */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		for (;;) {
+			len = MINMATCH + lz4_count(ip + MINMATCH,
+						   ref + MINMATCH, matchlimit);
+			op = lz4_encode_sequence(op, oend, anchor, ip, ref, len);
+			if (!op)
+				return LZ4_E_OUTPUT_OVERRUN;
+			ip += len;
+			anchor = ip;
+			if (ip > mflimit)
+				goto last_literals;
+
+			table[LZ4_HASH(ip - 2, LZ4_HASH_LOG)] = ip - 2 - src;
+
+			/* another match right away saves a literal run */
+			h = LZ4_HASH(ip, LZ4_HASH_LOG);
+			ref = src + table[h];
+			table[h] = ip - src;
+			if (ip - ref > MAX_DISTANCE ||
+			    LZ4_READ32(ref) != LZ4_READ32(ip))
+				break;
+		}
+		ip++;
+	}
+
+last_literals:
+	op = lz4_encode_last(op, oend, anchor, iend);
+	if (!op)
+		return LZ4_E_OUTPUT_OVERRUN;
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
@@ -0,0 +1,135 @@
+/*
+ * LZ4 decompressor
+ *
+ * Every length and offset read from the input is checked, so corrupt or
+ * malicious input can neither read past @src + @src_len nor write past
+ * the buffer size given in *@dst_len.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#endif
+
+#include <asm/unaligned.h>
+#include <linux/lz4.h>
+#include "lz4defs.h"
+
+/* the smallest multiple of an offset below 8 that is at least 8 */
+static const u8 spread[8] = { 0, 8, 8, 9, 8, 10, 12, 14 };
+
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len)
+{
+	const u8 *ip = src, *ref;
+	const u8 * const iend = src + src_len;
+	u8 *op = dst, *cpy;
+	u8 * const oend = dst + *dst_len;
+	unsigned int token, s;
+	size_t len, offset;
+
+	*dst_len = 0;
+
+	for (;;) {
+		if (ip >= iend)
+			return LZ4_E_INPUT_OVERRUN;
+		token = *ip++;
+
+		/* literals */
+		len = token >> ML_BITS;
+		if (len == RUN_MASK) {
+			do {
+				if (ip >= iend)
+					return LZ4_E_INPUT_OVERRUN;
+				s = *ip++;
+				len += s;
+			} while (s == 255);
+		}
+		if (len > (size_t)(iend - ip))
+			return LZ4_E_INPUT_OVERRUN;
+		if (len > (size_t)(oend - op))
+			return LZ4_E_OUTPUT_OVERRUN;
+		if (iend - ip >= len + 8 && oend - op >= len + 8) {
+			/* short runs are the common case, copy 8 at a time */
+			cpy = op + len;
+			while (op < cpy) {
+				put_unaligned(get_unaligned((const u64 *)ip),
+					      (u64 *)op);
+				op += 8;
+				ip += 8;
+			}
+			ip -= op - cpy;
+			op = cpy;
+		} else {
+			memcpy(op, ip, len);
+			op += len;
+			ip += len;
+		}
+
+		/* the last sequence has no match */
+		if (ip == iend)
+			break;
+
+		/* match */
+		if (iend - ip < 2)
+			return LZ4_E_INPUT_OVERRUN;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (!offset || offset > (size_t)(op - dst))
+			return LZ4_E_LOOKBEHIND_OVERRUN;
+		ref = op - offset;
+
+		len = token & ML_MASK;
+		if (len == ML_MASK) {
+			do {
+				if (ip >= iend)
+					return LZ4_E_INPUT_OVERRUN;
+				s = *ip++;
+				len += s;
+			} while (s == 255);
+		}
+		len += MINMATCH;
+		if (len > (size_t)(oend - op))
+			return LZ4_E_OUTPUT_OVERRUN;
+
+		cpy = op + len;
+		if (offset < 8 && oend - op >= 8) {
+			/*
+			 * Lay out the first eight bytes one at a time; from
+			 * there on the data repeats at a multiple of @offset
+			 * that is at least 8.  Bytes written past @cpy are
+			 * overwritten by what follows.
+			 */
+			for (s = 0; s < 8; s++)
+				op[s] = ref[s];
+			op += 8;
+			ref = op - spread[offset];
+		}
+		if (op - ref >= 8) {
+			while (op < cpy && oend - op >= 8) {
+				put_unaligned(get_unaligned((const u64 *)ref),
+					      (u64 *)op);
+				op += 8;
+				ref += 8;
+			}
+		}
+		/* close to the end of the buffer, one byte at a time */
+		while (op < cpy)
+			*op++ = *ref++;
+		op = cpy;
+	}
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+#ifndef STATIC
+EXPORT_SYMBOL_GPL(lz4_decompress_safe);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
+#endif
@@ -0,0 +1,205 @@
+/*
+ * LZ4 self test and benchmark
+ *
+ * Compresses zeroes, text-like data and random data one page at a time,
+ * the way zram and the crypto users see it, and once as a single large
+ * block.  Every result is decompressed and compared, the same data cut
+ * short must be rejected, and the time spent in each direction is
+ * reported in MB/s.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) "lz4: " fmt
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/random.h>
+#include <linux/time.h>
+#include <linux/lz4.h>
+
+#define TEST_SIZE	(256 * 1024)
+#define TEST_LOOPS	4
+
+typedef int (*lz4_comp_fn)(const unsigned char *src, size_t src_len,
+			   unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+struct lz4_test_buf {
+	u8 *src;
+	u8 *comp;
+	u8 *out;
+	void *wrkmem;
+	size_t comp_len[TEST_SIZE / PAGE_SIZE + 1];
+};
+
+static const char * const words[] = {
+	"the ", "page ", "struct ", "return ", "int ", "0x0000", "if (",
+	"lock", ");\n\t", "kernel ", "= NULL;", "buffer ", "\n}\n",
+};
+
+static void fill_text(u8 *buf, size_t len)
+{
+	u32 seed = 1;
+	size_t i = 0;
+	const char *w;
+
+	while (i < len) {
+		seed = seed * 1103515245 + 12345;
+		w = words[(seed >> 16) % ARRAY_SIZE(words)];
+		while (*w && i < len)
+			buf[i++] = *w++;
+		/* some noise, so that not every match is a long one */
+		if (((seed >> 8) & 7) == 0 && i < len)
+			buf[i++] = seed >> 24;
+	}
+}
+
+static u64 elapsed_ns(struct timespec *start)
+{
+	struct timespec stop;
+
+	getnstimeofday(&stop);
+	return (u64)(stop.tv_sec - start->tv_sec) * NSEC_PER_SEC +
+		stop.tv_nsec - start->tv_nsec;
+}
+
+static unsigned int mb_per_sec(u64 bytes, u64 ns)
+{
+	return ns ? div64_u64(bytes * 1000, ns) : 0;
+}
+
+/*
+ * Run one compressor over @b->src in @chunk sized pieces and check the
+ * round trip.  Returns the number of failures.
+ */
+static int lz4_test_one(struct lz4_test_buf *b, const char *data,
+			const char *name, lz4_comp_fn comp, size_t chunk)
+{
+	size_t nr = TEST_SIZE / chunk, total = 0, len, i;
+	u64 cns, dns;
+	struct timespec start;
+	int loop, err, errors = 0;
+
+	getnstimeofday(&start);
+	for (loop = 0; loop < TEST_LOOPS; loop++) {
+		for (i = 0; i < nr; i++) {
+			len = lz4_compressbound(chunk);
+			err = comp(b->src + i * chunk, chunk,
+				   b->comp + i * lz4_compressbound(chunk),
+				   &len, b->wrkmem);
+			if (err != LZ4_E_OK) {
+				pr_err("%s %s: compress failed (%d)\n",
+				       name, data, err);
+				return 1;
+			}
+			b->comp_len[i] = len;
+		}
+	}
+	cns = elapsed_ns(&start);
+
+	for (i = 0; i < nr; i++)
+		total += b->comp_len[i];
+
+	getnstimeofday(&start);
+	for (loop = 0; loop < TEST_LOOPS; loop++) {
+		for (i = 0; i < nr; i++) {
+			len = chunk;
+			err = lz4_decompress_safe(
+					b->comp + i * lz4_compressbound(chunk),
+					b->comp_len[i], b->out + i * chunk,
+					&len);
+			if (err != LZ4_E_OK || len != chunk)
+				errors++;
+		}
+	}
+	dns = elapsed_ns(&start);
+
+	if (errors || memcmp(b->src, b->out, nr * chunk)) {
+		pr_err("%s %s: data does not round trip\n", name, data);
+		return 1;
+	}
+
+	/* truncated input and a short output buffer must both be caught */
+	len = chunk;
+	if (lz4_decompress_safe(b->comp, b->comp_len[0] - 1, b->out,
+				&len) == LZ4_E_OK) {
+		pr_err("%s %s: truncated input accepted\n", name, data);
+		errors++;
+	}
+	len = chunk - 1;
+	if (lz4_decompress_safe(b->comp, b->comp_len[0], b->out,
+				&len) == LZ4_E_OK) {
+		pr_err("%s %s: output overrun not detected\n", name, data);
+		errors++;
+	}
+
+	pr_info("%-5s %-6s %6zu byte blocks: ratio %3zu%%, compress %u MB/s, decompress %u MB/s\n",
+		name, data, chunk, total * 100 / (nr * chunk),
+		mb_per_sec((u64)TEST_SIZE * TEST_LOOPS, cns),
+		mb_per_sec((u64)TEST_SIZE * TEST_LOOPS, dns));
+
+	return errors;
+}
+
+static int __init lz4_selftest_init(void)
+{
+	struct lz4_test_buf *b;
+	int data, errors = 0;
+	static const char * const data_names[] = { "zero", "text", "random" };
+
+	b = vzalloc(sizeof(*b));
+	if (!b)
+		return -ENOMEM;
+	b->src = vmalloc(TEST_SIZE);
+	b->out = vmalloc(TEST_SIZE);
+	b->comp = vmalloc(TEST_SIZE / PAGE_SIZE *
+			  lz4_compressbound(PAGE_SIZE) + PAGE_SIZE);
+	b->wrkmem = vmalloc(LZ4HC_MEM_COMPRESS);
+	if (!b->src || !b->out || !b->comp || !b->wrkmem) {
+		errors = -ENOMEM;
+		goto out;
+	}
+
+	for (data = 0; data < ARRAY_SIZE(data_names); data++) {
+		if (data == 0)
+			memset(b->src, 0, TEST_SIZE);
+		else if (data == 1)
+			fill_text(b->src, TEST_SIZE);
+		else
+			get_random_bytes(b->src, TEST_SIZE);
+
+		errors += lz4_test_one(b, data_names[data], "lz4",
+				       lz4_compress, PAGE_SIZE);
+		errors += lz4_test_one(b, data_names[data], "lz4hc",
+				       lz4hc_compress, PAGE_SIZE);
+		errors += lz4_test_one(b, data_names[data], "lz4",
+				       lz4_compress, TEST_SIZE);
+	}
+
+	if (errors)
+		pr_warn("%d self tests failed\n", errors);
+	else
+		pr_info("self tests passed\n");
+	errors = 0;
+out:
+	vfree(b->wrkmem);
+	vfree(b->comp);
+	vfree(b->out);
+	vfree(b->src);
+	vfree(b);
+	return errors;
+}
+
+static void __exit lz4_selftest_exit(void)
+{
+}
+
+module_init(lz4_selftest_init);
+module_exit(lz4_selftest_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 self test and benchmark");
@@ -0,0 +1,114 @@
+/*
+ * lz4defs.h -- constants and helpers shared by the LZ4 compressors and
+ * the decompressor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define MINMATCH	4
+#define MAX_DISTANCE	65535
+
+/* The last match must start at least MFLIMIT bytes before the end ... */
+#define MFLIMIT		12
+/* ... and the last LASTLITERALS bytes are always literals */
+#define LASTLITERALS	5
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+#define LZ4_READ32(p)	get_unaligned((const u32 *)(p))
+
+/* Knuth's multiplicative hash of the four bytes at @p */
+#define LZ4_HASH(p, log)	((LZ4_READ32(p) * 2654435761U) >> (32 - (log)))
+
+/* Number of equal bytes at @ip and @ref, not looking at @limit or beyond */
+static inline size_t lz4_count(const u8 *ip, const u8 *ref, const u8 *limit)
+{
+	const u8 *start = ip;
+
+	while (ip <= limit - sizeof(unsigned long) &&
+	       get_unaligned((const unsigned long *)ip) ==
+	       get_unaligned((const unsigned long *)ref)) {
+		ip += sizeof(unsigned long);
+		ref += sizeof(unsigned long);
+	}
+	while (ip < limit && *ip == *ref) {
+		ip++;
+		ref++;
+	}
+
+	return ip - start;
+}
+
+/*
+ * Emit one sequence: the literals from @anchor up to @ip, then a match
+ * of @len bytes at distance @ip - @ref.  Returns the new output
+ * position, or NULL if the sequence might not fit.
+ */
+static inline u8 *lz4_encode_sequence(u8 *op, const u8 *oend,
+				      const u8 *anchor, const u8 *ip,
+				      const u8 *ref, size_t len)
+{
+	size_t lit = ip - anchor;
+	u8 *token;
+
+	if (op + 1 + lit / 255 + 1 + lit + 2 + len / 255 + 1 > oend)
+		return NULL;
+
+	token = op++;
+	if (lit >= RUN_MASK) {
+		size_t l = lit - RUN_MASK;
+
+		*token = RUN_MASK << ML_BITS;
+		for (; l >= 255; l -= 255)
+			*op++ = 255;
+		*op++ = l;
+	} else {
+		*token = lit << ML_BITS;
+	}
+	memcpy(op, anchor, lit);
+	op += lit;
+
+	put_unaligned_le16(ip - ref, op);
+	op += 2;
+
+	len -= MINMATCH;
+	if (len >= ML_MASK) {
+		*token |= ML_MASK;
+		for (len -= ML_MASK; len >= 255; len -= 255)
+			*op++ = 255;
+		*op++ = len;
+	} else {
+		*token |= len;
+	}
+
+	return op;
+}
+
+/* Emit the closing run of literals */
+static inline u8 *lz4_encode_last(u8 *op, const u8 *oend,
+				  const u8 *anchor, const u8 *iend)
+{
+	size_t lit = iend - anchor;
+
+	if (op + 1 + lit / 255 + 1 + lit > oend)
+		return NULL;
+
+	if (lit >= RUN_MASK) {
+		size_t l = lit - RUN_MASK;
+
+		*op++ = RUN_MASK << ML_BITS;
+		for (; l >= 255; l -= 255)
+			*op++ = 255;
+		*op++ = l;
+	} else {
+		*op++ = lit << ML_BITS;
+	}
+	memcpy(op, anchor, lit);
+
+	return op + lit;
+}
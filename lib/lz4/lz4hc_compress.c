@@ -0,0 +1,134 @@
+/*
+ * LZ4HC - high compression LZ4
+ *
+ * Same output format as lz4_compress(), but every position is entered in
+ * a hash chain and up to MAX_ATTEMPTS earlier positions are compared to
+ * find the longest match.  A match is only taken if the next position
+ * does not start a longer one (lazy matching).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+#define MAX_ATTEMPTS	256
+
+struct lz4hc_ctx {
+	const u8 *base;
+	u32 next;		/* first position not in the chains yet */
+	u32 *head;		/* last position of each hash */
+	u16 *chain;		/* distance to the previous one, 0 at the end */
+};
+
+static void lz4hc_insert(struct lz4hc_ctx *ctx, u32 pos)
+{
+	u32 h, delta;
+
+	for (; ctx->next < pos; ctx->next++) {
+		h = LZ4_HASH(ctx->base + ctx->next, LZ4HC_HASH_LOG);
+		delta = ctx->next - ctx->head[h];
+		if (delta > MAX_DISTANCE)
+			delta = 0;
+		ctx->chain[ctx->next & (LZ4HC_CHAIN_SIZE - 1)] = delta;
+		ctx->head[h] = ctx->next;
+	}
+}
+
+/* Length of the longest match for @ip, 0 if there is none */
+static size_t lz4hc_find_match(struct lz4hc_ctx *ctx, const u8 *ip,
+			       const u8 *matchlimit, const u8 **match)
+{
+	u32 pos = ip - ctx->base, cand, delta;
+	int attempts = MAX_ATTEMPTS;
+	size_t len, best = 0;
+	const u8 *ref;
+
+	lz4hc_insert(ctx, pos);
+
+	cand = ctx->head[LZ4_HASH(ip, LZ4HC_HASH_LOG)];
+	while (pos - cand <= MAX_DISTANCE && cand < pos && attempts--) {
+		ref = ctx->base + cand;
+		if (ref[best] == ip[best] &&
+		    LZ4_READ32(ref) == LZ4_READ32(ip)) {
+			len = MINMATCH + lz4_count(ip + MINMATCH,
+						   ref + MINMATCH, matchlimit);
+			if (len > best) {
+				best = len;
+				*match = ref;
+				if (ip + len >= matchlimit)
+					break;
+			}
+		}
+		delta = ctx->chain[cand & (LZ4HC_CHAIN_SIZE - 1)];
+		if (!delta)
+			break;
+		cand -= delta;
+	}
+
+	return best;
+}
+
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	struct lz4hc_ctx ctx;
+	const u8 *ip = src, *anchor = src, *ref, *ref2;
+	const u8 * const iend = src + src_len;
+	const u8 * const mflimit = iend - MFLIMIT;
+	const u8 * const matchlimit = iend - LASTLITERALS;
+	u8 *op = dst;
+	u8 * const oend = dst + *dst_len;
+	size_t len, len2;
+
+	if (src_len < MFLIMIT + 1)
+		goto last_literals;
+
+	ctx.base = src;
+	ctx.next = 0;
+	ctx.head = wrkmem;
+	ctx.chain = wrkmem + (1 << LZ4HC_HASH_LOG) * sizeof(u32);
+	memset(ctx.head, 0, (1 << LZ4HC_HASH_LOG) * sizeof(u32));
+
+	while (ip <= mflimit) {
+		len = lz4hc_find_match(&ctx, ip, matchlimit, &ref);
+		if (!len) {
+			ip++;
+			continue;
+		}
+
+		/* a longer match one byte on is worth a literal */
+		while (ip + 1 <= mflimit) {
+			len2 = lz4hc_find_match(&ctx, ip + 1, matchlimit, &ref2);
+			if (len2 <= len)
+				break;
+			ip++;
+			len = len2;
+			ref = ref2;
+		}
+
+		op = lz4_encode_sequence(op, oend, anchor, ip, ref, len);
+		if (!op)
+			return LZ4_E_OUTPUT_OVERRUN;
+		ip += len;
+		anchor = ip;
+	}
+
+last_literals:
+	op = lz4_encode_last(op, oend, anchor, iend);
+	if (!op)
+		return LZ4_E_OUTPUT_OVERRUN;
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4hc_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4HC Compressor");
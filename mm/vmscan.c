@@ -42,6 +42,7 @@
 #include <linux/sysctl.h>
 #include <linux/oom.h>
 #include <linux/prefetch.h>
+#include <linux/memory_hotplug.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -128,6 +129,10 @@ struct scan_control {
  * From 0 .. 100.  Higher means more swappy.
  */
 int vm_swappiness = 60;
+/*
+ * Threads reclaiming for each node: kswapd and kswapd_threads - 1 helpers.
+ */
+int kswapd_threads = 1;
 long vm_total_pages;	/* The total number of pages which the VM controls */
 
 static LIST_HEAD(shrinker_list);
@@ -2898,6 +2903,54 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
 	finish_wait(&pgdat->kswapd_wait, &wait);
 }
 
+static void kswapd_init_task(pg_data_t *pgdat,
+			     struct reclaim_state *reclaim_state)
+{
+	struct task_struct *tsk = current;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	lockdep_set_current_reclaim_state(GFP_KERNEL);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(tsk, cpumask);
+	current->reclaim_state = reclaim_state;
+
+	/*
+	 * Tell the memory management that we're a "memory allocator",
+	 * and that if we need more memory we should get access to it
+	 * regardless (see "__alloc_pages()"). "kswapd" should
+	 * never get caught in the normal page freeing logic.
+	 *
+	 * (Kswapd normally doesn't need memory anyway, but sometimes
+	 * you need a small amount of memory in order to be able to
+	 * page out something else, and this flag essentially protects
+	 * us from recursively trying to free more memory as we're
+	 * trying to free the first piece of memory in the first place).
+	 */
+	tsk->flags |= PF_MEMALLOC | PF_SWAPWRITE | PF_KSWAPD;
+	set_freezable();
+}
+
+/*
+ * Publish the order kswapd balances the node at and wake up its helpers
+ * to reclaim alongside it.
+ */
+static void kswapd_wake_helpers(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	pgdat->kswapd_balance_order = order;
+	pgdat->kswapd_balance_classzone_idx = classzone_idx;
+	smp_wmb();
+	pgdat->kswapd_balance_seq++;
+	pgdat->kswapd_balancing = true;
+	/*
+	 * Publish the request before looking for sleepers, pairs with the
+	 * barrier in prepare_to_wait() of the helpers' wait_event.
+	 */
+	smp_mb();
+	if (waitqueue_active(&pgdat->kswapd_helper_wait))
+		wake_up_interruptible(&pgdat->kswapd_helper_wait);
+}
+
 /*
  * The background pageout daemon, started as a kernel thread
  * from the init process.
@@ -2918,33 +2971,12 @@ static int kswapd(void *p)
 	int classzone_idx, new_classzone_idx;
 	int balanced_classzone_idx;
 	pg_data_t *pgdat = (pg_data_t*)p;
-	struct task_struct *tsk = current;
 
 	struct reclaim_state reclaim_state = {
 		.reclaimed_slab = 0,
 	};
-	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
-
-	lockdep_set_current_reclaim_state(GFP_KERNEL);
-
-	if (!cpumask_empty(cpumask))
-		set_cpus_allowed_ptr(tsk, cpumask);
-	current->reclaim_state = &reclaim_state;
 
-	/*
-	 * Tell the memory management that we're a "memory allocator",
-	 * and that if we need more memory we should get access to it
-	 * regardless (see "__alloc_pages()"). "kswapd" should
-	 * never get caught in the normal page freeing logic.
-	 *
-	 * (Kswapd normally doesn't need memory anyway, but sometimes
-	 * you need a small amount of memory in order to be able to
-	 * page out something else, and this flag essentially protects
-	 * us from recursively trying to free more memory as we're
-	 * trying to free the first piece of memory in the first place).
-	 */
-	tsk->flags |= PF_MEMALLOC | PF_SWAPWRITE | PF_KSWAPD;
-	set_freezable();
+	kswapd_init_task(pgdat, &reclaim_state);
 
 	order = new_order = 0;
 	balanced_order = 0;
@@ -2995,8 +3027,10 @@ static int kswapd(void *p)
 		if (!ret) {
 			trace_mm_vmscan_kswapd_wake(pgdat->node_id, order);
 			balanced_classzone_idx = classzone_idx;
+			kswapd_wake_helpers(pgdat, order, classzone_idx);
 			balanced_order = balance_pgdat(pgdat, order,
 						&balanced_classzone_idx);
+			pgdat->kswapd_balancing = false;
 		}
 	}
 
@@ -3004,6 +3038,47 @@ static int kswapd(void *p)
 	return 0;
 }
 
+/*
+ * A helper of kswapd, one of kswapd_threads - 1 per node.  On a large
+ * node a single kswapd cannot keep up with the allocation rate, and the
+ * allocators fall into direct reclaim.  Every time kswapd starts to
+ * balance the node, its helpers run balance_pgdat() at the same order
+ * next to it.  They scan the same LRU lists in disjoint batches, and the
+ * memcg reclaim iterator of a zone hands concurrent reclaimers different
+ * memcgs, so the scanning is split between them.  The helpers leave the
+ * wakeup order and the sleeping decisions to kswapd.
+ */
+static int kswapd_helper(void *p)
+{
+	pg_data_t *pgdat = p;
+	unsigned long seq = 0;
+	struct reclaim_state reclaim_state = {
+		.reclaimed_slab = 0,
+	};
+
+	kswapd_init_task(pgdat, &reclaim_state);
+
+	for (;;) {
+		int order, classzone_idx;
+
+		wait_event_freezable(pgdat->kswapd_helper_wait,
+				     kthread_should_stop() ||
+				     (pgdat->kswapd_balancing &&
+				      pgdat->kswapd_balance_seq != seq));
+		if (kthread_should_stop())
+			break;
+
+		seq = pgdat->kswapd_balance_seq;
+		smp_rmb();
+		order = pgdat->kswapd_balance_order;
+		classzone_idx = pgdat->kswapd_balance_classzone_idx;
+		balance_pgdat(pgdat, order, &classzone_idx);
+	}
+
+	current->reclaim_state = NULL;
+	return 0;
+}
+
 /*
  * A zone is low on free memory, so wake its kswapd task to service it.
  */
@@ -3125,14 +3200,50 @@ static int __devinit cpu_callback(struct notifier_block *nfb,
 
 			mask = cpumask_of_node(pgdat->node_id);
 
-			if (cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids)
+			if (cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids) {
+				int i;
+
 				/* One of our CPUs online: restore mask */
 				set_cpus_allowed_ptr(pgdat->kswapd, mask);
+				for (i = 0; i < MAX_KSWAPD_THREADS - 1; i++)
+					if (pgdat->kswapd_helpers[i])
+						set_cpus_allowed_ptr(pgdat->kswapd_helpers[i],
+								     mask);
+			}
 		}
 	}
 	return NOTIFY_OK;
 }
 
+/*
+ * Start or stop the helpers of kswapd on a node to match kswapd_threads.
+ * Caller must hold lock_memory_hotplug().
+ */
+static int kswapd_run_helpers(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int i;
+
+	for (i = 0; i < MAX_KSWAPD_THREADS - 1; i++) {
+		struct task_struct *helper = pgdat->kswapd_helpers[i];
+
+		if (i < kswapd_threads - 1 && !helper) {
+			helper = kthread_run(kswapd_helper, pgdat, "kswapd%d:%d",
+					     nid, i + 1);
+			if (IS_ERR(helper)) {
+				pr_err("Failed to start kswapd helper on node %d\n",
+				       nid);
+				return PTR_ERR(helper);
+			}
+			pgdat->kswapd_helpers[i] = helper;
+		} else if (i >= kswapd_threads - 1 && helper) {
+			kthread_stop(helper);
+			pgdat->kswapd_helpers[i] = NULL;
+		}
+	}
+	return 0;
+}
+
 /*
  * This kswapd start function will be called by init and node-hot-add.
  * On node-hot-add, kswapd will moved to proper cpus if cpus are hot-added.
@@ -3143,7 +3254,7 @@ int kswapd_run(int nid)
 	int ret = 0;
 
 	if (pgdat->kswapd)
-		return 0;
+		return kswapd_run_helpers(nid);
 
 	pgdat->kswapd = kthread_run(kswapd, pgdat, "kswapd%d", nid);
 	if (IS_ERR(pgdat->kswapd)) {
@@ -3152,7 +3263,8 @@ int kswapd_run(int nid)
 		pgdat->kswapd = NULL;
 		pr_err("Failed to start kswapd on node %d\n", nid);
 		ret = PTR_ERR(pgdat->kswapd);
-	}
+	} else
+		ret = kswapd_run_helpers(nid);
 	return ret;
 }
 
@@ -3162,7 +3274,16 @@ int kswapd_run(int nid)
  */
 void kswapd_stop(int nid)
 {
-	struct task_struct *kswapd = NODE_DATA(nid)->kswapd;
+	pg_data_t *pgdat = NODE_DATA(nid);
+	struct task_struct *kswapd = pgdat->kswapd;
+	int i;
+
+	for (i = 0; i < MAX_KSWAPD_THREADS - 1; i++) {
+		if (pgdat->kswapd_helpers[i]) {
+			kthread_stop(pgdat->kswapd_helpers[i]);
+			pgdat->kswapd_helpers[i] = NULL;
+		}
+	}
 
 	if (kswapd) {
 		kthread_stop(kswapd);
@@ -3170,6 +3291,41 @@ void kswapd_stop(int nid)
 	}
 }
 
+/*
+ * vm.kswapd_threads changes the number of reclaim threads of every node
+ * right away. If a helper cannot be started, the old number is restored
+ * and the error returned to the writer.
+ */
+int kswapd_threads_sysctl_handler(struct ctl_table *table, int write,
+				  void __user *buffer, size_t *length,
+				  loff_t *ppos)
+{
+	int old_threads = kswapd_threads;
+	int nid, ret;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	lock_memory_hotplug();
+	for_each_node_state(nid, N_HIGH_MEMORY) {
+		if (!NODE_DATA(nid)->kswapd)
+			continue;
+		ret = kswapd_run_helpers(nid);
+		if (ret)
+			break;
+	}
+	if (ret) {
+		/* Only more threads can fail, going back only stops them */
+		kswapd_threads = old_threads;
+		for_each_node_state(nid, N_HIGH_MEMORY)
+			if (NODE_DATA(nid)->kswapd)
+				kswapd_run_helpers(nid);
+	}
+	unlock_memory_hotplug();
+	return ret;
+}
+
 static int __init kswapd_init(void)
 {
 	int nid;
@@ -0,0 +1,181 @@
+#!/bin/bash
+#
+# run_bench.sh - fairness/throughput regression benchmark for FAIRAMP policies
+#
+# 1. Runs every command of the command file alone to get its standalone time.
+# 2. Runs the whole mix with the unaware baseline (mode: unaware) and with
+#    each predefined policy of fairamp (mode: normal).
+# 3. Computes the measured metrics from the timings saved by fairamp --result.
+#      slowdown_i = T_shared_i / T_alone_i
+#      NP_i       = 1 / slowdown_i      (normalized progress)
+#      STP        = sum(NP_i)           (system throughput)
+#      ANTT       = avg(slowdown_i)     (average normalized turnaround time)
+#      minF       = min(NP_i) / max(NP_i)
+#      uniformity = 1 - stddev(NP_i) / avg(NP_i)
+#    (uniformity uses the same formula as calculate_uniformity() of the solver)
+#
+# Output (in the result directory):
+#   alone.tsv     standalone time of each command
+#   <policy>.tsv  timings saved by fairamp --result
+#   apps.csv      policy,id,name,t_alone,t_shared,slowdown
+#   summary.csv   policy,mode,stp,antt,minF,uniformity
+#
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+
+FAIRAMP=${FAIRAMP:-fairamp}
+COMM_FILE=$BENCH_DIR/bench.comm
+RESULT_DIR=$BENCH_DIR/results/$(date +%Y%m%d-%H%M%S)
+CORE_TYPE=
+POLICIES=
+SKIP_ALONE=0
+
+usage() {
+	echo "usage: run_bench.sh [-c command_file] [-o result_dir] [-t core_type_config] [-p \"policy ...\"] [-a alone.tsv]"
+	echo "  -c: command file (default: bench.comm)"
+	echo "  -o: directory to save the results (default: results/<date>)"
+	echo "  -t: core type configuration passed to fairamp --type"
+	echo "  -p: policies to run (default: all predefined policies of fairamp)"
+	echo "  -a: reuse standalone times of a previous run"
+	echo "environment: FAIRAMP=path to the fairamp binary (default: fairamp)"
+	exit 1
+}
+
+while getopts "c:o:t:p:a:h" opt; do
+	case $opt in
+	c) COMM_FILE=$OPTARG ;;
+	o) RESULT_DIR=$OPTARG ;;
+	t) CORE_TYPE=$OPTARG ;;
+	p) POLICIES=$OPTARG ;;
+	a) ALONE_FILE=$OPTARG; SKIP_ALONE=1 ;;
+	*) usage ;;
+	esac
+done
+
+if [ "$(id -u)" != "0" ]; then
+	echo "ERROR! Please run as root!"
+	exit 1
+fi
+
+if ! command -v "$FAIRAMP" > /dev/null; then
+	echo "ERROR: $FAIRAMP is not found. Install tools/fairamp or set FAIRAMP."
+	exit 1
+fi
+
+if [ ! -x "$BENCH_DIR/workload" ]; then
+	make -C "$BENCH_DIR" > /dev/null || exit 1
+fi
+
+mkdir -p "$RESULT_DIR/output" || exit 1
+COMM_FILE=$(cd "$(dirname "$COMM_FILE")" && pwd)/$(basename "$COMM_FILE")
+
+# the policy list printed by 'fairamp -h' follows predefined_policies[]
+if [ -z "$POLICIES" ]; then
+	POLICIES=$("$FAIRAMP" -h 2> /dev/null | sed -n 's/^policy: //p' | head -1)
+	if [ -z "$POLICIES" ]; then
+		echo "ERROR: failed to get the predefined policies from $FAIRAMP -h"
+		exit 1
+	fi
+fi
+
+# the unaware baseline always runs once as "baseline", not again as a policy;
+# aliases in predefined_policies[] share a set_round_slice function, so each
+# runs once under its first name
+POLICIES=$(for policy in $POLICIES; do
+	case $policy in
+	unaware) ;;
+	max-perf) echo max_throughput ;;
+	max-fair) echo complete_fair ;;
+	*) echo "$policy" ;;
+	esac
+done | awk '!seen[$0]++' | tr '\n' ' ')
+
+# run_fairamp <name> <comm_file> <mode> [policy]
+run_fairamp() {
+	local name=$1 comm=$2 mode=$3 policy=$4
+	local args="--comm $comm --mode $mode --output $RESULT_DIR/output/$name.output --result $RESULT_DIR/$name.tsv"
+
+	[ -n "$policy" ] && args="$args --policy $policy"
+	[ -n "$CORE_TYPE" ] && args="$args --type $CORE_TYPE"
+
+	echo "== $name (mode: $mode${policy:+ policy: $policy})"
+	# commands are given relative to the bench directory
+	(cd "$BENCH_DIR" && "$FAIRAMP" $args > "$RESULT_DIR/output/$name.log" 2>&1)
+	if [ ! -s "$RESULT_DIR/$name.tsv" ]; then
+		echo "ERROR: fairamp failed. see $RESULT_DIR/output/$name.log"
+		return 1
+	fi
+}
+
+# 1. standalone runs: one command at a time, no sharing
+if [ $SKIP_ALONE -eq 0 ]; then
+	ALONE_FILE=$RESULT_DIR/alone.tsv
+	: > "$ALONE_FILE"
+	id=0
+	grep -v '^#' "$COMM_FILE" | grep -v '^[[:space:]]*$' | while read -r line; do
+		echo "$line" > "$RESULT_DIR/output/alone.$id.comm"
+		run_fairamp "alone.$id" "$RESULT_DIR/output/alone.$id.comm" unaware unaware || exit 1
+		awk -F'\t' -v id=$id '!/^#/ { print id "\t" $7 }' "$RESULT_DIR/alone.$id.tsv" >> "$ALONE_FILE"
+		rm -f "$RESULT_DIR/alone.$id.tsv"
+		id=$((id + 1))
+	done || exit 1
+elif [ "$ALONE_FILE" != "$RESULT_DIR/alone.tsv" ]; then
+	cp "$ALONE_FILE" "$RESULT_DIR/alone.tsv" || exit 1
+	ALONE_FILE=$RESULT_DIR/alone.tsv
+fi
+
+# 2. shared runs: the unaware baseline and every policy
+run_fairamp baseline "$COMM_FILE" unaware unaware
+for policy in $POLICIES; do
+	run_fairamp "$policy" "$COMM_FILE" normal "$policy"
+done
+
+# 3. metrics
+echo "policy,id,name,t_alone,t_shared,slowdown" > "$RESULT_DIR/apps.csv"
+echo "policy,mode,stp,antt,minF,uniformity" > "$RESULT_DIR/summary.csv"
+
+for name in baseline $POLICIES; do
+	tsv=$RESULT_DIR/$name.tsv
+	[ -s "$tsv" ] || continue
+	mode=normal
+	[ "$name" = baseline ] && mode=unaware
+
+	awk -F'\t' -v policy="$name" -v mode="$mode" \
+		-v apps="$RESULT_DIR/apps.csv" -v summary="$RESULT_DIR/summary.csv" '
+	FNR == NR { alone[$1] = $2; next }
+	/^#/ { next }
+	{
+		id = $1; t = $7; name = $8
+		gsub(/"/, "", name)
+		if (t <= 0 || alone[id] <= 0) {
+			printf "%s,%d,\"%s\",%.6f,%.6f,NaN\n", policy, id, name, alone[id], t >> apps
+			failed = 1
+			next
+		}
+		slowdown = t / alone[id]
+		np = 1 / slowdown
+		printf "%s,%d,\"%s\",%.6f,%.6f,%.6f\n", policy, id, name, alone[id], t, slowdown >> apps
+
+		n++
+		stp += np
+		antt += slowdown
+		sq += np * np
+		if (n == 1 || np < min) min = np
+		if (n == 1 || np > max) max = np
+	}
+	END {
+		if (failed || n == 0) {
+			printf "%s,%s,NaN,NaN,NaN,NaN\n", policy, mode >> summary
+			exit
+		}
+		avg = stp / n
+		var = sq / n - avg * avg
+		uni = (var > 0) ? 1 - sqrt(var) / avg : 1
+		printf "%s,%s,%.6f,%.6f,%.6f,%.6f\n", policy, mode, stp, antt / n, min / max, uni >> summary
+	}' "$ALONE_FILE" "$tsv"
+done
+
+echo
+column -s, -t < "$RESULT_DIR/summary.csv" 2> /dev/null || cat "$RESULT_DIR/summary.csv"
+echo
+echo "results: $RESULT_DIR"
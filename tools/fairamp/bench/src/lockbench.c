@@ -0,0 +1,177 @@
+/*
+ * lockbench.c - lock contention microbenchmark for FAIRAMP lock boosting
+ *
+ * Threads repeatedly take one shared lock, run a critical section of a
+ * fixed amount of work, release the lock and run some work outside of it.
+ * When the holder runs on a slow core, every waiter waits for the slow core,
+ * so the critical-section throughput shows how long locks are held.
+ *
+ * The lock is a PTHREAD_PRIO_INHERIT mutex by default, which is a PI futex
+ * in the kernel, so the owner is known to the waiters and the kernel can
+ * boost it (CONFIG_FAIRAMP_LOCK_BOOST). Compare the throughput with
+ *   # echo 0 > /proc/sys/kernel/sched_fairamp_lock_boost_us
+ * to see the effect of the boost. -P 0 uses a normal mutex, whose owner is
+ * unknown to the kernel.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#define TIME_DIFF(B,E) ((E.tv_sec - B.tv_sec) + (E.tv_usec - B.tv_usec)*0.000001)
+
+/* default value */
+#define DEFAULT_THREADS   4
+#define DEFAULT_SECONDS  10
+#define DEFAULT_CS_WORK  20000 /* iterations in the critical section */
+#define DEFAULT_NCS_WORK 20000 /* iterations outside the critical section */
+
+struct option_values {
+	int num_threads;
+	int seconds;
+	unsigned long cs_work;
+	unsigned long ncs_work;
+	int pi;
+} opt = {DEFAULT_THREADS, DEFAULT_SECONDS, DEFAULT_CS_WORK, DEFAULT_NCS_WORK, 1};
+
+static pthread_mutex_t lock;
+static volatile int stop;
+static unsigned long shared_sum; /* protected by lock */
+
+struct thread_data {
+	pthread_t thread;
+	unsigned long seed;
+	unsigned long count; /* critical sections done */
+} __attribute__((aligned(64)));
+
+/* register-only loop, same as cpu_kernel() of workload.c */
+static unsigned long work(unsigned long iters, unsigned long seed)
+{
+	unsigned long x = seed | 1;
+	unsigned long i;
+
+	for (i = 0; i < iters; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+	}
+	return x;
+}
+
+static void *lock_thread(void *data)
+{
+	struct thread_data *td = (struct thread_data *)data;
+	unsigned long x = td->seed;
+
+	while (!stop) {
+		pthread_mutex_lock(&lock);
+		shared_sum += work(opt.cs_work, shared_sum);
+		pthread_mutex_unlock(&lock);
+
+		x = work(opt.ncs_work, x);
+		td->count++;
+	}
+	return (void *)x;
+}
+
+static void usage(void)
+{
+	printf("usage: lockbench -t [num_threads] -s [seconds] -c [cs_work] -n [ncs_work] -P [0|1]\n");
+	printf("num_threads: the number of contending threads (default: %d)\n", DEFAULT_THREADS);
+	printf("seconds: duration of the run (default: %d)\n", DEFAULT_SECONDS);
+	printf("cs_work: iterations in the critical section (default: %d)\n", DEFAULT_CS_WORK);
+	printf("ncs_work: iterations outside the critical section (default: %d)\n", DEFAULT_NCS_WORK);
+	printf("P: 1 for a priority inheritance (PI futex) mutex, 0 for a normal mutex (default: 1)\n");
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct thread_data *threads;
+	pthread_mutexattr_t attr;
+	struct timeval begin, end;
+	unsigned long total = 0, min = ~0UL, max = 0;
+	double elapsed;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "t:s:c:n:P:h")) != -1) {
+		switch (c) {
+		case 't':
+			opt.num_threads = atoi(optarg);
+			break;
+		case 's':
+			opt.seconds = atoi(optarg);
+			break;
+		case 'c':
+			opt.cs_work = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			opt.ncs_work = strtoul(optarg, NULL, 10);
+			break;
+		case 'P':
+			opt.pi = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+		}
+	}
+
+	if (opt.num_threads <= 0 || opt.seconds <= 0) {
+		fprintf(stderr, "error: invalid options\n");
+		usage();
+	}
+
+	pthread_mutexattr_init(&attr);
+	if (opt.pi && pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT) != 0) {
+		fprintf(stderr, "error: PTHREAD_PRIO_INHERIT is not supported\n");
+		exit(-1);
+	}
+	pthread_mutex_init(&lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	threads = (struct thread_data *)calloc(opt.num_threads, sizeof(struct thread_data));
+	if (!threads) {
+		fprintf(stderr, "error: memory allocation failed\n");
+		exit(-1);
+	}
+
+	gettimeofday(&begin, 0);
+	for (i = 0; i < opt.num_threads; i++) {
+		threads[i].seed = i + 1;
+		if (pthread_create(&threads[i].thread, NULL, lock_thread, &threads[i]) != 0) {
+			fprintf(stderr, "error: pthread_create failed\n");
+			exit(-1);
+		}
+	}
+	sleep(opt.seconds);
+	stop = 1;
+	for (i = 0; i < opt.num_threads; i++)
+		pthread_join(threads[i].thread, NULL);
+	gettimeofday(&end, 0);
+	elapsed = TIME_DIFF(begin, end);
+
+	for (i = 0; i < opt.num_threads; i++) {
+		total += threads[i].count;
+		if (threads[i].count < min)
+			min = threads[i].count;
+		if (threads[i].count > max)
+			max = threads[i].count;
+		printf("thread %d: %lu critical sections\n", i, threads[i].count);
+	}
+
+	/* min/max shows whether some threads starve behind the others */
+	printf("lock: %s threads: %d time: %.3f throughput: %.1f cs/s min/max: %.3f checksum: %lx\n",
+			opt.pi ? "pi" : "normal", opt.num_threads, elapsed, total / elapsed,
+			max ? (double)min / max : 0.0, shared_sum);
+
+	pthread_mutex_destroy(&lock);
+	free(threads);
+	return 0;
+}
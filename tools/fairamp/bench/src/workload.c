@@ -0,0 +1,319 @@
+/*
+ * workload.c - synthetic kernels with known speedup profiles for FAIRAMP
+ *
+ * Each kernel stresses a different part of the core so that its fast-core
+ * speedup is predictable:
+ *   cpu   - register-only integer/floating point loop.
+ *           Scales with the core frequency (highest speedup).
+ *   mem   - dependent loads over a randomly permuted buffer larger than LLC.
+ *           Bound by memory latency (speedup close to 1).
+ *   mixed - alternates cpu and mem phases, so the speedup changes over time.
+ *   io    - short cpu bursts separated by sleeps, like a thread blocking on I/O.
+ *   mt    - several cpu threads meeting at a barrier after every chunk,
+ *           so the slowest thread decides the progress.
+ *
+ * The program prints the elapsed time and a checksum (to keep the compiler
+ * from removing the work) on stdout.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define TIME_DIFF(B,E) ((E.tv_sec - B.tv_sec) + (E.tv_usec - B.tv_usec)*0.000001)
+
+#define MILLION 1000000UL
+#define CACHE_LINE 64
+
+/* default value */
+#define DEFAULT_WORK     2000 /* millions of iterations */
+#define DEFAULT_MEM_MB    256
+#define DEFAULT_THREADS     2
+#define DEFAULT_PHASES     16
+#define DEFAULT_SLEEP_US 5000
+
+struct option_values {
+	char *kernel;
+	unsigned long work;     /* millions of iterations */
+	unsigned long mem_mb;   /* working set of mem and mixed */
+	int num_threads;        /* for mt */
+	int num_phases;         /* for mixed */
+	unsigned long sleep_us; /* for io */
+} opt = {"cpu", DEFAULT_WORK, DEFAULT_MEM_MB, DEFAULT_THREADS, DEFAULT_PHASES, DEFAULT_SLEEP_US};
+
+/* ======================= */
+/* kernels                 */
+/* ======================= */
+
+/* register-only loop: xorshift and a dependent floating point chain */
+static unsigned long cpu_kernel(unsigned long iters, unsigned long seed)
+{
+	unsigned long x = seed | 1;
+	double f = 1.0;
+	unsigned long i;
+
+	for (i = 0; i < iters; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		f = f * 1.0000001 + (double)(x & 0xff) * 1e-9;
+	}
+	return x + (unsigned long)f;
+}
+
+struct chase_buffer {
+	unsigned long *next; /* next[i] is the index of the cache line visited after i */
+	unsigned long num_lines;
+	unsigned long pos;
+};
+
+/* build a single random cycle over all cache lines (Sattolo's algorithm) */
+static int init_chase_buffer(struct chase_buffer *buf, unsigned long mem_mb)
+{
+	unsigned long stride = CACHE_LINE / sizeof(unsigned long);
+	unsigned long *perm;
+	unsigned long i, j, tmp;
+
+	buf->num_lines = mem_mb * 1024 * 1024 / CACHE_LINE;
+	if (buf->num_lines < 2)
+		buf->num_lines = 2;
+	buf->next = (unsigned long *)malloc(buf->num_lines * CACHE_LINE);
+	perm = (unsigned long *)malloc(buf->num_lines * sizeof(unsigned long));
+	if (!buf->next || !perm) {
+		free(buf->next);
+		free(perm);
+		return -1;
+	}
+
+	for (i = 0; i < buf->num_lines; i++)
+		perm[i] = i;
+	srand(1);
+	for (i = buf->num_lines - 1; i > 0; i--) {
+		j = (unsigned long)rand() % i;
+		tmp = perm[i];
+		perm[i] = perm[j];
+		perm[j] = tmp;
+	}
+	for (i = 0; i < buf->num_lines; i++)
+		buf->next[perm[i] * stride] = perm[(i + 1) % buf->num_lines] * stride;
+
+	free(perm);
+	buf->pos = 0;
+	return 0;
+}
+
+/* dependent loads: every load misses in the cache once the buffer exceeds LLC */
+static unsigned long mem_kernel(struct chase_buffer *buf, unsigned long iters)
+{
+	unsigned long pos = buf->pos;
+	unsigned long i;
+
+	for (i = 0; i < iters; i++)
+		pos = buf->next[pos];
+	buf->pos = pos;
+	return pos;
+}
+
+static unsigned long run_cpu(void)
+{
+	return cpu_kernel(opt.work * MILLION, 1);
+}
+
+/* memory accesses are much slower than the alu loop, so do 1/16 of the iterations */
+#define MEM_ITERS(work) ((work) * MILLION / 16)
+
+static unsigned long run_mem(void)
+{
+	struct chase_buffer buf;
+	unsigned long sum;
+
+	if (init_chase_buffer(&buf, opt.mem_mb)) {
+		fprintf(stderr, "error: memory allocation failed\n");
+		exit(-1);
+	}
+	sum = mem_kernel(&buf, MEM_ITERS(opt.work));
+	free(buf.next);
+	return sum;
+}
+
+static unsigned long run_mixed(void)
+{
+	struct chase_buffer buf;
+	unsigned long per_phase = opt.work / opt.num_phases;
+	unsigned long sum = 0;
+	int i;
+
+	if (init_chase_buffer(&buf, opt.mem_mb)) {
+		fprintf(stderr, "error: memory allocation failed\n");
+		exit(-1);
+	}
+	for (i = 0; i < opt.num_phases; i++) {
+		/* each phase does half of the work of the pure kernels */
+		if (i % 2 == 0)
+			sum += cpu_kernel(per_phase * MILLION, i + 1);
+		else
+			sum += mem_kernel(&buf, MEM_ITERS(per_phase));
+	}
+	free(buf.next);
+	return sum;
+}
+
+/* 1M iterations of cpu_kernel() between two sleeps */
+#define IO_BURST MILLION
+
+static unsigned long run_io(void)
+{
+	struct timespec ts = {opt.sleep_us / MILLION, (opt.sleep_us % MILLION) * 1000};
+	unsigned long bursts = opt.work * MILLION / IO_BURST;
+	unsigned long sum = 0;
+	unsigned long i;
+
+	/* io kernel spends most of the time blocked, so run 1/10 of the bursts */
+	bursts /= 10;
+	for (i = 0; i < bursts; i++) {
+		sum += cpu_kernel(IO_BURST, i + 1);
+		nanosleep(&ts, NULL);
+	}
+	return sum;
+}
+
+/* chunks per thread in mt: threads meet at the barrier after each chunk */
+#define MT_CHUNKS 64
+
+static pthread_barrier_t mt_barrier;
+
+static void *mt_thread(void *data)
+{
+	unsigned long seed = (unsigned long)data;
+	unsigned long per_chunk = opt.work * MILLION / MT_CHUNKS;
+	unsigned long sum = 0;
+	int i;
+
+	for (i = 0; i < MT_CHUNKS; i++) {
+		sum += cpu_kernel(per_chunk, seed + i);
+		pthread_barrier_wait(&mt_barrier);
+	}
+	return (void *)sum;
+}
+
+static unsigned long run_mt(void)
+{
+	pthread_t *threads;
+	unsigned long sum = 0;
+	void *ret;
+	int i;
+
+	threads = (pthread_t *)calloc(opt.num_threads, sizeof(pthread_t));
+	if (!threads) {
+		fprintf(stderr, "error: memory allocation failed\n");
+		exit(-1);
+	}
+	pthread_barrier_init(&mt_barrier, NULL, opt.num_threads);
+	for (i = 0; i < opt.num_threads; i++) {
+		if (pthread_create(&threads[i], NULL, mt_thread, (void *)(unsigned long)(i + 1)) != 0) {
+			fprintf(stderr, "error: pthread_create failed\n");
+			exit(-1);
+		}
+	}
+	for (i = 0; i < opt.num_threads; i++) {
+		pthread_join(threads[i], &ret);
+		sum += (unsigned long)ret;
+	}
+	pthread_barrier_destroy(&mt_barrier);
+	free(threads);
+	return sum;
+}
+
+static struct kernel {
+	char *name;
+	unsigned long (*func)(void);
+} kernels[] = {
+	{ "cpu",   run_cpu },
+	{ "mem",   run_mem },
+	{ "mixed", run_mixed },
+	{ "io",    run_io },
+	{ "mt",    run_mt },
+	{ NULL,    NULL },
+};
+
+/* ====================== */
+/* main() function        */
+/* ====================== */
+
+static void usage(void)
+{
+	int i;
+
+	printf("usage: workload -k [kernel] -n [work] -m [mem_mb] -t [num_threads] -p [num_phases] -s [sleep_us]\n");
+	printf("kernel:");
+	for (i = 0; kernels[i].name; i++)
+		printf(" %s", kernels[i].name);
+	printf(" (default: %s)\n", opt.kernel);
+	printf("work: millions of iterations (default: %d)\n", DEFAULT_WORK);
+	printf("mem_mb: working set of mem and mixed in MB (default: %d)\n", DEFAULT_MEM_MB);
+	printf("num_threads: the number of threads of mt (default: %d)\n", DEFAULT_THREADS);
+	printf("num_phases: the number of cpu/mem phases of mixed (default: %d)\n", DEFAULT_PHASES);
+	printf("sleep_us: sleep time between bursts of io in usec (default: %d)\n", DEFAULT_SLEEP_US);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct timeval begin, end;
+	struct kernel *kernel = NULL;
+	unsigned long sum;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "k:n:m:t:p:s:h")) != -1) {
+		switch (c) {
+		case 'k':
+			opt.kernel = optarg;
+			break;
+		case 'n':
+			opt.work = strtoul(optarg, NULL, 10);
+			break;
+		case 'm':
+			opt.mem_mb = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			opt.num_threads = atoi(optarg);
+			break;
+		case 'p':
+			opt.num_phases = atoi(optarg);
+			break;
+		case 's':
+			opt.sleep_us = strtoul(optarg, NULL, 10);
+			break;
+		case 'h':
+		default:
+			usage();
+		}
+	}
+
+	for (i = 0; kernels[i].name; i++) {
+		if (strcmp(opt.kernel, kernels[i].name) == 0) {
+			kernel = &kernels[i];
+			break;
+		}
+	}
+
+	if (!kernel || opt.work == 0 || opt.num_threads <= 0 || opt.num_phases <= 0) {
+		fprintf(stderr, "error: invalid options\n");
+		usage();
+	}
+
+	gettimeofday(&begin, 0);
+	sum = kernel->func();
+	gettimeofday(&end, 0);
+
+	printf("kernel: %s work: %lu time: %.3f checksum: %lx\n",
+			kernel->name, opt.work, TIME_DIFF(begin, end), sum);
+	return 0;
+}
@@ -40,6 +40,9 @@ int measuring_IPS_type_started = 0;
 /* variable used by main() and the signal handler */
 char *output_filename;
 
+/* machine-readable timings of the commands (NULL if not requested) */
+char *result_filename = NULL;
+
 /* mask the available cpus for the configuration */
 cpu_set_t __cpumask;
 cpu_set_t *cpumask = &__cpumask;
@@ -52,6 +55,7 @@ static void set_mask_str(char *mask_str, cpu_set_t *mask);
 static void usage_comm_file(void);
 static void free_command(struct command *command, int num_comm);
 static int check_output_filename(const char *output_filename);
+static int save_results(const char *result_filename, struct command *command, int num_comm);
 
 /* definitions of cleanup functions */
 static void kill_remaining_commands(int __running);
@@ -436,12 +440,13 @@ int get_options(int argc, char *const *argv,
 		{"mode", required_argument, NULL, 'm'},
 		{"ftrace", required_argument, NULL, 'f'},
 		{"interval", required_argument, NULL, 'i'},
+		{"result", required_argument, NULL, 'r'},
 		{0, 0, 0, 0}
 	};
 	int option_index = 0;
 	int c;
 	
-	while ((c = getopt_long(argc, argv, "t:p:c:o:m:f:i:hs", long_options, &option_index)) != -1) {
+	while ((c = getopt_long(argc, argv, "t:p:c:o:m:f:i:r:hs", long_options, &option_index)) != -1) {
 		switch(c) {
 		case 't':
 			/* parse core configuration */
@@ -479,6 +484,9 @@ int get_options(int argc, char *const *argv,
 			if (interval_given < 0)
 				return -1;
 			break;
+		case 'r':
+			result_filename = optarg;
+			break;
 		case 0:
 			/* If this option set a flag, do nothing else now. */
 			if (long_options[option_index].flag != NULL)
@@ -539,6 +547,8 @@ int get_options(int argc, char *const *argv,
 	printf("sched_policy: %s\n", get_sched_policy_name());
 	printf("comm_file: %s\n", *comm_filename);
 	printf("output_file: %s\n", *output_filename);
+	if (result_filename)
+		printf("result_file: %s\n", result_filename);
 	if (opt_ignore_effi)
 		printf("efficiency setting will be ignored.\n");
 	return 0;
@@ -577,6 +587,7 @@ static void usage(void) {
 		   "Additional options\n"
 		   "--ftrace=[ftrace file name] or -f [ftrace file name]: save the trace for scheduling context switch information\n"
 		   "--interval=[time in ms] or -i [time in ms]: set the scheduling interval in miniseconds (defautl: 2000ms)\n"
+		   "--result=[result file name] or -r [result file name]: save the timings of the commands as tab-separated values\n"
 		   "\n");
 
 
@@ -818,6 +829,8 @@ finished_task:
 	/* show the final results */
 	sort_by_num(command, num_comm);
 	print_commands(command, num_comm);
+	if (result_filename)
+		save_results(result_filename, command, num_comm);
 	
 	close_temp_outputs();
 	merge_temp_outputs(output_filename);
@@ -982,6 +995,35 @@ error_no_filename:
 	goto end;
 }
 
+/* save the timings of the commands for scripts, e.g., bench/run_bench.sh
+ * one line per command, tab-separated. time is -1 if the command is not finished.
+ */
+static int save_results(const char *result_filename, struct command *command, int num_comm) {
+	int i;
+	FILE *fp = fopen(result_filename, "w");
+
+	if (!fp) {
+		pr_err("ERROR: while opening %s to save the results\n", result_filename);
+		return -1;
+	}
+
+	fprintf(fp, "# policy: %s mode: %s\n", get_sched_policy_name(), mode_name);
+	fprintf(fp, "# id\tspeedup\tnum_threads\tfast_round_slice\tslow_round_slice\tstatus\ttime\tname\n");
+	for (i = 0; i < num_comm; i++) {
+		fprintf(fp, "%d\t%.3f\t%d\t%u\t%u\t%d\t%.6f\t%s\n",
+				command[i].num,
+				command[i].speedup,
+				command[i].num_threads,
+				command[i].round_slice.fast,
+				command[i].round_slice.slow,
+				command[i].finished ? WEXITSTATUS(command[i].status) : -1,
+				command[i].finished ? TIME_DIFF(command[i].begin, command[i].end) : -1,
+				command[i].name);
+	}
+	fclose(fp);
+	return 0;
+}
+
 static void close_temp_outputs() {
 	int i;
 
@@ -0,0 +1,286 @@
+/*
+ *
+ * aio-rw.c
+ *
+ * rw: Benchmark for io_submit()/io_getevents()
+ *
+ * Every thread owns an aio context and keeps --depth random reads (or
+ * writes) of --bs bytes in flight on the target, like fio with the libaio
+ * engine. --contexts idle contexts are set up per thread on top of it, as
+ * a process with one context per I/O thread has, so the cost of finding
+ * the context on every system call shows up. Use a ramdisk or a loop
+ * device on tmpfs to keep the device out of the way.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/aio_abi.h>
+
+static const char *filename;
+static unsigned int nthreads = 1;
+static unsigned int ncontexts = 16;
+static unsigned int depth = 32;
+static unsigned int bs = 4096;
+static unsigned int nsecs = 10;
+static bool do_write = false;
+static bool buffered = false;
+static bool compressible = false;
+
+static int fd;
+static unsigned long long nblocks;
+static volatile int done;
+
+struct worker {
+	pthread_t thread;
+	unsigned int seed;
+	unsigned long long ios;
+	unsigned long long getevents;	/* io_getevents() calls */
+};
+
+static const struct option options[] = {
+	OPT_STRING('f', "file", &filename, "file",
+		   "Specify the file or block device to do I/O on"),
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads, each with its own context"),
+	OPT_UINTEGER('c', "contexts", &ncontexts,
+		     "Specify number of extra idle contexts per thread"),
+	OPT_UINTEGER('d', "depth", &depth,
+		     "Specify number of I/Os in flight per thread"),
+	OPT_UINTEGER('b', "bs", &bs,
+		     "Specify block size in bytes"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime (in seconds)"),
+	OPT_BOOLEAN('w', "write", &do_write,
+		    "Do writes instead of reads"),
+	OPT_BOOLEAN('B', "buffered", &buffered,
+		    "Do not open the target with O_DIRECT"),
+	OPT_BOOLEAN('z', "compressible", &compressible,
+		    "Write blocks that compress about 2:1 (half random bytes)"),
+	OPT_END()
+};
+
+static const char * const bench_aio_rw_usage[] = {
+	"perf bench aio rw -f <file> <options>",
+	NULL
+};
+
+static inline int io_setup(unsigned nr, aio_context_t *ctxp)
+{
+	return syscall(__NR_io_setup, nr, ctxp);
+}
+
+static inline int io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static inline int io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static inline int io_getevents(aio_context_t ctx, long min_nr, long nr,
+			       struct io_event *events, struct timespec *timeout)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, timeout);
+}
+
+static void prep_iocb(struct iocb *cb, void *buf, unsigned int *seed)
+{
+	unsigned long long block = ((unsigned long long)rand_r(seed) << 31 |
+				    rand_r(seed)) % nblocks;
+
+	cb->aio_fildes = fd;
+	cb->aio_lio_opcode = do_write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+	cb->aio_buf = (unsigned long)buf;
+	cb->aio_nbytes = bs;
+	cb->aio_offset = block * bs;
+}
+
+/*
+ * The first half of every block is random, the second half the 0x5a
+ * filler, so a compressing target such as zram has real work to do
+ * instead of storing a run of one byte.
+ */
+static void fill_compressible(char *bufs, size_t len, unsigned int *seed)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		if (i % bs < bs / 2)
+			bufs[i] = rand_r(seed);
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = arg;
+	aio_context_t ctx = 0, *idle;
+	struct iocb *cbs, **cbp;
+	struct io_event *events;
+	char *bufs;
+	unsigned int i;
+	int ret;
+
+	idle = calloc(ncontexts, sizeof(*idle));
+	cbs = calloc(depth, sizeof(*cbs));
+	cbp = calloc(depth, sizeof(*cbp));
+	events = calloc(depth, sizeof(*events));
+	BUG_ON(!idle || !cbs || !cbp || !events);
+	BUG_ON(posix_memalign((void **)&bufs, 4096, (size_t)depth * bs));
+	memset(bufs, 0x5a, (size_t)depth * bs);
+	if (compressible)
+		fill_compressible(bufs, (size_t)depth * bs, &w->seed);
+
+	for (i = 0; i < ncontexts; i++)
+		if (io_setup(1, &idle[i]))
+			die("io_setup: %s\n", strerror(errno));
+	if (io_setup(depth, &ctx))
+		die("io_setup: %s\n", strerror(errno));
+
+	for (i = 0; i < depth; i++) {
+		prep_iocb(&cbs[i], bufs + (size_t)i * bs, &w->seed);
+		cbs[i].aio_data = i;
+		cbp[i] = &cbs[i];
+	}
+	if (io_submit(ctx, depth, cbp) != (int)depth)
+		die("io_submit: %s\n", strerror(errno));
+
+	while (!done) {
+		ret = io_getevents(ctx, 1, depth, events, NULL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			die("io_getevents: %s\n", strerror(errno));
+		}
+		w->getevents++;
+
+		/* resubmit every completed iocb in one call */
+		for (i = 0; i < (unsigned int)ret; i++) {
+			struct iocb *cb = &cbs[events[i].data];
+
+			if ((long)events[i].res != (long)bs)
+				die("I/O failed: %s\n", strerror(-(long)events[i].res));
+			prep_iocb(cb, (void *)(unsigned long)cb->aio_buf, &w->seed);
+			cbp[i] = cb;
+		}
+		w->ios += ret;
+		if (io_submit(ctx, ret, cbp) != ret)
+			die("io_submit: %s\n", strerror(errno));
+	}
+
+	/* io_destroy() waits for the I/Os still in flight */
+	io_destroy(ctx);
+	for (i = 0; i < ncontexts; i++)
+		io_destroy(idle[i]);
+
+	free(bufs);
+	free(events);
+	free(cbp);
+	free(cbs);
+	free(idle);
+	return NULL;
+}
+
+int bench_aio_rw(int argc, const char **argv,
+		 const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	unsigned long long ios = 0, getevents = 0, size;
+	struct worker *workers;
+	struct stat st;
+	unsigned int i;
+	double secs;
+
+	argc = parse_options(argc, argv, options, bench_aio_rw_usage, 0);
+	if (argc || !nthreads || !depth || !bs || !nsecs)
+		usage_with_options(bench_aio_rw_usage, options);
+
+	/* not an error for 'perf bench all', which gives no options */
+	if (!filename) {
+		fprintf(stderr, "aio rw needs a target, specify it with -f\n");
+		return 1;
+	}
+
+	fd = open(filename, (do_write ? O_RDWR : O_RDONLY) |
+		  (buffered ? 0 : O_DIRECT));
+	if (fd < 0)
+		die("%s: %s\n", filename, strerror(errno));
+
+	BUG_ON(fstat(fd, &st));
+	if (S_ISBLK(st.st_mode))
+		BUG_ON(ioctl(fd, BLKGETSIZE64, &size));
+	else
+		size = st.st_size;
+	nblocks = size / bs;
+	if (!nblocks)
+		die("%s is smaller than a block\n", filename);
+
+	workers = calloc(nthreads, sizeof(*workers));
+	BUG_ON(!workers);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads; i++) {
+		workers[i].seed = i + 1;
+		BUG_ON(pthread_create(&workers[i].thread, NULL, workerfn, &workers[i]));
+	}
+
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		BUG_ON(pthread_join(workers[i].thread, NULL));
+		ios += workers[i].ios;
+		getevents += workers[i].getevents;
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+	close(fd);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads doing %s %u byte %ss at depth %u on %s\n",
+		       nthreads, buffered ? "buffered" : "direct", bs,
+		       do_write ? "write" : "read", depth, filename);
+		if (do_write && compressible)
+			printf("# blocks compress about 2:1\n");
+		printf("# %u idle contexts per thread\n\n", ncontexts);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0f IOPS\n", ios / secs);
+		printf(" %14.1f MB/sec\n", ios * bs / secs / (1 << 20));
+		printf(" %14.2f events per io_getevents()\n",
+		       getevents ? (double)ios / getevents : 0.0);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f\n", ios / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(workers);
+	return 0;
+}
@@ -6,6 +6,18 @@ extern int bench_sched_pipe(int argc, const char **argv, const char *prefix);
 extern int bench_mem_memcpy(int argc, const char **argv,
 			    const char *prefix __maybe_unused);
 extern int bench_mem_memset(int argc, const char **argv, const char *prefix);
+extern int bench_mem_reclaim(int argc, const char **argv, const char *prefix);
+extern int bench_mem_swap(int argc, const char **argv, const char *prefix);
+extern int bench_mem_sparse_read(int argc, const char **argv, const char *prefix);
+extern int bench_futex_hash(int argc, const char **argv, const char *prefix);
+extern int bench_futex_wake(int argc, const char **argv, const char *prefix);
+extern int bench_futex_requeue(int argc, const char **argv, const char *prefix);
+extern int bench_aio_rw(int argc, const char **argv, const char *prefix);
+extern int bench_epoll_wait(int argc, const char **argv, const char *prefix);
+extern int bench_ipc_sem(int argc, const char **argv, const char *prefix);
+extern int bench_net_accept(int argc, const char **argv, const char *prefix);
+extern int bench_net_churn(int argc, const char **argv, const char *prefix);
+extern int bench_fuse_read(int argc, const char **argv, const char *prefix);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
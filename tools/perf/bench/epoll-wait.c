@@ -0,0 +1,261 @@
+/*
+ *
+ * epoll-wait.c
+ *
+ * wait: Benchmark for epoll_wait() with many waiters
+ *
+ * --threads waiters wait on --fds eventfds, all in one epoll instance or,
+ * with --multiq, each in its own instance with all the fds added, the way
+ * servers with one accept loop per thread do. --writers threads write to
+ * random fds as fast as they can, so they run the epoll poll callback, and
+ * the waiters read the fds they get events for. A read that finds the fd
+ * drained already is a wasted wakeup: another waiter took the event.
+ *
+ * -P creates the instances with EPOLL_PERCPU, so the writers do not contend
+ * on the lock of the shared instance. -x adds the fds with EPOLLEXCLUSIVE,
+ * so a write wakes up one of the per-thread instances instead of all.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#ifndef EPOLL_PERCPU
+#define EPOLL_PERCPU	0x00000001
+#endif
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE	(1u << 28)
+#endif
+
+#define EPOLL_MAXEVENTS	64
+
+static unsigned int nthreads;
+static unsigned int nwriters = 1;
+static unsigned int nfds = 1024;
+static unsigned int nsecs = 10;
+static bool multiq = false;
+static bool exclusive = false;
+static bool percpu = false;
+static bool edge = false;
+
+static int *fds;
+static volatile int done;
+
+struct worker {
+	pthread_t thread;
+	int epfd;
+	unsigned int seed;
+	unsigned long long ops;		/* events read, or writes */
+	unsigned long long wakeups;	/* epoll_wait() returning events */
+	unsigned long long wasted;	/* reads finding nothing */
+} __attribute__((aligned(64)));
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of waiter threads (default: number of cpus)"),
+	OPT_UINTEGER('w', "writers", &nwriters,
+		     "Specify number of writer threads"),
+	OPT_UINTEGER('f', "fds", &nfds,
+		     "Specify number of eventfds"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime (in seconds)"),
+	OPT_BOOLEAN('m', "multiq", &multiq,
+		    "Use one epoll instance per waiter instead of a shared one"),
+	OPT_BOOLEAN('x', "exclusive", &exclusive,
+		    "Add the fds with EPOLLEXCLUSIVE (implies --multiq)"),
+	OPT_BOOLEAN('P', "percpu", &percpu,
+		    "Create the epoll instances with EPOLL_PERCPU"),
+	OPT_BOOLEAN('e', "edge", &edge,
+		    "Add the fds with EPOLLET"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wait_usage[] = {
+	"perf bench epoll wait <options>",
+	NULL
+};
+
+static int setup_epoll(void)
+{
+	struct epoll_event ev;
+	unsigned int i;
+	int epfd;
+
+	epfd = epoll_create1(percpu ? EPOLL_PERCPU : 0);
+	if (epfd < 0)
+		die("epoll_create1: %s\n", strerror(errno));
+
+	for (i = 0; i < nfds; i++) {
+		ev.events = EPOLLIN;
+		if (edge)
+			ev.events |= EPOLLET;
+		if (exclusive)
+			ev.events |= EPOLLEXCLUSIVE;
+		ev.data.fd = fds[i];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev))
+			die("epoll_ctl: %s\n", strerror(errno));
+	}
+	return epfd;
+}
+
+static void *waiterfn(void *arg)
+{
+	struct worker *w = arg;
+	struct epoll_event events[EPOLL_MAXEVENTS];
+	u_int64_t val;
+	int i, n;
+
+	while (!done) {
+		/* time out now and then to notice the end of the run */
+		n = epoll_wait(w->epfd, events, EPOLL_MAXEVENTS, 100);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			die("epoll_wait: %s\n", strerror(errno));
+		}
+		if (!n)
+			continue;
+		w->wakeups++;
+
+		for (i = 0; i < n; i++) {
+			if (read(events[i].data.fd, &val, sizeof(val)) == sizeof(val))
+				w->ops++;
+			else if (errno == EAGAIN)
+				w->wasted++;
+			else
+				die("read: %s\n", strerror(errno));
+		}
+	}
+	return NULL;
+}
+
+static void *writerfn(void *arg)
+{
+	struct worker *w = arg;
+	u_int64_t one = 1;
+
+	while (!done) {
+		if (write(fds[rand_r(&w->seed) % nfds], &one, sizeof(one)) < 0 &&
+		    errno != EAGAIN)
+			die("write: %s\n", strerror(errno));
+		w->ops++;
+	}
+	return NULL;
+}
+
+int bench_epoll_wait(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	unsigned long long reads = 0, writes = 0, wakeups = 0, wasted = 0;
+	struct worker *waiters, *writers;
+	unsigned int i;
+	int shared_epfd = -1;
+	double secs;
+
+	argc = parse_options(argc, argv, options, bench_epoll_wait_usage, 0);
+	if (argc)
+		usage_with_options(bench_epoll_wait_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nwriters || !nfds || !nsecs)
+		usage_with_options(bench_epoll_wait_usage, options);
+	if (exclusive)
+		multiq = true;
+
+	fds = calloc(nfds, sizeof(*fds));
+	waiters = calloc(nthreads, sizeof(*waiters));
+	writers = calloc(nwriters, sizeof(*writers));
+	BUG_ON(!fds || !waiters || !writers);
+
+	for (i = 0; i < nfds; i++) {
+		fds[i] = eventfd(0, EFD_NONBLOCK);
+		if (fds[i] < 0)
+			die("eventfd: %s\n", strerror(errno));
+	}
+
+	if (!multiq)
+		shared_epfd = setup_epoll();
+	for (i = 0; i < nthreads; i++)
+		waiters[i].epfd = multiq ? setup_epoll() : shared_epfd;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads; i++)
+		BUG_ON(pthread_create(&waiters[i].thread, NULL, waiterfn, &waiters[i]));
+	for (i = 0; i < nwriters; i++) {
+		writers[i].seed = i + 1;
+		BUG_ON(pthread_create(&writers[i].thread, NULL, writerfn, &writers[i]));
+	}
+
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < nwriters; i++) {
+		BUG_ON(pthread_join(writers[i].thread, NULL));
+		writes += writers[i].ops;
+	}
+	for (i = 0; i < nthreads; i++) {
+		BUG_ON(pthread_join(waiters[i].thread, NULL));
+		reads += waiters[i].ops;
+		wakeups += waiters[i].wakeups;
+		wasted += waiters[i].wasted;
+		if (multiq)
+			close(waiters[i].epfd);
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+
+	if (!multiq)
+		close(shared_epfd);
+	for (i = 0; i < nfds; i++)
+		close(fds[i]);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u waiters on %u %s%s eventfds in %s%s epoll instance%s, %u writer(s)\n\n",
+		       nthreads, nfds, edge ? "edge-triggered" : "level-triggered",
+		       exclusive ? " exclusive" : "", multiq ? "per-thread" : "one",
+		       percpu ? " per-cpu" : "", multiq ? "s" : "", nwriters);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0f writes/sec\n", writes / secs);
+		printf(" %14.0f events/sec\n", reads / secs);
+		printf(" %14.2f events per wakeup\n",
+		       wakeups ? (double)reads / wakeups : 0.0);
+		printf(" %14.2f%% wasted reads\n",
+		       reads + wasted ? 100.0 * wasted / (reads + wasted) : 0.0);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f\n", reads / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(writers);
+	free(waiters);
+	free(fds);
+	return 0;
+}
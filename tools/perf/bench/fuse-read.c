@@ -0,0 +1,446 @@
+/*
+ *
+ * fuse-read.c
+ *
+ * read: Benchmark for small random reads through a FUSE filesystem
+ *
+ * The benchmark mounts a minimal passthrough filesystem with one file and
+ * serves it itself: --threads daemon threads read the requests from
+ * /dev/fuse and answer the reads from --file, or from memory when no file
+ * is given. --readers threads do random --bs byte reads of the file, which
+ * is opened with direct I/O, so every read is a round trip to the daemon.
+ * Both kinds of threads are bound to the cpus round robin. With --clone
+ * every daemon thread clones its own /dev/fuse fd on its cpu, so it is
+ * woken up first for the requests submitted there. Needs root.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <linux/fuse.h>
+
+#ifndef FUSE_DEV_IOC_CLONE
+#define FUSE_DEV_IOC_CLONE	_IOR(229, 0, uint32_t)
+#endif
+
+#define FUSE_FILE_NAME	"file"
+#define FUSE_FILE_ID	2
+/* room for the largest request we can get, a write is never sent */
+#define FUSE_BUF_SIZE	(64 * 1024)
+
+static unsigned int nthreads;
+static unsigned int nreaders;
+static unsigned int bs = 4096;
+static unsigned int size_mb = 64;
+static unsigned int nsecs = 5;
+static const char *filename;
+static const char *mnt_str;
+static bool clone_dev = false;
+
+static int master_fd;
+static int backing_fd = -1;
+static char *backing_mem;
+static unsigned long long size;
+static unsigned int ncpus;
+static char mnt[PATH_MAX];
+static volatile int done;
+
+struct worker {
+	pthread_t thread;
+	unsigned int cpu;
+	unsigned int seed;
+	int fd;				/* device of a daemon thread */
+	unsigned long long ops;		/* requests served, or reads */
+} __attribute__((aligned(64)));
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of daemon threads (default: number of cpus)"),
+	OPT_UINTEGER('R', "readers", &nreaders,
+		     "Specify number of reader threads (default: number of cpus)"),
+	OPT_UINTEGER('b', "bs", &bs,
+		     "Specify read size in bytes"),
+	OPT_UINTEGER('s', "size", &size_mb,
+		     "Specify file size in MB, without --file"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime (in seconds)"),
+	OPT_STRING('f', "file", &filename, "file",
+		   "Specify the file to pass the reads through to"),
+	OPT_STRING('m', "mnt", &mnt_str, "dir",
+		   "Specify the mount point (default: a new directory in /tmp)"),
+	OPT_BOOLEAN('C', "clone", &clone_dev,
+		    "Give every daemon thread its own cloned /dev/fuse fd"),
+	OPT_END()
+};
+
+static const char * const bench_fuse_read_usage[] = {
+	"perf bench fuse read <options>",
+	NULL
+};
+
+static void bind_cpu(unsigned int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	BUG_ON(sched_setaffinity(0, sizeof(set), &set));
+}
+
+static void fill_attr(struct fuse_attr *attr, uint64_t nodeid)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = nodeid;
+	attr->nlink = 1;
+	if (nodeid == FUSE_ROOT_ID) {
+		attr->mode = S_IFDIR | 0755;
+		attr->nlink = 2;
+	} else {
+		attr->mode = S_IFREG | 0444;
+		attr->size = size;
+		attr->blocks = size / 512;
+	}
+}
+
+/* a request aborted by a signal gets ENOENT, that is fine */
+static void reply(int fd, struct fuse_in_header *in, int error,
+		  const void *arg, size_t len)
+{
+	struct fuse_out_header out = {
+		.len = sizeof(out) + (error ? 0 : len),
+		.error = error,
+		.unique = in->unique,
+	};
+	struct iovec iov[2] = {
+		{ .iov_base = &out, .iov_len = sizeof(out) },
+		{ .iov_base = (void *)arg, .iov_len = len },
+	};
+
+	if (writev(fd, iov, error ? 1 : 2) < 0 && errno != ENOENT)
+		die("writev: %s\n", strerror(errno));
+}
+
+static void do_init(int fd, struct fuse_in_header *in, struct fuse_init_in *arg)
+{
+	struct fuse_init_out out;
+
+	memset(&out, 0, sizeof(out));
+	out.major = FUSE_KERNEL_VERSION;
+	out.minor = arg->minor;
+	out.max_readahead = arg->max_readahead;
+	out.max_background = 16;
+	out.congestion_threshold = 12;
+	out.max_write = 4096;
+	/* the reply as of 7.13, which every kernel since then takes */
+	reply(fd, in, 0, &out, offsetof(struct fuse_init_out, max_write) +
+	      sizeof(out.max_write));
+}
+
+static void do_read(int fd, struct fuse_in_header *in, struct fuse_read_in *arg,
+		    char *buf)
+{
+	size_t len = arg->size;
+	ssize_t ret;
+
+	if (arg->offset >= size)
+		len = 0;
+	else if (arg->offset + len > size)
+		len = size - arg->offset;
+
+	if (backing_fd < 0) {
+		reply(fd, in, 0, backing_mem + arg->offset, len);
+		return;
+	}
+
+	ret = pread(backing_fd, buf, len, arg->offset);
+	if (ret < 0)
+		reply(fd, in, -errno, NULL, 0);
+	else
+		reply(fd, in, 0, buf, ret);
+}
+
+static void *daemonfn(void *arg)
+{
+	struct worker *w = arg;
+	struct fuse_in_header *in;
+	struct fuse_entry_out entry;
+	struct fuse_attr_out attr;
+	struct fuse_open_out open_out;
+	char *buf, *data;
+	ssize_t ret;
+	uint32_t oldfd = master_fd;
+
+	buf = malloc(FUSE_BUF_SIZE);
+	data = malloc(FUSE_BUF_SIZE);
+	BUG_ON(!buf || !data);
+	in = (struct fuse_in_header *)buf;
+
+	bind_cpu(w->cpu);
+	w->fd = master_fd;
+	if (clone_dev) {
+		w->fd = open("/dev/fuse", O_RDWR);
+		if (w->fd < 0)
+			die("/dev/fuse: %s\n", strerror(errno));
+		if (ioctl(w->fd, FUSE_DEV_IOC_CLONE, &oldfd))
+			die("FUSE_DEV_IOC_CLONE: %s\n", strerror(errno));
+	}
+
+	for (;;) {
+		ret = read(w->fd, buf, FUSE_BUF_SIZE);
+		if (ret < 0) {
+			/* ENODEV once unmounted at the end of the run */
+			if (errno == ENODEV)
+				break;
+			if (errno == EINTR || errno == ENOENT)
+				continue;
+			die("read: %s\n", strerror(errno));
+		}
+		BUG_ON(ret < (ssize_t)sizeof(*in));
+
+		switch (in->opcode) {
+		case FUSE_INIT:
+			do_init(w->fd, in, (struct fuse_init_in *)(in + 1));
+			break;
+
+		case FUSE_LOOKUP:
+			if (in->nodeid != FUSE_ROOT_ID ||
+			    strcmp((char *)(in + 1), FUSE_FILE_NAME)) {
+				reply(w->fd, in, -ENOENT, NULL, 0);
+				break;
+			}
+			memset(&entry, 0, sizeof(entry));
+			entry.nodeid = FUSE_FILE_ID;
+			entry.entry_valid = 3600;
+			entry.attr_valid = 3600;
+			fill_attr(&entry.attr, FUSE_FILE_ID);
+			reply(w->fd, in, 0, &entry, sizeof(entry));
+			break;
+
+		case FUSE_GETATTR:
+			memset(&attr, 0, sizeof(attr));
+			attr.attr_valid = 3600;
+			fill_attr(&attr.attr, in->nodeid);
+			reply(w->fd, in, 0, &attr, sizeof(attr));
+			break;
+
+		case FUSE_OPEN:
+			memset(&open_out, 0, sizeof(open_out));
+			/* keep the page cache out, every read comes here */
+			open_out.open_flags = FOPEN_DIRECT_IO;
+			reply(w->fd, in, 0, &open_out, sizeof(open_out));
+			break;
+
+		case FUSE_READ:
+			do_read(w->fd, in, (struct fuse_read_in *)(in + 1), data);
+			w->ops++;
+			break;
+
+		case FUSE_FLUSH:
+		case FUSE_RELEASE:
+			reply(w->fd, in, 0, NULL, 0);
+			break;
+
+		case FUSE_FORGET:
+		case FUSE_BATCH_FORGET:
+		case FUSE_INTERRUPT:
+			/* no reply */
+			break;
+
+		default:
+			reply(w->fd, in, -ENOSYS, NULL, 0);
+			break;
+		}
+	}
+
+	if (clone_dev)
+		close(w->fd);
+	free(data);
+	free(buf);
+	return NULL;
+}
+
+static void *readerfn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long long nblocks = size / bs;
+	char path[PATH_MAX + sizeof(FUSE_FILE_NAME)];
+	char *buf;
+	int fd;
+
+	buf = malloc(bs);
+	BUG_ON(!buf);
+	bind_cpu(w->cpu);
+
+	snprintf(path, sizeof(path), "%s/" FUSE_FILE_NAME, mnt);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		die("%s: %s\n", path, strerror(errno));
+
+	while (!done) {
+		unsigned long long block = ((unsigned long long)rand_r(&w->seed) << 31 |
+					    rand_r(&w->seed)) % nblocks;
+
+		if (pread(fd, buf, bs, block * bs) != (ssize_t)bs)
+			die("pread: %s\n", strerror(errno));
+		w->ops++;
+	}
+
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+int bench_fuse_read(int argc, const char **argv,
+		    const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	unsigned long long reads = 0, min_ops = ~0ULL, max_ops = 0;
+	struct worker *daemons, *readers;
+	char opts[128];
+	struct stat st;
+	bool tmp_mnt = false;
+	unsigned int i;
+	double secs;
+
+	argc = parse_options(argc, argv, options, bench_fuse_read_usage, 0);
+	if (argc || !bs || !nsecs)
+		usage_with_options(bench_fuse_read_usage, options);
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nthreads)
+		nthreads = ncpus;
+	if (!nreaders)
+		nreaders = ncpus;
+
+	if (filename) {
+		backing_fd = open(filename, O_RDONLY);
+		if (backing_fd < 0)
+			die("%s: %s\n", filename, strerror(errno));
+		BUG_ON(fstat(backing_fd, &st));
+		size = st.st_size;
+	} else {
+		size = (unsigned long long)size_mb << 20;
+		backing_mem = malloc(size);
+		BUG_ON(!backing_mem);
+		memset(backing_mem, 0x5a, size);
+	}
+	if (size < bs)
+		die("the file is smaller than a read\n");
+
+	/* not an error for 'perf bench all', which runs as any user */
+	master_fd = open("/dev/fuse", O_RDWR);
+	if (master_fd < 0) {
+		fprintf(stderr, "fuse read needs /dev/fuse: %s\n", strerror(errno));
+		return 1;
+	}
+	if (mnt_str) {
+		snprintf(mnt, sizeof(mnt), "%s", mnt_str);
+	} else {
+		snprintf(mnt, sizeof(mnt), "/tmp/perf-fuse-XXXXXX");
+		if (!mkdtemp(mnt))
+			die("mkdtemp: %s\n", strerror(errno));
+		tmp_mnt = true;
+	}
+	snprintf(opts, sizeof(opts), "fd=%d,rootmode=40000,user_id=%d,group_id=%d",
+		 master_fd, getuid(), getgid());
+	if (mount("perf-bench", mnt, "fuse", MS_NOSUID | MS_NODEV, opts)) {
+		fprintf(stderr, "fuse read needs to mount on %s, as root: %s\n",
+			mnt, strerror(errno));
+		close(master_fd);
+		if (tmp_mnt)
+			rmdir(mnt);
+		return 1;
+	}
+
+	daemons = calloc(nthreads, sizeof(*daemons));
+	readers = calloc(nreaders, sizeof(*readers));
+	BUG_ON(!daemons || !readers);
+
+	for (i = 0; i < nthreads; i++) {
+		daemons[i].cpu = i % ncpus;
+		BUG_ON(pthread_create(&daemons[i].thread, NULL, daemonfn, &daemons[i]));
+	}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nreaders; i++) {
+		readers[i].cpu = i % ncpus;
+		readers[i].seed = i + 1;
+		BUG_ON(pthread_create(&readers[i].thread, NULL, readerfn, &readers[i]));
+	}
+
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < nreaders; i++) {
+		BUG_ON(pthread_join(readers[i].thread, NULL));
+		reads += readers[i].ops;
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+
+	/* the daemon threads get ENODEV once the connection goes away */
+	if (umount2(mnt, MNT_DETACH))
+		die("umount: %s\n", strerror(errno));
+	for (i = 0; i < nthreads; i++) {
+		BUG_ON(pthread_join(daemons[i].thread, NULL));
+		if (daemons[i].ops < min_ops)
+			min_ops = daemons[i].ops;
+		if (daemons[i].ops > max_ops)
+			max_ops = daemons[i].ops;
+	}
+	close(master_fd);
+	if (tmp_mnt)
+		rmdir(mnt);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u readers doing %u byte reads, %u daemon threads on %s%s\n\n",
+		       nreaders, bs, nthreads,
+		       clone_dev ? "a cloned /dev/fuse each" : "one /dev/fuse",
+		       filename ? ", passing through" : "");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0f reads/sec\n", reads / secs);
+		printf(" %14.1f MB/sec\n", reads * bs / secs / (1 << 20));
+		printf(" %14llu min, %llu max reads per daemon thread\n",
+		       min_ops, max_ops);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f\n", reads / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	if (backing_fd >= 0)
+		close(backing_fd);
+	free(backing_mem);
+	free(readers);
+	free(daemons);
+	return 0;
+}
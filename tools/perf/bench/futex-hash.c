@@ -0,0 +1,209 @@
+/*
+ *
+ * futex-hash.c
+ *
+ * hash: Benchmark for the futex hash table
+ *
+ * Every thread does FUTEX_WAIT with a value that does not match on its own
+ * futexes, which returns -EAGAIN right after taking the lock of the hash
+ * bucket. So the throughput shows how much the threads, and the processes
+ * with -p, contend on the hash buckets.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+static unsigned int nthreads;
+static unsigned int nprocs = 1;
+static unsigned int nfutexes = 1024;
+static unsigned int nsecs = 10;
+static bool fshared = false;
+static int futex_flag;
+
+/* shared with the other processes of -p */
+struct hash_shared {
+	volatile int done;
+	unsigned long long ops[0]; /* per process */
+};
+
+static struct hash_shared *shared;
+
+struct worker {
+	pthread_t thread;
+	u_int32_t *futex;
+	unsigned long long ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads per process (default: number of cpus)"),
+	OPT_UINTEGER('p', "processes", &nprocs,
+		     "Specify number of processes"),
+	OPT_UINTEGER('f', "futexes", &nfutexes,
+		     "Specify number of futexes per thread"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime (in seconds)"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int i;
+	int ret;
+
+	while (!shared->done) {
+		for (i = 0; i < nfutexes; i++) {
+			/* the futexes hold 0, so this never blocks */
+			ret = futex_wait(&w->futex[i], 1234, NULL, futex_flag);
+			if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+				die("futex_wait: %s\n", strerror(errno));
+		}
+		w->ops += nfutexes;
+	}
+	return NULL;
+}
+
+static unsigned long long run_process(void)
+{
+	struct worker *workers;
+	unsigned long long ops = 0;
+	cpu_set_t cpu;
+	pthread_attr_t attr;
+	unsigned int i;
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	workers = calloc(nthreads, sizeof(*workers));
+	BUG_ON(!workers);
+
+	pthread_attr_init(&attr);
+	for (i = 0; i < nthreads; i++) {
+		workers[i].futex = calloc(nfutexes, sizeof(u_int32_t));
+		BUG_ON(!workers[i].futex);
+
+		/* spread the threads over the cpus */
+		CPU_ZERO(&cpu);
+		CPU_SET(i % ncpus, &cpu);
+		BUG_ON(pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpu));
+		BUG_ON(pthread_create(&workers[i].thread, &attr, workerfn, &workers[i]));
+	}
+	pthread_attr_destroy(&attr);
+
+	for (i = 0; i < nthreads; i++) {
+		BUG_ON(pthread_join(workers[i].thread, NULL));
+		ops += workers[i].ops;
+		free(workers[i].futex);
+	}
+	free(workers);
+	return ops;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	unsigned long long total = 0;
+	unsigned int i;
+	pid_t pid;
+	int status;
+	double secs;
+
+	argc = parse_options(argc, argv, options, bench_futex_hash_usage, 0);
+	if (argc)
+		usage_with_options(bench_futex_hash_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nprocs || !nfutexes || !nsecs)
+		usage_with_options(bench_futex_hash_usage, options);
+	futex_flag = fshared ? 0 : FUTEX_PRIVATE_FLAG;
+
+	shared = mmap(NULL, sizeof(*shared) + nprocs * sizeof(shared->ops[0]),
+		      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	BUG_ON(shared == MAP_FAILED);
+
+	gettimeofday(&start, NULL);
+
+	/* process 0 is this one, the others are forked */
+	for (i = 1; i < nprocs; i++) {
+		pid = fork();
+		BUG_ON(pid < 0);
+		if (!pid) {
+			shared->ops[i] = run_process();
+			exit(0);
+		}
+	}
+
+	if (fork() == 0) {
+		/* the timer */
+		sleep(nsecs);
+		shared->done = 1;
+		exit(0);
+	}
+	shared->ops[0] = run_process();
+
+	while (wait(&status) > 0)
+		;
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+
+	for (i = 0; i < nprocs; i++)
+		total += shared->ops[i];
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u process(es) of %u threads operating on %u %s futexes each\n\n",
+		       nprocs, nthreads, nfutexes, fshared ? "shared" : "private");
+
+		if (nprocs > 1) {
+			for (i = 0; i < nprocs; i++)
+				printf(" process %u: %14.0f ops/sec\n", i,
+				       shared->ops[i] / secs);
+			printf("\n");
+		}
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0f ops/sec\n", total / secs);
+		printf(" %14.0f ops/sec per thread\n",
+		       total / secs / (nprocs * nthreads));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f\n", total / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	munmap(shared, sizeof(*shared) + nprocs * sizeof(shared->ops[0]));
+	return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ *
+ * futex-wake.c
+ *
+ * wake: Benchmark for FUTEX_WAKE
+ *
+ * Threads block on one futex, and the main thread measures how long it
+ * takes to wake all of them up, --nwakes at a time.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static unsigned int nthreads;
+static unsigned int nwakes = 1;
+static unsigned int nrepeats = 10;
+static bool fshared = false;
+static int futex_flag;
+
+static u_int32_t futex1;
+static unsigned int nblocked;
+static pthread_mutex_t thread_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t thread_parent = PTHREAD_COND_INITIALIZER;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: number of cpus)"),
+	OPT_UINTEGER('w', "nwakes", &nwakes,
+		     "Specify number of threads to wake up per call"),
+	OPT_UINTEGER('r', "repeat", &nrepeats,
+		     "Specify number of repetitions"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use a shared futex instead of a private one"),
+	OPT_END()
+};
+
+static const char * const bench_futex_wake_usage[] = {
+	"perf bench futex wake <options>",
+	NULL
+};
+
+static void *blocked_workerfn(void *arg __maybe_unused)
+{
+	pthread_mutex_lock(&thread_lock);
+	nblocked++;
+	pthread_cond_signal(&thread_parent);
+	pthread_mutex_unlock(&thread_lock);
+
+	/* a spurious wakeup with futex1 still 0 waits again */
+	while (futex_wait(&futex1, 0, NULL, futex_flag) != 0) {
+		if (errno != EINTR && errno != EAGAIN)
+			break;
+	}
+	return NULL;
+}
+
+/* start the waiters and give them time to reach futex_wait() */
+static void block_threads(pthread_t *w)
+{
+	cpu_set_t cpu;
+	pthread_attr_t attr;
+	unsigned int i;
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	nblocked = 0;
+	pthread_attr_init(&attr);
+	for (i = 0; i < nthreads; i++) {
+		CPU_ZERO(&cpu);
+		CPU_SET(i % ncpus, &cpu);
+		BUG_ON(pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpu));
+		BUG_ON(pthread_create(&w[i], &attr, blocked_workerfn, NULL));
+	}
+	pthread_attr_destroy(&attr);
+
+	pthread_mutex_lock(&thread_lock);
+	while (nblocked < nthreads)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+	usleep(100000);
+}
+
+int bench_futex_wake(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	unsigned long long usecs, total_usecs = 0;
+	unsigned int i, j, nwoken;
+	pthread_t *w;
+
+	argc = parse_options(argc, argv, options, bench_futex_wake_usage, 0);
+	if (argc)
+		usage_with_options(bench_futex_wake_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nwakes || !nrepeats)
+		usage_with_options(bench_futex_wake_usage, options);
+	futex_flag = fshared ? 0 : FUTEX_PRIVATE_FLAG;
+
+	w = calloc(nthreads, sizeof(pthread_t));
+	BUG_ON(!w);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %u threads blocked on a %s futex, waking %u at a time\n\n",
+		       nthreads, fshared ? "shared" : "private", nwakes);
+
+	for (j = 0; j < nrepeats; j++) {
+		futex1 = 0;
+		block_threads(w);
+
+		nwoken = 0;
+		gettimeofday(&start, NULL);
+		while (nwoken != nthreads)
+			nwoken += futex_wake(&futex1, nwakes, futex_flag);
+		gettimeofday(&stop, NULL);
+		timersub(&stop, &start, &diff);
+
+		usecs = diff.tv_sec * 1000000ULL + diff.tv_usec;
+		total_usecs += usecs;
+		if (bench_format == BENCH_FORMAT_DEFAULT)
+			printf(" [Run %u]: woke %u threads in %.4f ms\n",
+			       j + 1, nwoken, usecs / 1000.0);
+
+		for (i = 0; i < nthreads; i++)
+			BUG_ON(pthread_join(w[i], NULL));
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("\n %14.4f ms per wakeup of all %u threads (avg of %u runs)\n",
+		       total_usecs / 1000.0 / nrepeats, nthreads, nrepeats);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.4f\n", total_usecs / 1000.0 / nrepeats);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(w);
+	return 0;
+}
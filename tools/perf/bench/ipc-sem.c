@@ -0,0 +1,197 @@
+/*
+ *
+ * ipc-sem.c
+ *
+ * sem: Benchmark for semop() on one big System V semaphore set
+ *
+ * Every thread owns one semaphore of a set with a semaphore per thread, as
+ * databases with one semaphore per backend set them up. By default each
+ * thread takes and releases its own semaphore, which never blocks, so the
+ * throughput shows how much the threads contend on the locking of the set.
+ * With --pingpong, the threads work in pairs that pass a token back and
+ * forth through their semaphores, so every operation sleeps and wakes up
+ * the partner. --complex does the same with two operations per semop(),
+ * which the kernel handles on the whole set.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/ipc.h>
+#include <sys/sem.h>
+
+static unsigned int nthreads;
+static unsigned int nsecs = 5;
+static bool pingpong = false;
+static bool complex_ops = false;
+
+static int semid;
+static volatile int done;
+
+struct worker {
+	pthread_t thread;
+	unsigned short num;		/* own semaphore */
+	unsigned long long ops;
+} __attribute__((aligned(64)));
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: number of cpus)"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime (in seconds)"),
+	OPT_BOOLEAN('p', "pingpong", &pingpong,
+		    "Pass a token between pairs of threads"),
+	OPT_BOOLEAN('C', "complex", &complex_ops,
+		    "Do two operations per semop() call"),
+	OPT_END()
+};
+
+static const char * const bench_ipc_sem_usage[] = {
+	"perf bench ipc sem <options>",
+	NULL
+};
+
+/*
+ * Add @op to semaphore @num. With --complex, a second operation that does
+ * not change anything is added, on the same semaphore.
+ */
+static void do_semop(unsigned short num, short op)
+{
+	struct sembuf sops[2] = {
+		{ .sem_num = num, .sem_op = op, .sem_flg = 0 },
+		{ .sem_num = num, .sem_op = 0, .sem_flg = IPC_NOWAIT },
+	};
+
+	/* the wait-for-zero would fail while the semaphore is up */
+	if (complex_ops && op > 0) {
+		sops[1] = sops[0];
+		sops[0].sem_op = 0;
+	}
+
+	while (semop(semid, sops, complex_ops ? 2 : 1)) {
+		if (errno == EINTR || errno == EAGAIN)
+			continue;
+		/* the set is removed at the end of the run */
+		if ((errno == EIDRM || errno == EINVAL) && done)
+			return;
+		die("semop: %s\n", strerror(errno));
+	}
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = arg;
+
+	while (!done) {
+		do_semop(w->num, -1);
+		do_semop(w->num, 1);
+		w->ops += 2;
+	}
+	return NULL;
+}
+
+/* odd threads start the token, even ones wait for it */
+static void *pingpongfn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned short partner = w->num ^ 1;
+
+	while (!done) {
+		do_semop(w->num, -1);
+		do_semop(partner, 1);
+		w->ops += 2;
+	}
+	return NULL;
+}
+
+int bench_ipc_sem(int argc, const char **argv,
+		  const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	unsigned long long total = 0;
+	struct worker *workers;
+	unsigned int i;
+	double secs;
+
+	argc = parse_options(argc, argv, options, bench_ipc_sem_usage, 0);
+	if (argc)
+		usage_with_options(bench_ipc_sem_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (pingpong)
+		nthreads = (nthreads + 1) & ~1U;
+	if (!nthreads || !nsecs)
+		usage_with_options(bench_ipc_sem_usage, options);
+
+	semid = semget(IPC_PRIVATE, nthreads, IPC_CREAT | 0600);
+	if (semid < 0)
+		die("semget: %s\n", strerror(errno));
+
+	workers = calloc(nthreads, sizeof(*workers));
+	BUG_ON(!workers);
+
+	for (i = 0; i < nthreads; i++) {
+		workers[i].num = i;
+		/* own semaphores start up, the waiting half of the pairs down */
+		if (!pingpong || (i & 1))
+			BUG_ON(semctl(semid, i, SETVAL, 1));
+	}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads; i++)
+		BUG_ON(pthread_create(&workers[i].thread, NULL,
+				      pingpong ? pingpongfn : workerfn,
+				      &workers[i]));
+
+	sleep(nsecs);
+	done = 1;
+
+	/* wakes up the threads still sleeping with EIDRM */
+	semctl(semid, 0, IPC_RMID);
+
+	for (i = 0; i < nthreads; i++) {
+		BUG_ON(pthread_join(workers[i].thread, NULL));
+		total += workers[i].ops;
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads doing %s semop()s %s\n\n", nthreads,
+		       complex_ops ? "complex" : "simple",
+		       pingpong ? "passing a token in pairs" : "on their own semaphore");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0f ops/sec\n", total / secs);
+		printf(" %14.0f ops/sec per thread\n", total / secs / nthreads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f\n", total / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(workers);
+	return 0;
+}
@@ -0,0 +1,289 @@
+/*
+ *
+ * mem-reclaim.c
+ *
+ * reclaim: Benchmark for allocation stalls under page cache pressure
+ *
+ * --readers threads stream through --file with read(), so the page cache
+ * keeps growing and the kernel has to reclaim the clean pages behind them
+ * all the time. Use a file larger than memory on fast storage. Meanwhile
+ * --threads threads map --size MB of anonymous memory, touch every page
+ * and unmap it again, timing each page fault. A fault that takes longer
+ * than --stall usecs counts as an allocation stall: the allocator did not
+ * find a free page and had to wait for reclaim. Reclaim throughput is
+ * taken from the pgsteal counters of /proc/vmstat, split between kswapd
+ * and direct reclaim.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define READ_CHUNK	(1 << 20)
+
+static const char *filename;
+static unsigned int nthreads;
+static unsigned int nreaders = 1;
+static unsigned int size_mb = 64;
+static unsigned int stall_us = 1000;
+static unsigned int nsecs = 10;
+
+static int fd;
+static unsigned long long file_size;
+static long page_size;
+static volatile int done;
+
+struct worker {
+	pthread_t thread;
+	unsigned long long offset;	/* where a reader starts */
+	unsigned long long ops;		/* pages touched, or bytes read */
+	unsigned long long stalls;
+	unsigned long long stall_ns;
+	unsigned long long max_ns;
+} __attribute__((aligned(64)));
+
+struct reclaim_stat {
+	unsigned long long steal_kswapd;
+	unsigned long long steal_direct;
+	unsigned long long scan_kswapd;
+	unsigned long long scan_direct;
+	unsigned long long allocstall;
+};
+
+static const struct option options[] = {
+	OPT_STRING('f', "file", &filename, "file",
+		   "Specify the file to stream through the page cache"),
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of allocating threads (default: number of cpus)"),
+	OPT_UINTEGER('R', "readers", &nreaders,
+		     "Specify number of threads reading the file"),
+	OPT_UINTEGER('s', "size", &size_mb,
+		     "Specify MB of memory an allocating thread maps at a time"),
+	OPT_UINTEGER('l', "stall", &stall_us,
+		     "Specify the page fault latency counted as a stall (in usecs)"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime (in seconds)"),
+	OPT_END()
+};
+
+static const char * const bench_mem_reclaim_usage[] = {
+	"perf bench mem reclaim -f <file> <options>",
+	NULL
+};
+
+/* the counters are per zone, sum them up */
+static void read_reclaim_stat(struct reclaim_stat *rs)
+{
+	char name[64];
+	unsigned long long val;
+	FILE *fp;
+
+	memset(rs, 0, sizeof(*rs));
+	fp = fopen("/proc/vmstat", "r");
+	if (!fp)
+		die("/proc/vmstat: %s\n", strerror(errno));
+
+	while (fscanf(fp, "%63s %llu", name, &val) == 2) {
+		if (!strncmp(name, "pgsteal_kswapd", 14))
+			rs->steal_kswapd += val;
+		else if (!strncmp(name, "pgsteal_direct", 14))
+			rs->steal_direct += val;
+		else if (!strncmp(name, "pgscan_kswapd", 13))
+			rs->scan_kswapd += val;
+		else if (!strncmp(name, "pgscan_direct", 13))
+			rs->scan_direct += val;
+		else if (!strcmp(name, "allocstall"))
+			rs->allocstall += val;
+	}
+	fclose(fp);
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *allocfn(void *arg)
+{
+	struct worker *w = arg;
+	size_t size = (size_t)size_mb << 20;
+	unsigned long long t0, t;
+	size_t off;
+	char *p;
+
+	while (!done) {
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			die("mmap: %s\n", strerror(errno));
+
+		for (off = 0; off < size && !done; off += page_size) {
+			t0 = now_ns();
+			p[off] = 1;
+			t = now_ns() - t0;
+
+			w->ops++;
+			if (t > w->max_ns)
+				w->max_ns = t;
+			if (t > stall_us * 1000ULL) {
+				w->stalls++;
+				w->stall_ns += t;
+			}
+		}
+		munmap(p, size);
+	}
+	return NULL;
+}
+
+static void *readerfn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long long pos = w->offset;
+	ssize_t ret;
+	char *buf;
+
+	buf = malloc(READ_CHUNK);
+	BUG_ON(!buf);
+
+	while (!done) {
+		ret = pread(fd, buf, READ_CHUNK, pos);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			die("pread: %s\n", strerror(errno));
+		}
+		w->ops += ret;
+		pos += ret;
+		/* wrap around at the end, the start is long gone from memory */
+		if (!ret || pos >= file_size)
+			pos = 0;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+int bench_mem_reclaim(int argc, const char **argv,
+		      const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	struct reclaim_stat before, after;
+	unsigned long long faults = 0, stalls = 0, stall_ns = 0, max_ns = 0;
+	unsigned long long bytes = 0;
+	struct worker *allocators, *readers;
+	struct stat st;
+	unsigned int i;
+	double secs;
+
+	argc = parse_options(argc, argv, options, bench_mem_reclaim_usage, 0);
+	if (argc || !size_mb || !nsecs)
+		usage_with_options(bench_mem_reclaim_usage, options);
+
+	/* not an error for 'perf bench all', which gives no options */
+	if (!filename) {
+		fprintf(stderr, "mem reclaim needs a file larger than memory, specify it with -f\n");
+		return 1;
+	}
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	page_size = sysconf(_SC_PAGESIZE);
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		die("%s: %s\n", filename, strerror(errno));
+	BUG_ON(fstat(fd, &st));
+	file_size = st.st_size;
+	if (!file_size)
+		die("%s is empty\n", filename);
+
+	allocators = calloc(nthreads, sizeof(*allocators));
+	readers = calloc(nreaders, sizeof(*readers));
+	BUG_ON(!allocators || !readers);
+
+	read_reclaim_stat(&before);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nreaders; i++) {
+		readers[i].offset = file_size / nreaders * i;
+		BUG_ON(pthread_create(&readers[i].thread, NULL, readerfn, &readers[i]));
+	}
+	for (i = 0; i < nthreads; i++)
+		BUG_ON(pthread_create(&allocators[i].thread, NULL, allocfn, &allocators[i]));
+
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		BUG_ON(pthread_join(allocators[i].thread, NULL));
+		faults += allocators[i].ops;
+		stalls += allocators[i].stalls;
+		stall_ns += allocators[i].stall_ns;
+		if (allocators[i].max_ns > max_ns)
+			max_ns = allocators[i].max_ns;
+	}
+	for (i = 0; i < nreaders; i++) {
+		BUG_ON(pthread_join(readers[i].thread, NULL));
+		bytes += readers[i].ops;
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+	read_reclaim_stat(&after);
+	close(fd);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads faulting in %u MB at a time, %u readers streaming %s\n\n",
+		       nthreads, size_mb, nreaders, filename);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0f page faults/sec\n", faults / secs);
+		printf(" %14llu stalls over %u usecs\n", stalls, stall_us);
+		printf(" %14.3f stall time [msec]\n", stall_ns / 1000000.0);
+		printf(" %14.3f max fault latency [msec]\n", max_ns / 1000000.0);
+		printf(" %14.1f MB/sec read\n\n", bytes / secs / (1 << 20));
+
+		printf(" %14.0f pages/sec reclaimed by kswapd (%llu scanned)\n",
+		       (after.steal_kswapd - before.steal_kswapd) / secs,
+		       after.scan_kswapd - before.scan_kswapd);
+		printf(" %14.0f pages/sec reclaimed directly (%llu scanned)\n",
+		       (after.steal_direct - before.steal_direct) / secs,
+		       after.scan_direct - before.scan_direct);
+		printf(" %14llu direct reclaim entries\n",
+		       after.allocstall - before.allocstall);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.3f\n", stall_ns / 1000000.0);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(readers);
+	free(allocators);
+	return 0;
+}
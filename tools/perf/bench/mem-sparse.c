@@ -0,0 +1,244 @@
+/*
+ *
+ * mem-sparse.c
+ *
+ * sparse-read: Benchmark for read faults on sparsely used anonymous memory
+ *
+ * Maps --size MB of anonymous memory, reads one byte every --stride KB of
+ * it and unmaps it again, --loops times. Programs that allocate large
+ * arrays or hash tables and look at only a part of them do the same. The
+ * suite reports the memory left resident by the reads, from
+ * /proc/self/statm, and the time the reads took per page fault. With
+ * transparent hugepages a read fault either allocates and clears a huge
+ * page or maps the huge zero page; compare the two by switching
+ * /sys/kernel/mm/transparent_hugepage/use_zero_page. With --write the
+ * memory is written with the same stride after it has been read, which
+ * measures the copy on write away from the zero page. The huge page
+ * allocations are taken from /proc/vmstat.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/* map at a huge page boundary, so every huge page of the range can be used */
+#define HUGE_ALIGN	(2UL << 20)
+
+static unsigned int size_mb = 512;
+static unsigned int stride_kb = 4;
+static unsigned int nloops = 4;
+static bool do_write;
+
+static long page_size;
+
+struct pass {
+	unsigned long long ns;		/* all the touches together */
+	unsigned long long max_ns;	/* slowest touch */
+	unsigned long long faults;
+	unsigned long long rss;		/* resident pages afterwards */
+};
+
+struct thp_stat {
+	unsigned long long fault_alloc;
+	unsigned long long fault_fallback;
+	unsigned long long zero_page_alloc;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('s', "size", &size_mb,
+		     "Specify MB of anonymous memory to map"),
+	OPT_UINTEGER('S', "stride", &stride_kb,
+		     "Specify KB from one byte read to the next"),
+	OPT_UINTEGER('l', "loops", &nloops,
+		     "Specify number of times to map, read and unmap the memory"),
+	OPT_BOOLEAN('w', "write", &do_write,
+		    "Write the memory with the same stride after reading it"),
+	OPT_END()
+};
+
+static const char * const bench_mem_sparse_read_usage[] = {
+	"perf bench mem sparse-read <options>",
+	NULL
+};
+
+static void read_thp_stat(struct thp_stat *ts)
+{
+	char name[64];
+	unsigned long long val;
+	FILE *fp;
+
+	memset(ts, 0, sizeof(*ts));
+	fp = fopen("/proc/vmstat", "r");
+	if (!fp)
+		die("/proc/vmstat: %s\n", strerror(errno));
+
+	while (fscanf(fp, "%63s %llu", name, &val) == 2) {
+		if (!strcmp(name, "thp_fault_alloc"))
+			ts->fault_alloc = val;
+		else if (!strcmp(name, "thp_fault_fallback"))
+			ts->fault_fallback = val;
+		else if (!strcmp(name, "thp_zero_page_alloc"))
+			ts->zero_page_alloc = val;
+	}
+	fclose(fp);
+}
+
+/* in pages */
+static unsigned long long resident(void)
+{
+	unsigned long long size, rss = 0;
+	FILE *fp;
+
+	fp = fopen("/proc/self/statm", "r");
+	if (!fp)
+		die("/proc/self/statm: %s\n", strerror(errno));
+	if (fscanf(fp, "%llu %llu", &size, &rss) != 2)
+		die("/proc/self/statm: unexpected format\n");
+	fclose(fp);
+	return rss;
+}
+
+static unsigned long long minor_faults(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_minflt;
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void touch(char *p, size_t size, size_t stride, bool write,
+		  struct pass *pass)
+{
+	unsigned long long t0, t, faults, rss;
+	volatile char *v = p;
+	size_t off;
+	char sum = 0;
+
+	rss = resident();
+	faults = minor_faults();
+	for (off = 0; off < size; off += stride) {
+		t0 = now_ns();
+		if (write)
+			v[off] = 1;
+		else
+			sum += v[off];
+		t = now_ns() - t0;
+
+		pass->ns += t;
+		if (t > pass->max_ns)
+			pass->max_ns = t;
+	}
+	pass->faults += minor_faults() - faults;
+	pass->rss += resident() - rss;
+
+	/* whatever was read must be zero */
+	BUG_ON(sum);
+}
+
+static void print_pass(const char *what, struct pass *pass)
+{
+	printf(" %14llu page faults per pass %s\n", pass->faults / nloops, what);
+	printf(" %14.1f MB resident after %s\n",
+	       (double)pass->rss / nloops * page_size / (1 << 20), what);
+	printf(" %14.3f usecs per page fault %s\n",
+	       pass->faults ? pass->ns / 1000.0 / pass->faults : 0.0, what);
+	printf(" %14.3f max latency %s [usecs]\n", pass->max_ns / 1000.0, what);
+}
+
+int bench_mem_sparse_read(int argc, const char **argv,
+			  const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	struct thp_stat before, after;
+	struct pass rd, wr;
+	size_t size, stride;
+	unsigned int i;
+	char *raw, *p;
+
+	argc = parse_options(argc, argv, options, bench_mem_sparse_read_usage, 0);
+	if (argc || !size_mb || !stride_kb || !nloops)
+		usage_with_options(bench_mem_sparse_read_usage, options);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	size = (size_t)size_mb << 20;
+	stride = (size_t)stride_kb << 10;
+
+	memset(&rd, 0, sizeof(rd));
+	memset(&wr, 0, sizeof(wr));
+
+	read_thp_stat(&before);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nloops; i++) {
+		raw = mmap(NULL, size + HUGE_ALIGN, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (raw == MAP_FAILED)
+			die("mmap: %s\n", strerror(errno));
+		p = (char *)(((unsigned long)raw + HUGE_ALIGN - 1) &
+			     ~(HUGE_ALIGN - 1));
+
+		touch(p, size, stride, false, &rd);
+		if (do_write)
+			touch(p, size, stride, true, &wr);
+
+		munmap(raw, size + HUGE_ALIGN);
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	read_thp_stat(&after);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# reading a byte every %u KB of %u MB of anonymous memory, %u times\n\n",
+		       stride_kb, size_mb, nloops);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14zu bytes read per pass\n", (size + stride - 1) / stride);
+		print_pass("reading", &rd);
+		if (do_write) {
+			printf("\n");
+			print_pass("writing", &wr);
+		}
+		printf("\n %14llu huge pages allocated by faults\n",
+		       after.fault_alloc - before.fault_alloc);
+		printf(" %14llu huge page faults fallen back to small pages\n",
+		       after.fault_fallback - before.fault_fallback);
+		printf(" %14llu huge zero page allocations\n",
+		       after.zero_page_alloc - before.zero_page_alloc);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.1f\n",
+		       (double)rd.rss / nloops * page_size / (1 << 20));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ *
+ * mem-swap.c
+ *
+ * swap: Benchmark for swap out and swap in throughput
+ *
+ * --threads threads share --size MB of anonymous memory, each thread owns
+ * a slice of it and writes to every page of its slice over and over. Make
+ * --size larger than the free memory, so every pass has to swap out the
+ * pages written a while ago and swap in the ones it comes back to, with
+ * all the threads allocating swap slots at the same time. Use a zram
+ * device or a swap file on a ramdisk to see the cost of the swap code
+ * rather than the one of the disk. The first pass fills the pages with
+ * data that compresses to about half, so zram has some work to do too.
+ * The swap traffic is taken from pswpout and pswpin of /proc/vmstat.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+static unsigned int nthreads;
+static unsigned int size_mb;
+static unsigned int nsecs = 10;
+
+static long page_size;
+static volatile int done;
+
+struct worker {
+	pthread_t thread;
+	char *start;			/* own slice of the mapping */
+	size_t size;
+	unsigned long long pages;	/* pages written */
+	unsigned long long passes;	/* complete passes over the slice */
+} __attribute__((aligned(64)));
+
+struct swap_stat {
+	unsigned long long pswpout;
+	unsigned long long pswpin;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('s', "size", &size_mb,
+		     "Specify MB of anonymous memory to cycle through, larger than free memory"),
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: number of cpus)"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime (in seconds)"),
+	OPT_END()
+};
+
+static const char * const bench_mem_swap_usage[] = {
+	"perf bench mem swap -s <MB> <options>",
+	NULL
+};
+
+static void read_swap_stat(struct swap_stat *ss)
+{
+	char name[64];
+	unsigned long long val;
+	FILE *fp;
+
+	memset(ss, 0, sizeof(*ss));
+	fp = fopen("/proc/vmstat", "r");
+	if (!fp)
+		die("/proc/vmstat: %s\n", strerror(errno));
+
+	while (fscanf(fp, "%63s %llu", name, &val) == 2) {
+		if (!strcmp(name, "pswpout"))
+			ss->pswpout = val;
+		else if (!strcmp(name, "pswpin"))
+			ss->pswpin = val;
+	}
+	fclose(fp);
+}
+
+/* in kB, as /proc/meminfo has it */
+static unsigned long long swap_total(void)
+{
+	char line[128];
+	unsigned long long val = 0;
+	FILE *fp;
+
+	fp = fopen("/proc/meminfo", "r");
+	if (!fp)
+		die("/proc/meminfo: %s\n", strerror(errno));
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "SwapTotal: %llu", &val) == 1)
+			break;
+	}
+	fclose(fp);
+	return val;
+}
+
+/* random words in the first half of the page, zeroes in the other */
+static void fill_page(char *page, unsigned long *seed)
+{
+	unsigned long *p = (unsigned long *)page;
+	size_t i;
+
+	for (i = 0; i < page_size / 2 / sizeof(*p); i++) {
+		*seed = *seed * 6364136223846793005UL + 1442695040888963407UL;
+		p[i] = *seed;
+	}
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long seed = (unsigned long)w;
+	size_t off;
+
+	for (off = 0; off < w->size && !done; off += page_size) {
+		fill_page(w->start + off, &seed);
+		w->pages++;
+	}
+
+	while (!done) {
+		/* dirty every page again, so it has to be written out again */
+		for (off = 0; off < w->size && !done; off += page_size) {
+			w->start[off]++;
+			w->pages++;
+		}
+		w->passes++;
+	}
+	return NULL;
+}
+
+int bench_mem_swap(int argc, const char **argv,
+		   const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	struct swap_stat before, after;
+	unsigned long long pages = 0, passes = 0;
+	unsigned long long swpout, swpin;
+	struct worker *workers;
+	size_t size, slice;
+	unsigned int i;
+	double secs;
+	char *p;
+
+	argc = parse_options(argc, argv, options, bench_mem_swap_usage, 0);
+	if (argc || !nsecs)
+		usage_with_options(bench_mem_swap_usage, options);
+
+	/* not an error for 'perf bench all', which gives no options */
+	if (!size_mb) {
+		fprintf(stderr, "mem swap needs more memory than is free, specify it with -s\n");
+		return 1;
+	}
+	if (!swap_total()) {
+		fprintf(stderr, "mem swap needs swap, there is none\n");
+		return 1;
+	}
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	page_size = sysconf(_SC_PAGESIZE);
+
+	size = (size_t)size_mb << 20;
+	slice = size / nthreads / page_size * page_size;
+	if (!slice)
+		usage_with_options(bench_mem_swap_usage, options);
+
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED)
+		die("mmap: %s\n", strerror(errno));
+
+	workers = calloc(nthreads, sizeof(*workers));
+	BUG_ON(!workers);
+
+	read_swap_stat(&before);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads; i++) {
+		workers[i].start = p + slice * i;
+		workers[i].size = slice;
+		BUG_ON(pthread_create(&workers[i].thread, NULL, workerfn, &workers[i]));
+	}
+
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		BUG_ON(pthread_join(workers[i].thread, NULL));
+		pages += workers[i].pages;
+		passes += workers[i].passes;
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+	read_swap_stat(&after);
+	munmap(p, size);
+
+	swpout = after.pswpout - before.pswpout;
+	swpin = after.pswpin - before.pswpin;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads writing to %u MB of anonymous memory\n\n",
+		       nthreads, size_mb);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0f pages/sec written\n", pages / secs);
+		printf(" %14llu passes over the memory\n", passes);
+		printf(" %14.0f pages/sec swapped out (%.1f MB/sec)\n",
+		       swpout / secs, swpout / secs * page_size / (1 << 20));
+		printf(" %14.0f pages/sec swapped in (%.1f MB/sec)\n",
+		       swpin / secs, swpin / secs * page_size / (1 << 20));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f\n", swpout / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(workers);
+	return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ *
+ * net-accept.c
+ *
+ * accept: Benchmark for the TCP connection rate over loopback
+ *
+ * --clients threads connect to 127.0.0.1 and reset the connection right
+ * away, so no TIME_WAIT sockets pile up, and --threads server threads
+ * accept and close the connections. By default all the servers accept on
+ * one listening socket, the way a prefork server shares its listener.
+ * With --reuseport every server binds its own listener to the port with
+ * SO_REUSEPORT, so each of them owns an accept queue and the kernel picks
+ * the queue by the hash of the flow.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT	15
+#endif
+
+static unsigned int nthreads;
+static unsigned int nclients;
+static unsigned int nsecs = 5;
+static unsigned int port;
+static bool reuseport = false;
+
+static struct sockaddr_in addr;
+static volatile int done;
+
+struct worker {
+	pthread_t thread;
+	int fd;				/* listener of a server thread */
+	unsigned long long conns;
+} __attribute__((aligned(64)));
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of server threads (default: number of cpus)"),
+	OPT_UINTEGER('c', "clients", &nclients,
+		     "Specify number of client threads (default: number of cpus)"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime (in seconds)"),
+	OPT_UINTEGER('p', "port", &port,
+		     "Specify the port to listen on (default: any free port)"),
+	OPT_BOOLEAN('R', "reuseport", &reuseport,
+		    "Give every server thread its own SO_REUSEPORT listener"),
+	OPT_END()
+};
+
+static const char * const bench_net_accept_usage[] = {
+	"perf bench net accept <options>",
+	NULL
+};
+
+/* the first listener picks the port when none is given, the others follow */
+static int setup_listener(void)
+{
+	socklen_t len = sizeof(addr);
+	int one = 1;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		die("socket: %s\n", strerror(errno));
+	BUG_ON(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+	if (reuseport &&
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)))
+		die("SO_REUSEPORT: %s\n", strerror(errno));
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		die("bind: %s\n", strerror(errno));
+	if (listen(fd, SOMAXCONN))
+		die("listen: %s\n", strerror(errno));
+	BUG_ON(getsockname(fd, (struct sockaddr *)&addr, &len));
+	return fd;
+}
+
+static void *serverfn(void *arg)
+{
+	struct worker *w = arg;
+	int fd;
+
+	while (!done) {
+		fd = accept(w->fd, NULL, NULL);
+		if (fd < 0) {
+			/* shutdown() of the listener at the end of the run */
+			if (done)
+				break;
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			die("accept: %s\n", strerror(errno));
+		}
+		close(fd);
+		w->conns++;
+	}
+	return NULL;
+}
+
+static void *clientfn(void *arg)
+{
+	struct worker *w = arg;
+	struct linger lin = { .l_onoff = 1, .l_linger = 0 };
+	int fd;
+
+	while (!done) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			die("socket: %s\n", strerror(errno));
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+			if (errno != EINTR && errno != EADDRNOTAVAIL)
+				die("connect: %s\n", strerror(errno));
+			close(fd);
+			continue;
+		}
+		/* reset instead of FIN, to keep the port out of TIME_WAIT */
+		BUG_ON(setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin)));
+		close(fd);
+		w->conns++;
+	}
+	return NULL;
+}
+
+int bench_net_accept(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	unsigned long long conns = 0, accepted = 0;
+	unsigned long long min_conns = ~0ULL, max_conns = 0;
+	struct worker *servers, *clients;
+	unsigned int i;
+	int shared_fd = -1;
+	double secs;
+
+	argc = parse_options(argc, argv, options, bench_net_accept_usage, 0);
+	if (argc)
+		usage_with_options(bench_net_accept_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nclients)
+		nclients = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nsecs || port > 65535)
+		usage_with_options(bench_net_accept_usage, options);
+
+	servers = calloc(nthreads, sizeof(*servers));
+	clients = calloc(nclients, sizeof(*clients));
+	BUG_ON(!servers || !clients);
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	if (!reuseport)
+		shared_fd = setup_listener();
+	for (i = 0; i < nthreads; i++)
+		servers[i].fd = reuseport ? setup_listener() : shared_fd;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads; i++)
+		BUG_ON(pthread_create(&servers[i].thread, NULL, serverfn, &servers[i]));
+	for (i = 0; i < nclients; i++)
+		BUG_ON(pthread_create(&clients[i].thread, NULL, clientfn, &clients[i]));
+
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < nclients; i++) {
+		BUG_ON(pthread_join(clients[i].thread, NULL));
+		conns += clients[i].conns;
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+
+	/* wakes up the servers sleeping in accept() */
+	if (!reuseport)
+		shutdown(shared_fd, SHUT_RDWR);
+	for (i = 0; i < nthreads; i++) {
+		if (reuseport)
+			shutdown(servers[i].fd, SHUT_RDWR);
+		BUG_ON(pthread_join(servers[i].thread, NULL));
+		if (reuseport)
+			close(servers[i].fd);
+		accepted += servers[i].conns;
+		if (servers[i].conns < min_conns)
+			min_conns = servers[i].conns;
+		if (servers[i].conns > max_conns)
+			max_conns = servers[i].conns;
+	}
+	if (!reuseport)
+		close(shared_fd);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u clients connecting to port %u, %u servers accepting on %s\n\n",
+		       nclients, ntohs(addr.sin_port), nthreads,
+		       reuseport ? "a SO_REUSEPORT listener each" : "one listener");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0f connections/sec\n", conns / secs);
+		printf(" %14llu connections accepted\n", accepted);
+		printf(" %14llu min, %llu max accepted per server\n",
+		       min_conns, max_conns);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f\n", conns / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(clients);
+	free(servers);
+	return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ *
+ * net-churn.c
+ *
+ * churn: Benchmark for the rate of new flows through connection tracking
+ *
+ * Every thread opens a UDP socket, sends one datagram to --addr and closes
+ * the socket again, so every datagram comes from a new source port and is
+ * a new flow for netfilter: with conntrack loaded each one allocates,
+ * confirms and, once the short UDP timeout hits, deletes a conntrack, the
+ * way the clients behind a NAT gateway do. Point --addr at the peer of a
+ * veth pair in another network namespace to go through the forwarding and
+ * NAT paths too. When --addr is local, a receiver drains the datagrams.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static unsigned int nthreads;
+static unsigned int nsecs = 5;
+static unsigned int port = 9;
+static const char *addr_str = "127.0.0.1";
+
+static struct sockaddr_in addr;
+static volatile int done;
+
+struct worker {
+	pthread_t thread;
+	unsigned long long flows;
+	unsigned long long errors;	/* sends the stack refused */
+} __attribute__((aligned(64)));
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: number of cpus)"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime (in seconds)"),
+	OPT_STRING('a', "addr", &addr_str, "addr",
+		   "Specify the IPv4 address to send to"),
+	OPT_UINTEGER('p', "port", &port,
+		     "Specify the UDP port to send to"),
+	OPT_END()
+};
+
+static const char * const bench_net_churn_usage[] = {
+	"perf bench net churn <options>",
+	NULL
+};
+
+static void *senderfn(void *arg)
+{
+	struct worker *w = arg;
+	char buf[64];
+	int fd;
+
+	memset(buf, 0, sizeof(buf));
+	while (!done) {
+		fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if (fd < 0)
+			die("socket: %s\n", strerror(errno));
+		/* connect() picks a fresh source port, so a new flow */
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+			die("connect: %s\n", strerror(errno));
+		/* the table can be full, or an ICMP error can be pending */
+		if (send(fd, buf, sizeof(buf), 0) < 0)
+			w->errors++;
+		else
+			w->flows++;
+		close(fd);
+	}
+	return NULL;
+}
+
+static void *receiverfn(void *arg)
+{
+	int fd = *(int *)arg;
+	char buf[64];
+
+	while (!done)
+		recv(fd, buf, sizeof(buf), 0);
+	return NULL;
+}
+
+int bench_net_churn(int argc, const char **argv,
+		    const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff, tmo = { .tv_sec = 0, .tv_usec = 100000 };
+	unsigned long long flows = 0, errors = 0;
+	struct worker *workers;
+	pthread_t receiver;
+	unsigned int i;
+	int rfd;
+	double secs;
+
+	argc = parse_options(argc, argv, options, bench_net_churn_usage, 0);
+	if (argc)
+		usage_with_options(bench_net_churn_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nsecs || !port || port > 65535)
+		usage_with_options(bench_net_churn_usage, options);
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, addr_str, &addr.sin_addr) != 1)
+		die("%s is not an IPv4 address\n", addr_str);
+
+	workers = calloc(nthreads, sizeof(*workers));
+	BUG_ON(!workers);
+
+	/* receive locally if we can, else the peer gets the datagrams */
+	rfd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (rfd < 0)
+		die("socket: %s\n", strerror(errno));
+	if (bind(rfd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(rfd);
+		rfd = -1;
+	} else {
+		BUG_ON(setsockopt(rfd, SOL_SOCKET, SO_RCVTIMEO, &tmo, sizeof(tmo)));
+		BUG_ON(pthread_create(&receiver, NULL, receiverfn, &rfd));
+	}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads; i++)
+		BUG_ON(pthread_create(&workers[i].thread, NULL, senderfn, &workers[i]));
+
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		BUG_ON(pthread_join(workers[i].thread, NULL));
+		flows += workers[i].flows;
+		errors += workers[i].errors;
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+
+	if (rfd >= 0) {
+		BUG_ON(pthread_join(receiver, NULL));
+		close(rfd);
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads sending one datagram per flow to %s:%u%s\n\n",
+		       nthreads, addr_str, port,
+		       rfd >= 0 ? " (local receiver)" : "");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0f flows/sec\n", flows / secs);
+		printf(" %14.0f flows/sec per thread\n", flows / secs / nthreads);
+		printf(" %14llu failed sends\n", errors);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f\n", flows / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(workers);
+	return 0;
+}
@@ -13,6 +13,12 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  futex ... futex hash table and wakeup paths
+ *  aio   ... asynchronous I/O submission and completion
+ *  epoll ... epoll event delivery and wakeups
+ *  ipc   ... System V IPC
+ *  net   ... TCP/IP socket layer
+ *  fuse  ... FUSE request queues
  *
  */
 
@@ -55,6 +61,84 @@ static struct bench_suite mem_suites[] = {
 	{ "memset",
 	  "Simple memory set in various ways",
 	  bench_mem_memset },
+	{ "reclaim",
+	  "Allocation stalls and reclaim rate under page cache pressure",
+	  bench_mem_reclaim },
+	{ "swap",
+	  "Swap out and swap in throughput of anonymous memory",
+	  bench_mem_swap },
+	{ "sparse-read",
+	  "Read faults and resident memory for sparsely read anonymous memory",
+	  bench_mem_sparse_read },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite futex_suites[] = {
+	{ "hash",
+	  "Contention on the futex hash buckets",
+	  bench_futex_hash },
+	{ "wake",
+	  "Wake up threads blocked on a futex",
+	  bench_futex_wake },
+	{ "requeue",
+	  "Requeue threads blocked on a futex to another one",
+	  bench_futex_requeue },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite aio_suites[] = {
+	{ "rw",
+	  "Random I/O with io_submit() and io_getevents()",
+	  bench_aio_rw },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite epoll_suites[] = {
+	{ "wait",
+	  "Many threads waiting for events on many fds",
+	  bench_epoll_wait },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite ipc_suites[] = {
+	{ "sem",
+	  "semop() on one semaphore set shared by many threads",
+	  bench_ipc_sem },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite net_suites[] = {
+	{ "accept",
+	  "Loopback TCP connection rate with many accepting threads",
+	  bench_net_accept },
+	{ "churn",
+	  "New UDP flows per second through connection tracking",
+	  bench_net_churn },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite fuse_suites[] = {
+	{ "read",
+	  "Small random reads through a FUSE filesystem served in-process",
+	  bench_fuse_read },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -74,6 +158,24 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "futex",
+	  "futex hash table and wakeup paths",
+	  futex_suites },
+	{ "aio",
+	  "asynchronous I/O submission and completion",
+	  aio_suites },
+	{ "epoll",
+	  "epoll event delivery and wakeups",
+	  epoll_suites },
+	{ "ipc",
+	  "System V IPC",
+	  ipc_suites },
+	{ "net",
+	  "TCP/IP socket layer",
+	  net_suites },
+	{ "fuse",
+	  "FUSE request queues",
+	  fuse_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "all benchmark subsystem",
 	  NULL },
@@ -10,6 +10,8 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
 #include <linux/vhost.h>
 #include <linux/virtio.h>
 #include <linux/virtio_ring.h>
@@ -29,8 +31,8 @@ struct vq_info {
 struct vdev_info {
 	struct virtio_device vdev;
 	int control;
-	struct pollfd fds[1];
-	struct vq_info vqs[1];
+	struct pollfd fds[VHOST_TEST_MAX_VQS];
+	struct vq_info vqs[VHOST_TEST_MAX_VQS];
 	int nvqs;
 	void *buf;
 	size_t buf_size;
@@ -133,28 +135,33 @@ static void vdev_info_init(struct vdev_info* dev, unsigned long long features)
  * for the wait queue on poll and another one on read,
  * plus the read which is there just to clear the
  * current state. */
-static void wait_for_interrupt(struct vdev_info *dev)
+static void wait_for_interrupt(struct vdev_info *dev, struct vq_info *vq)
 {
-	int i;
+	struct pollfd *fd = &dev->fds[vq->idx];
 	unsigned long long val;
-	poll(dev->fds, dev->nvqs, -1);
-	for (i = 0; i < dev->nvqs; ++i)
-		if (dev->fds[i].revents & POLLIN) {
-			read(dev->fds[i].fd, &val, sizeof val);
-		}
+	poll(fd, 1, -1);
+	if (fd->revents & POLLIN)
+		read(fd->fd, &val, sizeof val);
 }
 
+struct test_thread {
+	pthread_t thread;
+	struct vdev_info *dev;
+	struct vq_info *vq;
+	bool delayed;
+	int bufs;
+	long long spurious;
+};
+
 static void run_test(struct vdev_info *dev, struct vq_info *vq,
-		     bool delayed, int bufs)
+		     bool delayed, int bufs, long long *spuriousp)
 {
 	struct scatterlist sl;
 	long started = 0, completed = 0;
 	long completed_before;
-	int r, test = 1;
+	int r;
 	unsigned len;
 	long long spurious = 0;
-	r = ioctl(dev->control, VHOST_TEST_RUN, &test);
-	assert(r >= 0);
 	for (;;) {
 		virtqueue_disable_cb(vq->vq);
 		completed_before = completed;
@@ -186,16 +193,57 @@ static void run_test(struct vdev_info *dev, struct vq_info *vq,
 			break;
 		if (delayed) {
 			if (virtqueue_enable_cb_delayed(vq->vq))
-				wait_for_interrupt(dev);
+				wait_for_interrupt(dev, vq);
 		} else {
 			if (virtqueue_enable_cb(vq->vq))
-				wait_for_interrupt(dev);
+				wait_for_interrupt(dev, vq);
 		}
 	}
+	*spuriousp = spurious;
+}
+
+static void *test_thread_fn(void *arg)
+{
+	struct test_thread *t = arg;
+	run_test(t->dev, t->vq, t->delayed, t->bufs, &t->spurious);
+	return NULL;
+}
+
+/* Run the test on the first nvqs queues in parallel, one thread each,
+ * as a guest with a queue per vcpu would. */
+static void run_tests(struct vdev_info *dev, int nvqs, bool delayed, int bufs)
+{
+	struct test_thread threads[VHOST_TEST_MAX_VQS];
+	struct timeval start, stop;
+	long long spurious = 0;
+	double secs;
+	int i, r, test = 1;
+	r = ioctl(dev->control, VHOST_TEST_RUN, &test);
+	assert(r >= 0);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nvqs; ++i) {
+		threads[i].dev = dev;
+		threads[i].vq = &dev->vqs[i];
+		threads[i].delayed = delayed;
+		threads[i].bufs = bufs;
+		r = pthread_create(&threads[i].thread, NULL, test_thread_fn,
+				   &threads[i]);
+		assert(!r);
+	}
+	for (i = 0; i < nvqs; ++i) {
+		r = pthread_join(threads[i].thread, NULL);
+		assert(!r);
+		spurious += threads[i].spurious;
+	}
+	gettimeofday(&stop, NULL);
 	test = 0;
 	r = ioctl(dev->control, VHOST_TEST_RUN, &test);
 	assert(r >= 0);
+	secs = (stop.tv_sec - start.tv_sec) +
+		(stop.tv_usec - start.tv_usec) / 1000000.0;
 	fprintf(stderr, "spurious wakeus: 0x%llx\n", spurious);
+	fprintf(stderr, "%d queues: %.3f sec, %.0f bufs/sec\n",
+		nvqs, secs, (double)nvqs * bufs / secs);
 }
 
 const char optstring[] = "h";
@@ -228,6 +276,16 @@ const struct option longopts[] = {
 		.name = "no-delayed-interrupt",
 		.val = 'd',
 	},
+	{
+		.name = "vqs",
+		.val = 'q',
+		.has_arg = required_argument,
+	},
+	{
+		.name = "bufs",
+		.val = 'b',
+		.has_arg = required_argument,
+	},
 	{
 	}
 };
@@ -238,6 +296,8 @@ static void help()
 		" [--no-indirect]"
 		" [--no-event-idx]"
 		" [--delayed-interrupt]"
+		" [--vqs=N]"
+		" [--bufs=N]"
 		"\n");
 }
 
@@ -246,8 +306,9 @@ int main(int argc, char **argv)
 	struct vdev_info dev;
 	unsigned long long features = (1ULL << VIRTIO_RING_F_INDIRECT_DESC) |
 		(1ULL << VIRTIO_RING_F_EVENT_IDX);
-	int o;
+	int o, i;
 	bool delayed = false;
+	int nvqs = 1, bufs = 0x100000;
 
 	for (;;) {
 		o = getopt_long(argc, argv, optstring, longopts, NULL);
@@ -269,6 +330,20 @@ int main(int argc, char **argv)
 		case 'D':
 			delayed = true;
 			break;
+		case 'q':
+			nvqs = atoi(optarg);
+			if (nvqs < 1 || nvqs > VHOST_TEST_MAX_VQS) {
+				help();
+				exit(2);
+			}
+			break;
+		case 'b':
+			bufs = atoi(optarg);
+			if (bufs < 1) {
+				help();
+				exit(2);
+			}
+			break;
 		default:
 			assert(0);
 			break;
@@ -277,7 +352,8 @@ int main(int argc, char **argv)
 
 done:
 	vdev_info_init(&dev, features);
-	vq_info_add(&dev, 256);
-	run_test(&dev, &dev.vqs[0], delayed, 0x100000);
+	for (i = 0; i < nvqs; ++i)
+		vq_info_add(&dev, 256);
+	run_tests(&dev, nvqs, delayed, bufs);
 	return 0;
 }
@@ -128,11 +128,89 @@ bool kvm_is_mmio_pfn(pfn_t pfn)
 	return true;
 }
 
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+/* base round slice of a vcpu thread, the same as tools/fairamp */
+#define KVM_FAIRAMP_ROUND_SLICE 30000000U /* 30ms */
+#define KVM_FAIRAMP_MAX_FAST_SLICE (KVM_FAIRAMP_ROUND_SLICE - KVM_FAIRAMP_ROUND_SLICE / 100)
+
+/*
+ * Split the fast core share of the VM among its vcpus, so that a VM gets
+ * the same fast core time whatever the number of its vcpus.
+ * Called by the thread running @vcpu.
+ *
+ * The round slices the thread had before, set by the host (e.g. with
+ * tools/fairamp), are remembered and given back when the share drops to
+ * 0 or the vcpu moves to another thread. A host change made while the VM
+ * manages the thread is remembered as well, though the share wins.
+ */
+static void kvm_vcpu_fairamp_load(struct kvm_vcpu *vcpu, bool new_thread)
+{
+	struct kvm *kvm = vcpu->kvm;
+	struct sched_entity *se = &current->se;
+	int gen = atomic_read(&kvm->fairamp_gen);
+	int share = ACCESS_ONCE(kvm->fairamp_fast_share);
+	int nr_vcpus;
+	u32 fast_slice;
+
+	if (vcpu->fairamp_gen == gen && !(new_thread && share))
+		return;
+	vcpu->fairamp_gen = gen;
+
+	if (!vcpu->fairamp_managed ||
+	    se->unit_fast_vruntime != vcpu->fairamp_fast_slice ||
+	    se->unit_slow_vruntime != vcpu->fairamp_slow_slice) {
+		vcpu->fairamp_saved_fast = se->unit_fast_vruntime;
+		vcpu->fairamp_saved_slow = se->unit_slow_vruntime;
+	}
+
+	/* unmanaged: give the vcpu thread back to the host */
+	if (!share) {
+		if (vcpu->fairamp_managed)
+			fairamp_set_task_unit_vruntime(current,
+						       vcpu->fairamp_saved_fast,
+						       vcpu->fairamp_saved_slow);
+		vcpu->fairamp_managed = false;
+		return;
+	}
+
+	/*
+	 * Keep a slow round slice however large the share: a task with none
+	 * is banned from slow cores and would wait for a fast one.
+	 */
+	nr_vcpus = max(atomic_read(&kvm->online_vcpus), 1);
+	fast_slice = min_t(u64, div_u64((u64)(KVM_FAIRAMP_ROUND_SLICE / 100) * share,
+					nr_vcpus), KVM_FAIRAMP_MAX_FAST_SLICE);
+	vcpu->fairamp_fast_slice = fast_slice;
+	vcpu->fairamp_slow_slice = KVM_FAIRAMP_ROUND_SLICE - fast_slice;
+	vcpu->fairamp_managed = true;
+	fairamp_set_task_unit_vruntime(current, vcpu->fairamp_fast_slice,
+				       vcpu->fairamp_slow_slice);
+}
+
+/* give the round slices back to @pid, no longer running @vcpu */
+static void kvm_vcpu_fairamp_put(struct kvm_vcpu *vcpu, struct pid *pid)
+{
+	struct task_struct *task;
+
+	if (!vcpu->fairamp_managed)
+		return;
+	vcpu->fairamp_managed = false;
+
+	task = get_pid_task(pid, PIDTYPE_PID);
+	if (!task)
+		return;
+	fairamp_set_task_unit_vruntime(task, vcpu->fairamp_saved_fast,
+				       vcpu->fairamp_saved_slow);
+	put_task_struct(task);
+}
+#endif
+
 /*
  * Switches to specified vcpu, until a matching vcpu_put()
  */
 int vcpu_load(struct kvm_vcpu *vcpu)
 {
+	bool new_thread = false;
 	int cpu;
 
 	if (mutex_lock_killable(&vcpu->mutex))
@@ -143,8 +221,15 @@ int vcpu_load(struct kvm_vcpu *vcpu)
 		struct pid *newpid = get_task_pid(current, PIDTYPE_PID);
 		rcu_assign_pointer(vcpu->pid, newpid);
 		synchronize_rcu();
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+		kvm_vcpu_fairamp_put(vcpu, oldpid);
+#endif
 		put_pid(oldpid);
+		new_thread = true;
 	}
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+	kvm_vcpu_fairamp_load(vcpu, new_thread);
+#endif
 	cpu = get_cpu();
 	preempt_notifier_register(&vcpu->preempt_notifier);
 	kvm_arch_vcpu_load(vcpu, cpu);
@@ -249,6 +334,9 @@ EXPORT_SYMBOL_GPL(kvm_vcpu_init);
 
 void kvm_vcpu_uninit(struct kvm_vcpu *vcpu)
 {
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+	kvm_vcpu_fairamp_put(vcpu, vcpu->pid);
+#endif
 	put_pid(vcpu->pid);
 	kvm_arch_vcpu_uninit(vcpu);
 	free_page((unsigned long)vcpu->run);
@@ -1648,6 +1736,8 @@ bool kvm_vcpu_yield_to(struct kvm_vcpu *target)
 		put_task_struct(task);
 		return false;
 	}
+	/* a preempted vcpu likely holds the lock we spin on */
+	fairamp_lock_boost(task);
 	if (yield_to(task, 1)) {
 		put_task_struct(task);
 		return true;
@@ -1704,6 +1794,11 @@ void kvm_vcpu_on_spin(struct kvm_vcpu *me)
 	int i;
 
 	kvm_vcpu_set_in_spin_loop(me, true);
+	/*
+	 * Spinning wastes a fast core, so give up the rest of our fast
+	 * round to the tasks lagged on slow cores.
+	 */
+	fairamp_spin_yield();
 	/*
 	 * We boost the priority of a VCPU that is runnable but not
 	 * currently running, because it got preempted by something
@@ -1843,6 +1938,11 @@ static int kvm_vm_ioctl_create_vcpu(struct kvm *kvm, u32 id)
 	kvm->vcpus[atomic_read(&kvm->online_vcpus)] = vcpu;
 	smp_wmb();
 	atomic_inc(&kvm->online_vcpus);
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+	/* the fast core share is split among more vcpus now */
+	if (kvm->fairamp_fast_share)
+		atomic_inc(&kvm->fairamp_gen);
+#endif
 
 	mutex_unlock(&kvm->lock);
 	return r;
@@ -2239,6 +2339,21 @@ static long kvm_vm_ioctl(struct file *filp,
 		r = 0;
 		break;
 	}
+#endif
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+	case KVM_SET_FAIRAMP_FAST_SHARE:
+		r = -EINVAL;
+		if (arg > 100 * KVM_MAX_VCPUS)
+			goto out;
+		mutex_lock(&kvm->lock);
+		kvm->fairamp_fast_share = arg;
+		atomic_inc(&kvm->fairamp_gen);
+		mutex_unlock(&kvm->lock);
+		r = 0;
+		break;
+	case KVM_GET_FAIRAMP_FAST_SHARE:
+		r = kvm->fairamp_fast_share;
+		break;
 #endif
 	default:
 		r = kvm_arch_vm_ioctl(filp, ioctl, arg);
@@ -2370,6 +2485,9 @@ static long kvm_dev_ioctl_check_extension_generic(long arg)
 	case KVM_CAP_INTERNAL_ERROR_DATA:
 #ifdef CONFIG_HAVE_KVM_MSI
 	case KVM_CAP_SIGNAL_MSI:
+#endif
+#ifdef CONFIG_FAIRAMP_DO_SCHED
+	case KVM_CAP_FAIRAMP_FAST_SHARE:
 #endif
 		return 1;
 #ifdef KVM_CAP_IRQ_ROUTING